@@ -19,6 +19,18 @@ if lm.os == "windows" then
     }
 end
 
+if lm.os == "linux" then
+    lm:source_set "source_query_process" {
+        includes = {
+            "3rd/bee.lua",
+            "3rd/bee.lua/3rd/lua",
+        },
+        sources = {
+            "src/query_process/query_process_linux.cpp",
+        },
+    }
+end
+
 lm:executable "lua-debug" {
     bindir = "publish/bin/",
     deps = "source_bootstrap",
@@ -35,6 +47,7 @@ lm:executable "lua-debug" {
         ldflags = "-Wl,--out-implib,$obj/lua-debug.lib"
     },
     linux = {
+        deps = "source_query_process",
         crt = "static",
     },
     netbsd = {
@@ -226,6 +226,16 @@ attributes.common = {
         markdownDescription = "Automatically stop after thread entry.",
         type = "boolean",
     },
+    stallBudget = {
+        default = 0,
+        markdownDescription = "Capture the stack when the host doesn't call `heartbeat()` of the debugger for this many milliseconds. `0` disables it.",
+        type = "integer",
+    },
+    stallPause = {
+        default = false,
+        markdownDescription = "Pause the debuggee when a stall is captured.",
+        type = "boolean",
+    },
     address = {
         markdownDescription = [[
 Debugger address.
@@ -268,9 +278,21 @@ else
             "null",
         },
     }
+    attributes.common.autoAttachChildProcess = {
+        default = false,
+        markdownDescription = "Automatically debug child processes created by `fork()`.",
+        type = "boolean",
+    }
 end
 
 attributes.attach = {
+    addresses = {
+        markdownDescription = "Debugger addresses of several processes, debugged in one session. Threads are named after the address of their process. Each address has the same form as `address`.",
+        type = "array",
+        items = {
+            type = "string",
+        },
+    },
 }
 
 if OS == "win32" or OS == "darwin" then
@@ -322,6 +322,7 @@ for _, luaver in ipairs { "lua51", "lua52", "lua53", "lua54", "luajit", "lua-lat
         },
         sources = {
             "src/luadebug/*.cpp",
+            "src/luadebug/sampler/*.cpp",
             "src/luadebug/symbolize/*.cpp",
             "src/luadebug/thunk/*.cpp",
             "src/luadebug/util/*.cpp",
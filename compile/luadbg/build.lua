@@ -42,6 +42,10 @@ lm:phony {
     inputs = outpath..compile("lua.hpp"),
     outputs = {
         "src/luadebug/rdebug_hookmgr.cpp",
+        "src/luadebug/rdebug_sourcepool.cpp",
+        "src/luadebug/rdebug_profiler.cpp",
+        "src/luadebug/rdebug_sampler.cpp",
+        "src/luadebug/rdebug_strings.cpp",
         "src/luadebug/rdebug_debughost.cpp",
         "src/luadebug/rdebug_stdio.cpp",
         "src/luadebug/rdebug_utility.cpp",
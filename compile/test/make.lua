@@ -53,6 +53,14 @@ lm:executable "test_thunk" {
     includes = { "src/luadebug" },
 }
 
+lm:runlua "dap_bench" {
+    script = "test/dap_bench.lua",
+}
+
+lm:runlua "overhead_bench" {
+    script = "test/overhead_bench.lua",
+}
+
 lm:default {
     "test_frida",
     "test_delayload",
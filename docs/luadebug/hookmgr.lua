@@ -13,9 +13,11 @@ local hookmgr = {}
 ---* `bp` 执行有断点的proto时会触发，需要自己检查是否命中了行号。
 ---* `step` 满足单步状态时触发。
 ---* `funcbp` 每次进入一个函数时会触发。需要用hookmgr.funcbp_open激活。
+---* `heatproto` 和`newproto`类似，每次遇到新的proto时会触发。需要调用hookmgr.heat_add或hookmgr.heat_del告诉调试器是否统计这个proto的行执行次数。需要用hookmgr.heat_open激活。
 ---* `update` 每隔一段时间触发。需要用hookmgr.update_open激活。
 ---* `exception` 每次触发非内存错误时触发。需要用hookmgr.exception_open激活。需要补丁支持。
 ---* `thread` 每次进入或退出thread会触发。需要用hookmgr.thread_open激活。需要补丁支持。
+---* `stall` 捕获到一次卡顿后触发，参数是卡顿的时长（毫秒）。需要用hookmgr.stall_open激活，并且pause为true。
 ---
 function hookmgr.init(callback)
 end
@@ -62,6 +64,13 @@ end
 function hookmgr.break_del(proto)
 end
 
+---
+---@param proto lightuserdata
+---忘记proto是否有断点，下次执行到它时会再次触发`newproto`。
+---
+function hookmgr.break_reset(proto)
+end
+
 ---
 ---@param enable boolean
 ---启用`bp`事件。
@@ -82,6 +91,67 @@ end
 function hookmgr.funcbp_open(enable)
 end
 
+---
+---@param proto lightuserdata
+---统计这个proto每一行的执行次数。
+---
+function hookmgr.heat_add(proto)
+end
+
+---
+---@param proto lightuserdata
+---不统计这个proto的行执行次数。
+---
+function hookmgr.heat_del(proto)
+end
+
+---
+---@param enable boolean
+---开始或停止统计行执行次数，每次调用都会清空已有的统计。
+---
+function hookmgr.heat_open(enable)
+end
+
+---
+---@class LuaDebugHeatReport
+---@field proto lightuserdata
+---@field linedefined integer
+---@field counts integer[] 从linedefined开始每一行的执行次数。
+---
+
+---
+---@param reset boolean
+---@return LuaDebugHeatReport[]
+---返回行执行次数。reset为true时，返回后清零。
+---
+function hookmgr.heat_report(reset)
+end
+
+---
+---@param enable boolean
+---开始或停止统计C函数的调用次数和耗时，每次调用都会清空已有的统计。
+---
+function hookmgr.cstats_open(enable)
+end
+
+---
+---@class LuaDebugCFunctionStats
+---@field func string C函数的地址。
+---@field name string C函数的符号名。
+---@field module string? C函数所在的模块。
+---@field count integer 调用次数。
+---@field total integer 总耗时（纳秒）。
+---@field max integer 最大耗时（纳秒）。
+---@field histogram integer[][] 耗时的分布，每项为`{下限（纳秒）, 次数}`。
+---
+
+---
+---@return LuaDebugCFunctionStats[]
+---返回C函数的统计结果。
+---
+function hookmgr.cstats_report()
+end
+
 ---
 ---步入。
 ---
@@ -101,7 +171,25 @@ function hookmgr.step_over()
 end
 
 ---
----取消`step_in/step_out/step_over`的状态。
+---单步执行一条指令，只在当前的coroutine中生效。停下时同样触发`step`回调。
+---over为true时跳过被调用函数中的指令，回到当前或更浅的层级才停下。
+---
+---@param over boolean
+function hookmgr.step_instruction(over)
+end
+
+---
+---@param level integer
+---@param pc integer
+---@return boolean
+---步入level层函数中序号为pc的调用指令所调用的函数，停在它的第一行，中间的事件都不会进入调试器。
+---如果该函数离开了当前行或者返回都没有执行这个调用，则像步过一样停下。停下时同样触发`step`回调。
+---
+function hookmgr.step_into_call(level, pc)
+end
+
+---
+---取消`step_in/step_out/step_over/step_instruction/step_into_call`的状态。
 ---
 function hookmgr.step_cancel()
 end
@@ -113,6 +201,43 @@ end
 function hookmgr.update_open(enable)
 end
 
+---
+---@param budget integer
+---@param pause boolean | nil
+---启动卡顿检测。当宿主超过budget毫秒没有调用rdebug.heartbeat时，会在调试目标的线程中捕获一次完整的Lua栈，以及最上面3层的局部变量。
+---检测在一个独立的线程中进行，不需要常驻的hook。pause为true时，捕获后会触发`stall`事件。budget为0时停止检测。
+---
+function hookmgr.stall_open(budget, pause)
+end
+
+---
+---重新开始计时。调试目标停在调试器中的时间不应该被当作卡顿。
+---
+function hookmgr.stall_reset()
+end
+
+---
+---@class LuaDebugStallFrame
+---@field source string
+---@field line integer
+---@field name string
+---@field locals {name:string, value:string}[]?
+---
+
+---
+---@class LuaDebugStallReport
+---@field elapsed integer 捕获时已经卡顿的时长（毫秒）。
+---@field time integer 捕获的时间（Unix时间，秒）。
+---@field frames LuaDebugStallFrame[]
+---
+
+---
+---@return LuaDebugStallReport[]
+---返回最近的16次卡顿。
+---
+function hookmgr.stall_report()
+end
+
 ---
 ---@param enable boolean
 ---启用`exception`事件。
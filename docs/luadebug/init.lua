@@ -28,6 +28,20 @@ end
 function rdebug.event(name, ...)
 end
 
+---
+---@param budget integer | nil
+---协作模式。宿主在自己的主循环中调用它，调试器会在budget微秒内处理调试器的消息，包括断点的修改和暂停的请求，但至少会处理一条。
+---第一次调用后，调试器不再安装用于定时处理消息的hook，只在有断点或者单步时才会安装hook。它同时也是一次rdebug.heartbeat。
+---
+function rdebug.poll(budget)
+end
+
+---
+---宿主的心跳，通常在每一帧调用一次。卡顿检测（hookmgr.stall_open）通过它判断调试目标是否卡住了。
+---
+function rdebug.heartbeat()
+end
+
 ---
 ---@param str string
 ---@return string
@@ -44,4 +58,12 @@ end
 function rdebug.setenv(name, value)
 end
 
+---
+---@param callback fun(pid: integer)
+---设置fork回调。子进程继承的调试器VM不会再被执行，如果调试器要求附加子进程，会在子进程下一次调用rdebug.event/rdebug.poll/rdebug.heartbeat时调用callback，可以在其中重新启动调试器。
+---仅在非Windows下有效。
+---
+function rdebug.onfork(callback)
+end
+
 return rdebug
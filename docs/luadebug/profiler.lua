@@ -0,0 +1,39 @@
+---@meta
+
+---
+---@class LuaDebugProfiler
+---LuaJIT内置的采样分析器。采样不使用hook，也不会关闭JIT。
+---
+local profiler = {}
+
+---
+---@class LuaDebugProfilerOptions
+---@field interval integer? 采样间隔（毫秒），默认为1。
+---@field granularity "function" | "line" | nil 按函数或按行聚合，默认为function。
+---@field depth integer? 每个样本最多记录的栈深度，默认为64。
+---
+
+---
+---@class LuaDebugProfilerResult
+---@field samples integer 样本总数。
+---@field vmstate table<string, integer> 各个VM状态（compiled、interpreted、c、gc、jit）的样本数。
+---@field folded string 折叠栈格式的样本，每行为`栈 次数`，可以直接用于生成火焰图。
+---
+
+---
+---@param options LuaDebugProfilerOptions?
+---@return boolean
+---@return string?
+---开始采样。如果当前运行时不是LuaJIT，返回false和错误信息。
+---
+function profiler.start(options)
+end
+
+---
+---@return LuaDebugProfilerResult
+---停止采样，返回结果并清空已有的样本。
+---
+function profiler.stop()
+end
+
+return profiler
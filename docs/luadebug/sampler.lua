@@ -0,0 +1,33 @@
+---@meta
+
+---
+---@class LuaDebugSampler
+---同时采样native栈和Lua栈，并把它们合并为一个栈，用于生成跨越C边界的火焰图。
+---采样在独立的线程中进行，符号也在该线程中解析并缓存。
+---
+local sampler = {}
+
+---
+---@class LuaDebugSamplerResult
+---@field samples integer 样本总数。
+---@field missed integer 没有采到的样本数。
+---@field folded string 折叠栈格式的样本，每行为`栈 次数`。
+---
+
+---
+---@param options { interval: integer? }?
+---@return boolean
+---@return string?
+---开始采样，interval为采样间隔（毫秒），默认为10。如果当前平台不支持，返回false和错误信息。
+---
+function sampler.start(options)
+end
+
+---
+---@return LuaDebugSamplerResult
+---停止采样，返回结果并清空已有的样本。
+---
+function sampler.stop()
+end
+
+return sampler
@@ -0,0 +1,46 @@
+---@meta
+
+---
+---@class LuaDebugSourcePool
+---保存内存中的源码（非文件的chunk）。
+---
+local sourcepool = {}
+
+---
+---@class LuaDebugSourcePoolObject
+---
+local pool = {}
+
+---
+---@param text string
+---@return integer
+---保存一段源码，返回它的引用。相同的源码总是返回相同的引用，即使它已经被换出到磁盘。引用不会被重用。
+---
+function pool:add(text)
+end
+
+---
+---@param ref integer
+---@return string | nil
+---通过引用获取源码。
+---
+function pool:get(ref)
+end
+
+---
+---@return integer
+---@return integer
+---返回内存中和临时文件中的源码字节数。
+---
+function pool:memory()
+end
+
+---
+---@param capacity? integer
+---@return LuaDebugSourcePoolObject
+---获取进程共享的源码池，没有时创建它（capacity默认为64MB，只在创建时使用）。超过capacity字节后，最久没有使用的源码会被换出到临时文件。源码不会被丢弃。
+---
+function sourcepool.get(capacity)
+end
+
+return sourcepool
@@ -0,0 +1,46 @@
+---@meta
+
+---
+---@class LuaDebugStrings
+---分析调试目标的字符串堆：找出最大的字符串及其引用路径，以及内容重复的长字符串。
+---LuaJIT的字符串表无法遍历，只统计从_G或注册表可达的字符串；它的字符串全部是内部化的，没有重复。
+---
+local strings = {}
+
+---
+---@class LuaDebugStringsTop
+---@field size integer 字符串长度。
+---@field preview string 字符串的前64字节，不可打印的字符会被转义。
+---@field referrers string[] 从_G或注册表到该字符串的路径，最多3条。
+---
+
+---
+---@class LuaDebugStringsDuplicate
+---@field hash string 内容的哈希值。
+---@field count integer 相同内容的字符串个数。
+---@field size integer 字符串长度。
+---@field wasted integer 重复占用的字节数。
+---@field preview string 字符串的前64字节。
+---
+
+---
+---@class LuaDebugStringsResult
+---@field strings integer 遍历到的字符串个数，包括尚未回收的字符串。
+---@field bytes integer 遍历到的字符串总长度。
+---@field wasted integer 所有重复的长字符串占用的字节数。
+---@field truncated boolean 是否因为超出时间预算而提前结束。
+---@field reachable boolean 是否只统计了从_G或注册表可达的字符串。
+---@field top LuaDebugStringsTop[] 最大的字符串，按长度降序排列。
+---@field duplicates LuaDebugStringsDuplicate[] 重复的长字符串，按浪费的字节数降序排列。
+---
+
+---
+---@param options { top: integer?, minSize: integer?, budget: integer? }?
+---@return LuaDebugStringsResult
+---分析字符串堆。top为返回的条目数，默认为20；minSize为参与重复检测的最小长度，默认为256；
+---budget为时间预算（毫秒），默认为200，超出后返回已有的结果。
+---
+function strings.analyze(options)
+end
+
+return strings
@@ -34,6 +34,34 @@ end
 function utility.closeprocess()
 end
 
+---
+---@return integer
+---获取当前进程的pid。
+---
+function utility.getpid()
+end
+
+---
+---@return integer
+---单调时钟，单位为微秒。
+---
+function utility.monotonic()
+end
+
+---
+---@param enable boolean
+---是否附加fork出的子进程。开启后子进程会在启动时通知父进程，并调用`onfork`回调。
+---
+function utility.forkattach(enable)
+end
+
+---
+---@return integer[]
+---返回上次调用后新fork出的子进程pid。
+---
+function utility.forkchildren()
+end
+
 ---
 ---@param str string
 ---@return string
@@ -178,6 +178,28 @@ end
 function visitor.tablesize(t)
 end
 
+---
+---@param t any
+---@param start? integer
+---@param count? integer
+---@param filter? string
+---@param prefix? boolean
+---@return refvalue[]
+---@return integer
+---返回table（包括数组部分中非nil的值）按key排序后的第start个（从0开始）起的count个值，排序规则与serialize.lua相同。
+---如果指定了filter，只保留包含filter的key；prefix为true时只保留以filter开头的key。只有字符串和数字的key可以匹配。
+---排序结果会被缓存，直到调用visitor.cleantablesort。
+---返回值是一个数组，每三个值分别为key/value/value(ref)；第二个返回值为匹配的key的总数。
+---
+function visitor.tablesort(t, start, count, filter, prefix)
+end
+
+---
+---清除visitor.tablesort缓存的排序结果。
+---
+function visitor.cleantablesort()
+end
+
 ---
 ---@param ud refvalue
 ---@param offset integer
@@ -207,6 +229,18 @@ end
 function visitor.value(v)
 end
 
+---
+---@param v refvalue | light-refvalue
+---@param i? integer
+---@param j? integer
+---@return string?
+---@return integer?
+---返回v引用的字符串从i到j的部分，规则与string.sub相同，第二个返回值为字符串的长度。
+---超过4096字节的字符串不会被复制到调试器VM中，而是以refvalue表示，可以用它按需读取其中的一部分。
+---
+function visitor.strsub(v, i, j)
+end
+
 ---
 ---@param v refvalue
 ---@param new light-refvalue
@@ -239,6 +273,45 @@ end
 function visitor.getinfo(frame, what, result)
 end
 
+---
+---@param frame integer
+---@return string | nil
+---@return integer | nil
+---返回frame正在执行的指令的地址，以及它在函数中的序号（从0开始）。C函数或者无法得知时返回nil，LuaJIT总是返回nil。
+---
+function visitor.getpc(frame)
+end
+
+---@class visitor.calltarget
+---@field pc integer
+---@field name string
+
+---
+---@param frame integer
+---@return visitor.calltarget[] | nil
+---返回frame当前行中从正在执行的指令开始的所有调用指令，按执行顺序排列。name从字节码中推断，推断不出时为"?"。
+---C函数或者无法得知pc时返回nil。
+---
+function visitor.calltargets(frame)
+end
+
+---@class visitor.instruction
+---@field address string
+---@field line integer
+---@field opname string
+---@field operands string
+---@field comment string?
+
+---
+---@param frame integer | refvalue
+---@return visitor.instruction[] | nil
+---@return integer | nil
+---反汇编frame或者函数引用的字节码，格式与luac -l相同，comment为常量或者跳转的目标。不是Lua函数时返回nil。
+---如果frame是栈层级，第二个返回值为正在执行的指令的序号（从0开始）。
+---
+function visitor.disassemble(frame)
+end
+
 ---
 ---@param script string
 ---@return refvalue
@@ -296,4 +369,22 @@ end
 function visitor.cfunctioninfo(fun)
 end
 
+---@class visitor.vm
+---@field state string
+---@field status string
+---@field version string
+---@field heap integer?
+---@field hookmask integer
+---@field coroutines integer?
+---@field current boolean?
+
+---
+---返回进程中所有的Lua虚拟机，第一个是调试器所在的虚拟机。
+---其他虚拟机只有调试器由launcher注入时才有，heap为该虚拟机最后一次执行attach hook时的内存。
+---status为"attached"、"watching"或"failed"。
+---@return visitor.vm[]
+---
+function visitor.vms()
+end
+
 return visitor
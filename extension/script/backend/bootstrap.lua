@@ -1,9 +1,12 @@
 local thread = require "bee.thread"
+local utility = require "luadebug.utility"
+
+local MasterChannel <const> = ('DbgMaster(%d)'):format(utility.getpid())
 
 local m = {}
 
 local function hasMaster()
-    local ok = pcall(thread.channel, "DbgMaster")
+    local ok = pcall(thread.channel, MasterChannel)
     return ok
 end
 
@@ -11,7 +14,7 @@ local function initMaster(logpath, address)
     if hasMaster() then
         return
     end
-    thread.newchannel "DbgMaster"
+    thread.newchannel(MasterChannel)
     local mt = thread.thread(([[
         package.path = %q
         local log = require "common.log"
@@ -31,7 +34,7 @@ local function initMaster(logpath, address)
         address
     ))
     ExitGuard = setmetatable({}, {__gc=function()
-        local c = thread.channel "DbgMaster"
+        local c = thread.channel(MasterChannel)
         c:push(nil, "EXIT")
         thread.wait(mt)
     end})
@@ -48,6 +51,12 @@ function m.start(logpath, address)
     startWorker(logpath)
 end
 
+function m.headless(logpath, configpath)
+    local log = require 'common.log'
+    log.file = logpath..'/headless.log'
+    require 'backend.headless'.start(configpath)
+end
+
 function m.attach(logpath)
     if hasMaster() then
         startWorker(logpath)
@@ -0,0 +1,363 @@
+local hookmgr = require 'luadebug.hookmgr'
+local rdebug = require 'luadebug.visitor'
+local fs = require 'bee.filesystem'
+local json = require 'common.json'
+local log = require 'common.log'
+
+-- Runs the collectors of the debugger without a client: no master thread
+-- and no network. A config file picks the collectors, and their results
+-- are written to an output directory at a fixed interval and on exit.
+--
+--  {
+--      "output": "luadebug-out",
+--      "flushInterval": 10,
+--      "profiler": { "mode": "vm" | "mixed" | "cfunction", "interval": 10, "depth": 64 },
+--      "coverage": { "sources": [ "src/" ] },
+--      "strings": { "top": 20, "minSize": 256, "budget": 200, "interval": 300 },
+--      "stall": { "budget": 500 }
+--  }
+--
+-- The stall detector needs the host to call heartbeat() of the debugger
+-- from its main loop.
+
+local m = {}
+
+local config
+local output
+local lastFlush = 0
+local info = {}
+
+local function readfile(filename)
+    local f, err = io.open(filename, 'rb')
+    if not f then
+        return nil, err
+    end
+    local content = f:read 'a'
+    f:close()
+    return content
+end
+
+local function writefile(name, content)
+    local filename = output .. '/' .. name
+    local f, err = io.open(filename, 'wb')
+    if not f then
+        log.error('headless: ' .. err)
+        return
+    end
+    f:write(content)
+    f:close()
+end
+
+local function normalize(path)
+    return (path:gsub('\\', '/'))
+end
+
+local profiler = {}
+
+do
+    local folded = {}
+    local p
+    local options
+
+    local function merge(res)
+        if not res or not res.folded then
+            return
+        end
+        for stack, n in res.folded:gmatch '([^\n]+) (%d+)\n' do
+            folded[stack] = (folded[stack] or 0) + tonumber(n)
+        end
+    end
+
+    local function write()
+        local lines = {}
+        for stack, n in pairs(folded) do
+            lines[#lines + 1] = ('%s %d\n'):format(stack, n)
+        end
+        table.sort(lines)
+        writefile('profile.folded', table.concat(lines))
+    end
+
+    function profiler.start(cfg)
+        options = {
+            interval = cfg.interval,
+            granularity = cfg.granularity,
+            depth = cfg.depth,
+        }
+        if cfg.mode == 'cfunction' then
+            hookmgr.cstats_open(true)
+            p = 'cfunction'
+            return
+        end
+        p = require(cfg.mode == 'mixed' and 'luadebug.sampler' or 'luadebug.profiler')
+        local ok, err = p.start(options)
+        if not ok then
+            log.error('headless: ' .. tostring(err))
+            p = nil
+        end
+    end
+
+    function profiler.flush(final)
+        if p == 'cfunction' then
+            local functions = hookmgr.cstats_report()
+            table.sort(functions, function(a, b)
+                return a.total > b.total
+            end)
+            writefile('cfunction.json', json.encode { functions = functions })
+            return
+        end
+        if not p then
+            return
+        end
+        merge(p.stop())
+        if not final then
+            p.start(options)
+        end
+        write()
+    end
+end
+
+local coverage = {}
+
+do
+    local prefixes
+    local protos = {}
+    local files = {}
+    local activelines = {}
+
+    local function selected(path)
+        if not prefixes then
+            return true
+        end
+        for _, prefix in ipairs(prefixes) do
+            if path:sub(1, #prefix) == prefix then
+                return true
+            end
+        end
+        return false
+    end
+
+    -- Lines that have code, so that lines never run are reported too.
+    local function getactivelines(path)
+        local lines = activelines[path]
+        if lines then
+            return lines
+        end
+        lines = {}
+        local content = readfile(path)
+        if content then
+            local parser = require 'backend.worker.parser'
+            local ok, lineinfo = pcall(parser, content)
+            if ok and lineinfo then
+                for line, active in pairs(lineinfo) do
+                    if line == active then
+                        lines[line] = true
+                    end
+                end
+            end
+        end
+        activelines[path] = lines
+        return lines
+    end
+
+    function coverage.start(cfg)
+        if cfg.sources then
+            prefixes = {}
+            for _, s in ipairs(cfg.sources) do
+                prefixes[#prefixes + 1] = normalize(s)
+            end
+        end
+        hookmgr.heat_open(true)
+    end
+
+    function coverage.newproto(proto, level)
+        rdebug.getinfo(level, "S", info)
+        local source = info.source
+        if source and source:sub(1, 1) == '@' then
+            local path = normalize(source:sub(2))
+            if selected(path) then
+                protos[proto] = path
+                hookmgr.heat_add(proto)
+                return
+            end
+        end
+        hookmgr.heat_del(proto)
+    end
+
+    function coverage.flush()
+        for _, h in ipairs(hookmgr.heat_report(true)) do
+            local path = protos[h.proto]
+            if path then
+                local counts = files[path]
+                if not counts then
+                    counts = {}
+                    files[path] = counts
+                end
+                for i, n in ipairs(h.counts) do
+                    if n > 0 then
+                        local line = h.linedefined + i - 1
+                        counts[line] = (counts[line] or 0) + n
+                    end
+                end
+            end
+        end
+        local paths = {}
+        for path in pairs(files) do
+            paths[#paths + 1] = path
+        end
+        table.sort(paths)
+        local out = {}
+        for _, path in ipairs(paths) do
+            local counts = files[path]
+            local lines = {}
+            for line in pairs(getactivelines(path)) do
+                lines[line] = counts[line] or 0
+            end
+            for line, n in pairs(counts) do
+                lines[line] = n
+            end
+            local sorted = {}
+            for line in pairs(lines) do
+                sorted[#sorted + 1] = line
+            end
+            table.sort(sorted)
+            local hit = 0
+            out[#out + 1] = 'TN:\n'
+            out[#out + 1] = ('SF:%s\n'):format(path)
+            for _, line in ipairs(sorted) do
+                local n = lines[line]
+                if n > 0 then
+                    hit = hit + 1
+                end
+                out[#out + 1] = ('DA:%d,%d\n'):format(line, n)
+            end
+            out[#out + 1] = ('LF:%d\nLH:%d\nend_of_record\n'):format(#sorted, hit)
+        end
+        writefile('coverage.lcov', table.concat(out))
+    end
+end
+
+local strings = {}
+
+do
+    local options
+    local interval
+    local lastRun = 0
+
+    function strings.start(cfg)
+        options = {
+            top = cfg.top,
+            minSize = cfg.minSize,
+            budget = cfg.budget,
+        }
+        interval = cfg.interval or 300
+    end
+
+    -- The analysis stops the debuggee for up to its budget, so it runs on
+    -- its own, much longer interval. The debuggee is being closed on the
+    -- final flush, so nothing runs then.
+    function strings.flush(final)
+        local now = os.time()
+        if final or now - lastRun < interval then
+            return
+        end
+        lastRun = now
+        local ok, res = pcall(require 'luadebug.strings'.analyze, options)
+        if ok then
+            res.time = os.time()
+            writefile('strings.json', json.encode(res))
+        else
+            log.error('headless: ' .. tostring(res))
+        end
+    end
+end
+
+local stall = {}
+
+function stall.start(cfg)
+    hookmgr.stall_open(cfg.budget or 500, false)
+end
+
+function stall.flush()
+    writefile('stalls.json', json.encode { reports = hookmgr.stall_report() })
+end
+
+local collectors = {
+    profiler = profiler,
+    coverage = coverage,
+    strings = strings,
+    stall = stall,
+}
+
+local function flush(final)
+    for name, c in pairs(collectors) do
+        if config[name] then
+            c.flush(final)
+        end
+    end
+end
+
+local event = {}
+
+function event.update()
+    local now = os.time()
+    if now - lastFlush >= (config.flushInterval or 10) then
+        lastFlush = now
+        flush(false)
+    end
+end
+
+-- A host that calls poll() drives the flushes itself.
+function event.poll()
+    hookmgr.update_open(false)
+    event.update()
+end
+
+function event.heatproto(proto, level)
+    if config.coverage then
+        coverage.newproto(proto, level)
+    else
+        hookmgr.heat_del(proto)
+    end
+end
+
+function event.exit()
+    flush(true)
+end
+
+-- A coroutine gets the hooks of the collectors when it starts running.
+function event.thread()
+    hookmgr.updatehookmask(hookmgr.gethost())
+end
+
+function m.start(configpath)
+    local content, err = readfile(configpath)
+    if not content then
+        log.error('headless: ' .. err)
+        return
+    end
+    config = json.decode(content)
+    output = config.output or 'luadebug-out'
+    fs.create_directories(output)
+    hookmgr.init(function(name, ...)
+        local ok, e = xpcall(function(...)
+            if event[name] then
+                return event[name](...)
+            end
+        end, debug.traceback, ...)
+        if not ok then
+            log.error('headless: ' .. e)
+        end
+    end)
+    for name, c in pairs(collectors) do
+        if config[name] then
+            c.start(config[name])
+        end
+    end
+    lastFlush = os.time()
+    hookmgr.update_open(true)
+    if hookmgr.thread_open then
+        hookmgr.thread_open(true)
+    end
+end
+
+return m
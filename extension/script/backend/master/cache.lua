@@ -0,0 +1,126 @@
+-- Read-only state of the workers, kept up to date by the events they send.
+-- The requests that only read this state are answered by the master, so
+-- they never wait for the debuggee to reach its update hook.
+
+local sourcepool = require 'luadebug.sourcepool'
+
+local m = {}
+
+-- The texts of the sources without a path, added by the workers.
+local codePool = sourcepool.get()
+local loaded = {}
+local exceptions = {}
+-- Replies a stopped worker prepared for the requests a client sends right
+-- after the stop. Each one is used once, and they are all dropped as soon
+-- as the worker may change.
+local stops = {}
+
+local function sourceKey(source)
+    return source.sourceReference or source.path
+end
+
+function m.loadedSource(w, reason, source)
+    local key = sourceKey(source)
+    if not key then
+        return
+    end
+    local sources = loaded[w]
+    if not sources then
+        sources = {}
+        loaded[w] = sources
+    end
+    if reason == 'removed' then
+        sources[key] = nil
+        return
+    end
+    sources[key] = source
+end
+
+function m.loadedSources()
+    local res = {}
+    local mark = {}
+    for _, sources in pairs(loaded) do
+        for key, source in pairs(sources) do
+            if not mark[key] then
+                mark[key] = true
+                res[#res+1] = source
+            end
+        end
+    end
+    return res
+end
+
+function m.source(sourceReference)
+    return codePool:get(sourceReference & 0xFFFFFFFF)
+end
+
+function m.setException(w, info)
+    exceptions[w] = info
+end
+
+function m.exceptionInfo(w)
+    return exceptions[w]
+end
+
+function m.setStop(w, prefetch)
+    stops[w] = prefetch
+end
+
+function m.dropStop(w)
+    if w then
+        stops[w] = nil
+    else
+        stops = {}
+    end
+end
+
+-- The workers run again, so what they reported while stopped is stale.
+function m.resume()
+    exceptions = {}
+    stops = {}
+end
+
+function m.stackTrace(w, startFrame, levels)
+    local prefetch = stops[w]
+    if not prefetch then
+        return
+    end
+    startFrame = startFrame or 0
+    levels = levels or 0
+    for i, st in ipairs(prefetch.stackTrace) do
+        if st.startFrame == startFrame and st.levels == levels then
+            table.remove(prefetch.stackTrace, i)
+            return st.body
+        end
+    end
+end
+
+function m.scopes(w, frameId)
+    local prefetch = stops[w]
+    local scopes = prefetch and prefetch.scopes
+    if scopes and scopes.frameId == frameId then
+        prefetch.scopes = nil
+        return scopes.body
+    end
+end
+
+function m.variables(w, variablesReference)
+    local prefetch = stops[w]
+    if not prefetch then
+        return
+    end
+    for i, v in ipairs(prefetch.variables) do
+        if v.variablesReference == variablesReference then
+            table.remove(prefetch.variables, i)
+            return v.body
+        end
+    end
+end
+
+function m.exitWorker(w)
+    loaded[w] = nil
+    exceptions[w] = nil
+    stops[w] = nil
+end
+
+return m
@@ -106,4 +106,22 @@ function event.memory(body)
     }
 end
 
+function event.heatmap(body)
+    mgr.clientSend {
+        type = 'event',
+        seq = mgr.newSeq(),
+        event = 'heatmap',
+        body = body
+    }
+end
+
+function event.childProcess(body)
+    mgr.clientSend {
+        type = 'event',
+        seq = mgr.newSeq(),
+        event = 'childProcess',
+        body = body
+    }
+end
+
 return event
@@ -2,6 +2,7 @@ local proto = require 'common.protocol'
 local ev = require 'backend.event'
 local thread = require 'bee.thread'
 local stdio = require 'luadebug.stdio'
+local utility = require 'luadebug.utility'
 
 local redirect = {}
 local mgr = {}
@@ -67,7 +68,7 @@ end
 
 function mgr.init(io)
     network = io
-    masterThread = thread.channel 'DbgMaster'
+    masterThread = thread.channel(('DbgMaster(%d)'):format(utility.getpid()))
     network.event_in(event_in)
     network.event_close(event_close)
     return true
@@ -245,6 +246,9 @@ local function update_once()
         end
     end
     update_redirect()
+    for _, pid in ipairs(utility.forkchildren()) do
+        ev.emit('child-process', pid)
+    end
     if not network.update() then
         return true
     end
@@ -291,6 +295,7 @@ end
 
 function mgr.setClient(c)
     client = c
+    stat.compress = c.supportsCompressedTransport == true
 end
 
 function mgr.getClient()
@@ -1,6 +1,7 @@
 local mgr = require 'backend.master.mgr'
 local response = require 'backend.master.response'
 local event = require 'backend.master.event'
+local cache = require 'backend.master.cache'
 local ev = require 'backend.event'
 local utility = require 'luadebug.utility'
 
@@ -130,6 +131,14 @@ ev.on('worker-ready', function(w)
     end
 end)
 
+ev.on('child-process', function(pid)
+    if state == "initialized" and config.initialize.autoAttachChildProcess then
+        event.childProcess {
+            processId = pid,
+        }
+    end
+end)
+
 function request.configurationDone(req)
     response.success(req)
     state = "initialized"
@@ -274,6 +283,16 @@ function request.stackTrace(req)
     if not checkThreadId(req, threadId) then
         return
     end
+    local body = cache.stackTrace(threadId, args.startFrame, args.levels)
+    if body then
+        response.success(req, body)
+        return
+    end
+    if (args.startFrame or 0) == 0 and args.levels == 1 then
+        -- The worker starts a new frame on this request, and the references
+        -- of the prefetched replies would no longer be valid.
+        cache.dropStop(threadId)
+    end
     mgr.workerSend(threadId, {
         cmd = 'stackTrace',
         command = req.command,
@@ -296,6 +315,11 @@ function request.scopes(req)
         return
     end
 
+    local body = cache.scopes(threadId, args.frameId)
+    if body then
+        response.success(req, body)
+        return
+    end
     mgr.workerSend(threadId, {
         cmd = 'scopes',
         command = req.command,
@@ -311,6 +335,13 @@ function request.variables(req)
     if not checkThreadId(req, threadId) then
         return
     end
+    if not args.filter and not args.start and not args.count then
+        local body = cache.variables(threadId, args.variablesReference)
+        if body then
+            response.success(req, body)
+            return
+        end
+    end
     mgr.workerSend(threadId, {
         cmd = 'variables',
         command = req.command,
@@ -322,6 +353,25 @@ function request.variables(req)
     })
 end
 
+function request.customRequestTableView(req)
+    local args = req.arguments
+    local threadId = args.variablesReference >> 24
+    local valueId = args.variablesReference & 0x00FFFFFF
+    if not checkThreadId(req, threadId) then
+        return
+    end
+    mgr.workerSend(threadId, {
+        cmd = 'customRequestTableView',
+        command = req.command,
+        seq = req.seq,
+        valueId = valueId,
+        filter = args.filter,
+        prefix = args.prefix,
+        start = args.start,
+        count = args.count,
+    })
+end
+
 function request.evaluate(req)
     local args = req.arguments
     if type(args.frameId) ~= 'number' then
@@ -337,6 +387,9 @@ function request.evaluate(req)
     if not checkThreadId(req, threadId) then
         return
     end
+    if args.context == 'repl' then
+        cache.dropStop(threadId)
+    end
     mgr.workerSend(threadId, {
         cmd = 'evaluate',
         command = req.command,
@@ -353,6 +406,7 @@ end
 
 function request.disconnect(req)
     response.success(req)
+    cache.dropStop()
     local args = req.arguments
     if args.terminateDebuggee == nil then
         args.terminateDebuggee = not not config.launch
@@ -436,6 +490,7 @@ function request.pause(req)
 end
 
 function request.continue(req)
+    cache.resume()
     mgr.workerBroadcast {
         cmd = 'run'
     }
@@ -450,8 +505,10 @@ function request.next(req)
     if not checkThreadId(req, threadId) then
         return
     end
+    cache.resume()
     mgr.workerSend(threadId, {
         cmd = 'stepOver',
+        granularity = args.granularity,
     })
     mgr.workerBroadcastExclude(threadId, {
         cmd = 'run'
@@ -468,6 +525,7 @@ function request.stepOut(req)
     if not checkThreadId(req, threadId) then
         return
     end
+    cache.resume()
     mgr.workerSend(threadId, {
         cmd = 'stepOut',
     })
@@ -486,8 +544,11 @@ function request.stepIn(req)
     if not checkThreadId(req, threadId) then
         return
     end
+    cache.resume()
     mgr.workerSend(threadId, {
         cmd = 'stepIn',
+        granularity = args.granularity,
+        targetId = args.targetId,
     })
     mgr.workerBroadcastExclude(threadId, {
         cmd = 'run'
@@ -498,18 +559,33 @@ function request.stepIn(req)
     response.success(req)
 end
 
-function request.source(req)
+function request.stepInTargets(req)
     local args = req.arguments
-    local threadId = args.sourceReference >> 32
-    local sourceReference = args.sourceReference & 0xFFFFFFFF
+    if type(args.frameId) ~= 'number' then
+        response.error(req, "No frameId")
+        return
+    end
+    local threadId = args.frameId >> 24
     if not checkThreadId(req, threadId) then
         return
     end
     mgr.workerSend(threadId, {
-        cmd = 'source',
+        cmd = 'stepInTargets',
         command = req.command,
         seq = req.seq,
-        sourceReference = sourceReference,
+        frameId = args.frameId & 0x00FFFFFF,
+    })
+end
+
+function request.source(req)
+    local args = req.arguments
+    local threadId = args.sourceReference >> 32
+    if not checkThreadId(req, threadId) then
+        return
+    end
+    response.success(req, {
+        content = cache.source(args.sourceReference) or 'Source not available',
+        mimeType = 'text/x-lua',
     })
 end
 
@@ -519,10 +595,12 @@ function request.exceptionInfo(req)
     if not checkThreadId(req, threadId) then
         return
     end
-    mgr.workerSend(threadId, {
-        cmd = 'exceptionInfo',
-        command = req.command,
-        seq = req.seq,
+    response.success(req, cache.exceptionInfo(threadId) or {
+        breakMode = 'always',
+        exceptionId = '',
+        details = {
+            stackTrace = '',
+        }
     })
 end
 
@@ -533,6 +611,7 @@ function request.setVariable(req)
     if not checkThreadId(req, threadId) then
         return
     end
+    cache.dropStop(threadId)
     mgr.workerSend(threadId, {
         cmd = 'setVariable',
         command = req.command,
@@ -550,6 +629,7 @@ function request.setExpression(req)
     if not checkThreadId(req, threadId) then
         return
     end
+    cache.dropStop(threadId)
     mgr.workerSend(threadId, {
         cmd = 'setExpression',
         command = req.command,
@@ -562,11 +642,8 @@ end
 
 function request.loadedSources(req)
     response.success(req, {
-        sources = {}
+        sources = cache.loadedSources()
     })
-    mgr.workerBroadcast {
-        cmd = 'loadedSources'
-    }
 end
 
 function request.restartFrame(req)
@@ -577,6 +654,7 @@ function request.restartFrame(req)
         return
     end
     response.success(req)
+    cache.dropStop(threadId)
     mgr.workerSend(threadId, {
         cmd = 'restartFrame',
         frameId = frameId,
@@ -619,6 +697,7 @@ function request.writeMemory(req)
     if not checkThreadId(req, threadId) then
         return
     end
+    cache.dropStop(threadId)
     mgr.workerSend(threadId, {
         cmd = 'writeMemory',
         command = req.command,
@@ -630,8 +709,31 @@ function request.writeMemory(req)
     })
 end
 
+function request.disassemble(req)
+    local args = req.arguments
+    local threadId, refId = args.memoryReference:match "code_(%d+)x(.+)"
+    threadId = tonumber(threadId)
+    if not threadId or not refId then
+        response.error(req, "Error memoryReference")
+        return
+    end
+    if not checkThreadId(req, threadId) then
+        return
+    end
+    mgr.workerSend(threadId, {
+        cmd = 'disassemble',
+        command = req.command,
+        seq = req.seq,
+        memoryReference = refId,
+        offset = args.offset,
+        instructionOffset = args.instructionOffset,
+        instructionCount = args.instructionCount,
+    })
+end
+
 function request.customRequestShowIntegerAsDec(req)
     response.success(req)
+    cache.dropStop()
     mgr.workerBroadcast {
         cmd = 'customRequestShowIntegerAsDec'
     }
@@ -639,11 +741,107 @@ end
 
 function request.customRequestShowIntegerAsHex(req)
     response.success(req)
+    cache.dropStop()
     mgr.workerBroadcast {
         cmd = 'customRequestShowIntegerAsHex'
     }
 end
 
+function request.customRequestHeatmap(req)
+    local args = req.arguments or {}
+    response.success(req)
+    mgr.workerBroadcast {
+        cmd = 'customRequestHeatmap',
+        sources = args.sources,
+    }
+end
+
+function request.customRequestHeatmapFlush(req)
+    response.success(req)
+    mgr.workerBroadcast {
+        cmd = 'customRequestHeatmapFlush',
+    }
+end
+
+local function defaultThreadId(args)
+    if args and args.threadId then
+        return args.threadId
+    end
+    local threads = mgr.threads()
+    if threads[1] then
+        return threads[1].id
+    end
+end
+
+function request.customRequestProfileStart(req)
+    local args = req.arguments or {}
+    local threadId = defaultThreadId(args)
+    if not checkThreadId(req, threadId) then
+        return
+    end
+    mgr.workerSend(threadId, {
+        cmd = 'customRequestProfileStart',
+        command = req.command,
+        seq = req.seq,
+        mode = args.mode,
+        interval = args.interval,
+        granularity = args.granularity,
+        depth = args.depth,
+    })
+end
+
+function request.customRequestProfileStop(req)
+    local threadId = defaultThreadId(req.arguments)
+    if not checkThreadId(req, threadId) then
+        return
+    end
+    mgr.workerSend(threadId, {
+        cmd = 'customRequestProfileStop',
+        command = req.command,
+        seq = req.seq,
+    })
+end
+
+function request.customRequestStringHeap(req)
+    local args = req.arguments or {}
+    local threadId = defaultThreadId(args)
+    if not checkThreadId(req, threadId) then
+        return
+    end
+    mgr.workerSend(threadId, {
+        cmd = 'customRequestStringHeap',
+        command = req.command,
+        seq = req.seq,
+        top = args.top,
+        minSize = args.minSize,
+        budget = args.budget,
+    })
+end
+
+function request.customRequestStallReports(req)
+    local threadId = defaultThreadId(req.arguments)
+    if not checkThreadId(req, threadId) then
+        return
+    end
+    mgr.workerSend(threadId, {
+        cmd = 'customRequestStallReports',
+        command = req.command,
+        seq = req.seq,
+    })
+end
+
+function request.customRequestLuaStates(req)
+    local threadId = defaultThreadId(req.arguments)
+    if not checkThreadId(req, threadId) then
+        return
+    end
+    mgr.workerSend(threadId, {
+        cmd = 'customRequestLuaStates',
+        command = req.command,
+        seq = req.seq,
+    })
+end
+
 --function print(...)
 --    local n = select('#', ...)
 --    local t = {}
@@ -1,6 +1,7 @@
 local mgr = require 'backend.master.mgr'
 local event = require 'backend.master.event'
 local response = require 'backend.master.response'
+local cache = require 'backend.master.cache'
 
 local CMD = {}
 
@@ -9,10 +10,66 @@ function CMD.initWorker(WorkerIdent)
 end
 
 function CMD.exitWorker(w)
+    cache.exitWorker(w)
     mgr.exitWorker(w)
 end
 
+function CMD.eventException(w, req)
+    cache.setException(w, req)
+end
+
+local function fixStackTrace(w, body)
+    for _, frame in ipairs(body.stackFrames) do
+        frame.id = (w << 24) | frame.id
+        if frame.source and frame.source.sourceReference then
+            frame.source.sourceReference = (w << 32) | frame.source.sourceReference
+        end
+        if frame.instructionPointerReference then
+            frame.instructionPointerReference = "code_" .. w .. "x" .. frame.instructionPointerReference
+        end
+    end
+end
+
+local function fixScopes(w, body)
+    for _, scope in ipairs(body.scopes) do
+        if scope.variablesReference then
+            scope.variablesReference = (w << 24) | scope.variablesReference
+        else
+            scope.variablesReference = 0
+        end
+    end
+end
+
+local function fixVariables(w, body)
+    for _, var in ipairs(body.variables) do
+        if var.variablesReference then
+            var.variablesReference = (w << 24) | var.variablesReference
+        else
+            var.variablesReference = 0
+        end
+        if var.memoryReference then
+            var.memoryReference = "memory_" .. w .. "x" .. var.memoryReference
+        end
+    end
+end
+
 function CMD.eventStop(w, req)
+    local prefetch = req.prefetch
+    req.prefetch = nil
+    if prefetch then
+        for _, st in ipairs(prefetch.stackTrace) do
+            fixStackTrace(w, st.body)
+        end
+        if prefetch.scopes then
+            prefetch.scopes.frameId = (w << 24) | prefetch.scopes.frameId
+            fixScopes(w, prefetch.scopes.body)
+        end
+        for _, v in ipairs(prefetch.variables) do
+            v.variablesReference = (w << 24) | v.valueId
+            fixVariables(w, v.body)
+        end
+    end
+    cache.setStop(w, prefetch)
     req.threadId = w
     event.stopped(req)
 end
@@ -47,6 +104,7 @@ function CMD.eventLoadedSource(w, req)
     if req.source and req.source.sourceReference then
         req.source.sourceReference = (w << 32) | req.source.sourceReference
     end
+    cache.loadedSource(w, req.reason, req.source)
     event.loadedSource(req)
 end
 
@@ -55,12 +113,7 @@ function CMD.stackTrace(w, req)
         response.error(req, req.message)
         return
     end
-    for _, frame in ipairs(req.body.stackFrames) do
-        frame.id = (w << 24) | frame.id
-        if frame.source and frame.source.sourceReference then
-            frame.source.sourceReference = (w << 32) | frame.source.sourceReference
-        end
-    end
+    fixStackTrace(w, req.body)
     response.success(req, req.body)
 end
 
@@ -80,54 +133,57 @@ function CMD.evaluate(w, req)
     response.success(req, req.body)
 end
 
-function CMD.source(_, req)
-    if not req.content then
-        response.success(req, {
-            content = 'Source not available',
-            mimeType = 'text/x-lua',
-        })
+function CMD.scopes(w, req)
+    fixScopes(w, req.body)
+    response.success(req, req.body)
+end
+
+function CMD.variables(w, req)
+    if not req.success then
+        response.error(req, req.message)
         return
     end
-    response.success(req, {
-        content = req.content,
-        mimeType = 'text/x-lua',
-    })
+    fixVariables(w, req.body)
+    response.success(req, req.body)
 end
 
-function CMD.scopes(w, req)
-    for _, scope in ipairs(req.body.scopes) do
-        if scope.variablesReference then
-            scope.variablesReference = (w << 24) | scope.variablesReference
-        else
-            scope.variablesReference = 0
-        end
+function CMD.setVariable(_, req)
+    if not req.success then
+        response.error(req, req.message)
+        return
     end
     response.success(req, req.body)
 end
 
-function CMD.variables(w, req)
+function CMD.profiler(_, req)
     if not req.success then
         response.error(req, req.message)
         return
     end
-    for _, var in ipairs(req.body.variables) do
-        if var.variablesReference then
-            var.variablesReference = (w << 24) | var.variablesReference
-        else
-            var.variablesReference = 0
-        end
-        if var.memoryReference then
-            var.memoryReference = "memory_" .. w .. "x" .. var.memoryReference
-        end
+    response.success(req, req.body)
+end
+
+function CMD.stringHeap(_, req)
+    if not req.success then
+        response.error(req, req.message)
+        return
     end
     response.success(req, req.body)
 end
 
-function CMD.exceptionInfo(_, req)
+function CMD.stallReports(_, req)
     response.success(req, req.body)
 end
 
-function CMD.setVariable(_, req)
+function CMD.stepInTargets(_, req)
+    response.success(req, req.body)
+end
+
+function CMD.luaStates(_, req)
+    response.success(req, req.body)
+end
+
+function CMD.readMemory(_, req)
     if not req.success then
         response.error(req, req.message)
         return
@@ -135,7 +191,7 @@ function CMD.setVariable(_, req)
     response.success(req, req.body)
 end
 
-function CMD.readMemory(_, req)
+function CMD.writeMemory(_, req)
     if not req.success then
         response.error(req, req.message)
         return
@@ -143,14 +199,23 @@ function CMD.readMemory(_, req)
     response.success(req, req.body)
 end
 
-function CMD.writeMemory(_, req)
+function CMD.disassemble(w, req)
     if not req.success then
         response.error(req, req.message)
         return
     end
+    for _, inst in ipairs(req.body.instructions) do
+        if inst.location and inst.location.sourceReference then
+            inst.location.sourceReference = (w << 32) | inst.location.sourceReference
+        end
+    end
     response.success(req, req.body)
 end
 
+function CMD.eventHeatmap(_, req)
+    event.heatmap(req)
+end
+
 function CMD.eventMemory(w, req)
     req.memoryReference = "memory_" .. w .. "x" .. req.memoryReference
     event.memory(req)
@@ -2,14 +2,20 @@ local rdebug = require 'luadebug.visitor'
 local variables = require 'backend.worker.variables'
 local source = require 'backend.worker.source'
 local breakpoint = require 'backend.worker.breakpoint'
+local asyncparser = require 'backend.worker.asyncparser'
+local heatmap = require 'backend.worker.heatmap'
 local evaluate = require 'backend.worker.evaluate'
 local traceback = require 'backend.worker.traceback'
 local stdout = require 'backend.worker.stdout'
 local luaver = require 'backend.worker.luaver'
 local ev = require 'backend.event'
 local hookmgr = require 'luadebug.hookmgr'
+local profiler = require 'luadebug.profiler'
+local sampler = require 'luadebug.sampler'
+local strings = require 'luadebug.strings'
 local stdio = require 'luadebug.stdio'
 local thread = require 'bee.thread'
+local utility = require 'luadebug.utility'
 local fs = require 'backend.worker.filesystem'
 local log = require 'common.log'
 
@@ -18,26 +24,38 @@ local suspend = false
 local info = {}
 local state = 'running'
 local stopReason = 'step'
-local currentException = {
-    message = '',
-    trace = '',
-}
 local outputCapture = {}
 local noDebug = false
 local autoUpdate = true
+local cooperative = false
 local coroutineTree = {}
 local stackFrame = {}
+local codeFrame = {}
+local stepTargets = {}
 local skipFrame = 0
 local baseL
 
 local CMD = {}
 
-local WorkerIdent = tostring(thread.id)
+local WorkerIdent = ('%d-%s'):format(utility.getpid(), thread.id)
 local WorkerChannel = ('DbgWorker(%s)'):format(WorkerIdent)
 
 thread.newchannel(WorkerChannel)
-local masterThread = thread.channel 'DbgMaster'
+local masterThread = thread.channel(('DbgMaster(%d)'):format(utility.getpid()))
 local workerThread = thread.channel(WorkerChannel)
+asyncparser.init(WorkerIdent, WorkerChannel)
+
+local function dispatch(msg)
+    local ok, err = xpcall(function()
+        local f = CMD[msg.cmd]
+        if f then
+            f(msg)
+        end
+    end, debug.traceback)
+    if not ok then
+        log.error("ERROR:"..err)
+    end
+end
 
 local function workerThreadUpdate(timeout)
     while true do
@@ -45,15 +63,7 @@ local function workerThreadUpdate(timeout)
         if not ok then
             break
         end
-        local ok, err = xpcall(function()
-            local f = CMD[msg.cmd]
-            if f then
-                f(msg)
-            end
-        end, debug.traceback)
-        if not ok then
-            log.error("ERROR:"..err)
-        end
+        dispatch(msg)
     end
 end
 
@@ -79,11 +89,15 @@ ev.on('loadedSource', function(reason, s)
     if src then
         sendToMaster 'eventLoadedSource' {
             reason = reason,
-            source = src
+            source = src,
         }
     end
 end)
 
+ev.on('heatmap', function(body)
+    sendToMaster 'eventHeatmap' (body)
+end)
+
 ev.on('memory', function(memoryReference, offset, count)
     sendToMaster 'eventMemory' {
         memoryReference = memoryReference,
@@ -107,6 +121,8 @@ end)
 local function cleanFrame()
     variables.clean()
     stackFrame = {}
+    codeFrame = {}
+    stepTargets = {}
 end
 
 function CMD.initializing(pkg)
@@ -195,6 +211,11 @@ local function stackTrace(res, coid, start, levels)
         }
         if info.what ~= 'C' then
             r.column = 1
+            local address = rdebug.getpc(depth)
+            if address then
+                r.instructionPointerReference = address
+                codeFrame[address] = r.id
+            end
             local src = source.create(info.source)
             if source.valid(src) then
                 r.line = source.line(src, info.currentline)
@@ -243,9 +264,9 @@ local function nextTotalFrames(finish, n)
     return p
 end
 
-function CMD.stackTrace(pkg)
-    local start = pkg.startFrame and pkg.startFrame or 0
-    local levels = (pkg.levels and pkg.levels ~= 0) and pkg.levels or 200
+local function getStackTrace(start, levels)
+    start = start or 0
+    levels = (levels and levels ~= 0) and levels or 200
     local res = {}
 
     --
@@ -285,22 +306,18 @@ function CMD.stackTrace(pkg)
     hookmgr.sethost(baseL)
 
     -- TODO 当frames很多时，跳过中间的部分
-    sendToMaster 'stackTrace' {
-        command = pkg.command,
-        seq = pkg.seq,
-        success = true,
-        body = {
-            stackFrames = res,
-            totalFrames = nextTotalFrames(finish, start + levels),
-        }
+    return {
+        stackFrames = res,
+        totalFrames = nextTotalFrames(finish, start + levels),
     }
 end
 
-function CMD.source(pkg)
-    sendToMaster 'source' {
+function CMD.stackTrace(pkg)
+    sendToMaster 'stackTrace' {
         command = pkg.command,
         seq = pkg.seq,
-        content = source.getCode(pkg.sourceReference),
+        success = true,
+        body = getStackTrace(pkg.startFrame, pkg.levels),
     }
 end
 
@@ -315,19 +332,57 @@ local function findFrame(id)
     return L
 end
 
-function CMD.scopes(pkg)
-    local coid = (pkg.frameId >> 16) + 1
-    local depth = pkg.frameId & 0xFFFF
+local function getScopes(frameId)
+    local coid = (frameId >> 16) + 1
+    local depth = frameId & 0xFFFF
     hookmgr.sethost(assert(findFrame(coid)))
+    return variables.scopes(depth)
+end
+
+function CMD.scopes(pkg)
     sendToMaster 'scopes' {
         command = pkg.command,
         seq = pkg.seq,
         body = {
-            scopes = variables.scopes(depth)
+            scopes = getScopes(pkg.frameId)
         }
     }
 end
 
+-- What a client asks for right after a stop: the top frame, the next
+-- frames, the scopes of the top frame and the variables of its cheap
+-- scopes. It is computed before the stop is reported, so the master can
+-- answer these requests without waiting for the worker.
+local PREFETCH_LEVELS <const> = 20
+
+local function prefetchStop()
+    local res = {
+        stackTrace = {
+            { startFrame = 0, levels = 1, body = getStackTrace(0, 1) },
+            { startFrame = 1, levels = PREFETCH_LEVELS - 1, body = getStackTrace(1, PREFETCH_LEVELS - 1) },
+        },
+        variables = {},
+    }
+    local top = res.stackTrace[1].body.stackFrames[1]
+    if not top then
+        return res
+    end
+    local scopes = getScopes(top.id)
+    res.scopes = { frameId = top.id, body = { scopes = scopes } }
+    for _, scope in ipairs(scopes) do
+        if not scope.expensive and scope.variablesReference then
+            local vars = variables.extand(scope.variablesReference)
+            if vars then
+                res.variables[#res.variables + 1] = {
+                    valueId = scope.variablesReference,
+                    body = { variables = vars },
+                }
+            end
+        end
+    end
+    return res
+end
+
 function CMD.variables(pkg)
     local vars, err = variables.extand(pkg.valueId, pkg.filter, pkg.start, pkg.count)
     if not vars then
@@ -349,6 +404,28 @@ function CMD.variables(pkg)
     }
 end
 
+function CMD.customRequestTableView(pkg)
+    local vars, total = variables.view(pkg.valueId, pkg.filter, pkg.prefix, pkg.start, pkg.count)
+    if not vars then
+        sendToMaster 'variables' {
+            command = pkg.command,
+            seq = pkg.seq,
+            success = false,
+            message = total,
+        }
+        return
+    end
+    sendToMaster 'variables' {
+        command = pkg.command,
+        seq = pkg.seq,
+        success = true,
+        body = {
+            variables = vars,
+            total = total,
+        }
+    }
+end
+
 function CMD.setVariable(pkg)
     local var, err = variables.set(pkg.valueId, pkg.name, pkg.value)
     if not var then
@@ -390,6 +467,71 @@ function CMD.readMemory(pkg)
     }
 end
 
+-- Bytecode is 4 bytes per instruction in every supported runtime.
+local INSTRUCTION_SIZE <const> = 4
+
+local function disassemble(memoryReference, offset, instructionOffset, count)
+    local frameId = codeFrame[memoryReference]
+    if not frameId then
+        return nil, "Error memoryReference"
+    end
+    local depth = frameId & 0xFFFF
+    hookmgr.sethost(assert(findFrame((frameId >> 16) + 1)))
+    local code = rdebug.disassemble(depth)
+    rdebug.getinfo(depth, "S", info)
+    hookmgr.sethost(baseL)
+    if not code then
+        return nil, "Not a Lua function"
+    end
+    local base
+    for i, inst in ipairs(code) do
+        if inst.address == memoryReference then
+            base = i
+            break
+        end
+    end
+    if not base then
+        return nil, "Error memoryReference"
+    end
+    base = base + (offset or 0) // INSTRUCTION_SIZE + (instructionOffset or 0)
+    local src = source.create(info.source)
+    local location = source.valid(src) and source.output(src) or nil
+    local instructions = {}
+    for i = base, base + count - 1 do
+        local inst = code[i]
+        if inst then
+            local text = inst.opname .. ' ' .. inst.operands
+            if inst.comment then
+                text = text .. '\t; ' .. inst.comment
+            end
+            instructions[#instructions + 1] = {
+                address = inst.address,
+                instruction = text,
+                location = location,
+                line = location and source.line(src, inst.line) or inst.line,
+            }
+        else
+            instructions[#instructions + 1] = {
+                address = '0x0',
+                instruction = '??',
+                presentationHint = 'invalid',
+            }
+        end
+    end
+    return { instructions = instructions }
+end
+
+function CMD.disassemble(pkg)
+    local res, err = disassemble(pkg.memoryReference, pkg.offset, pkg.instructionOffset, pkg.instructionCount)
+    sendToMaster 'disassemble' {
+        command = pkg.command,
+        seq = pkg.seq,
+        success = res ~= nil,
+        message = err,
+        body = res,
+    }
+end
+
 function CMD.writeMemory(pkg)
     local res, err = variables.writeMemory(pkg.memoryReference, pkg.offset, pkg.data, pkg.allowPartial)
     if not res then
@@ -456,6 +598,10 @@ function CMD.setBreakpoints(pkg)
     breakpoint.set_bp(pkg.source, pkg.breakpoints, pkg.content)
 end
 
+function CMD.parsed(pkg)
+    asyncparser.finish(pkg.id, pkg.lineinfo)
+end
+
 function CMD.setFunctionBreakpoints(pkg)
     breakpoint.set_funcbp(pkg.breakpoints)
 end
@@ -464,24 +610,6 @@ function CMD.setExceptionBreakpoints(pkg)
     breakpoint.setExceptionBreakpoints(pkg.arguments)
 end
 
-function CMD.exceptionInfo(pkg)
-    sendToMaster 'exceptionInfo' {
-        command = pkg.command,
-        seq = pkg.seq,
-        body = {
-            breakMode = 'always',
-            exceptionId = currentException.message,
-            details = {
-                stackTrace = currentException.trace,
-            }
-        }
-    }
-end
-
-function CMD.loadedSources()
-    source.all_loaded()
-end
-
 function CMD.stop(pkg)
     if noDebug then
         return
@@ -496,22 +624,70 @@ function CMD.run()
     hookmgr.step_cancel()
 end
 
-function CMD.stepOver()
+function CMD.stepOver(pkg)
     if noDebug then
         return
     end
+    if pkg.granularity == 'instruction' then
+        state = 'stepInstruction'
+        hookmgr.step_instruction(true)
+        return
+    end
     state = 'stepOver'
     hookmgr.step_over()
 end
 
-function CMD.stepIn()
+function CMD.stepIn(pkg)
     if noDebug then
         return
     end
+    if pkg.granularity == 'instruction' then
+        state = 'stepInstruction'
+        hookmgr.step_instruction()
+        return
+    end
     state = 'stepIn'
+    local target = pkg.targetId and stepTargets[pkg.targetId]
+    if target and hookmgr.step_into_call(target.depth, target.pc) then
+        return
+    end
     hookmgr.step_in()
 end
 
+-- The calls still to come on the line of a frame of the stopped coroutine.
+-- The bytecode is needed to find them, so there are none with LuaJIT.
+function CMD.stepInTargets(pkg)
+    local targets = {}
+    local depth = pkg.frameId & 0xFFFF
+    if pkg.frameId >> 16 == 0 then
+        local calls = rdebug.calltargets(depth)
+        if calls then
+            rdebug.getinfo(depth, "Sl", info)
+            local line = source.line(source.create(info.source), info.currentline)
+            for _, call in ipairs(calls) do
+                local id = #stepTargets + 1
+                stepTargets[id] = {
+                    depth = depth,
+                    pc = call.pc,
+                }
+                targets[#targets + 1] = {
+                    id = id,
+                    label = call.name,
+                    line = line,
+                }
+            end
+        end
+    end
+    sendToMaster 'stepInTargets' {
+        command = pkg.command,
+        seq = pkg.seq,
+        success = true,
+        body = {
+            targets = targets,
+        },
+    }
+end
+
 function CMD.stepOut()
     if noDebug then
         return
@@ -567,11 +743,121 @@ function CMD.customRequestShowIntegerAsHex()
     }
 end
 
+function CMD.customRequestHeatmap(pkg)
+    heatmap.open(pkg.sources)
+end
+
+function CMD.customRequestHeatmapFlush()
+    heatmap.report()
+end
+
+local activeProfiler
+
+-- Call counts and latency of C functions, measured by the call hook.
+local cfunction = {}
+
+function cfunction.start()
+    hookmgr.cstats_open(true)
+    return true
+end
+
+function cfunction.stop()
+    local functions = hookmgr.cstats_report()
+    hookmgr.cstats_open(false)
+    table.sort(functions, function(a, b)
+        return a.total > b.total
+    end)
+    return {
+        functions = functions,
+    }
+end
+
+local profilers = {
+    mixed = sampler,
+    cfunction = cfunction,
+}
+
+function CMD.customRequestProfileStart(pkg)
+    if activeProfiler then
+        activeProfiler.stop()
+    end
+    local p = profilers[pkg.mode] or profiler
+    local ok, err = p.start {
+        interval = pkg.interval,
+        granularity = pkg.granularity,
+        depth = pkg.depth,
+    }
+    activeProfiler = ok and p or nil
+    sendToMaster 'profiler' {
+        command = pkg.command,
+        seq = pkg.seq,
+        success = ok,
+        message = err,
+    }
+end
+
+function CMD.customRequestProfileStop(pkg)
+    local p = activeProfiler or profiler
+    activeProfiler = nil
+    sendToMaster 'profiler' {
+        command = pkg.command,
+        seq = pkg.seq,
+        success = true,
+        body = p.stop(),
+    }
+end
+
+function CMD.customRequestStringHeap(pkg)
+    local ok, res = pcall(strings.analyze, {
+        top = pkg.top,
+        minSize = pkg.minSize,
+        budget = pkg.budget,
+    })
+    sendToMaster 'stringHeap' {
+        command = pkg.command,
+        seq = pkg.seq,
+        success = ok,
+        message = not ok and tostring(res) or nil,
+        body = ok and res or nil,
+    }
+end
+
+function CMD.customRequestStallReports(pkg)
+    sendToMaster 'stallReports' {
+        command = pkg.command,
+        seq = pkg.seq,
+        success = true,
+        body = {
+            reports = hookmgr.stall_report(),
+        },
+    }
+end
+
+-- Every Lua state of the process. Only the current one is known when the
+-- debugger wasn't injected by the launcher.
+function CMD.customRequestLuaStates(pkg)
+    local states = rdebug.vms()
+    for _, s in ipairs(states) do
+        if s.current then
+            s.breakpoints = breakpoint.active()
+        end
+    end
+    sendToMaster 'luaStates' {
+        command = pkg.command,
+        seq = pkg.seq,
+        success = true,
+        body = {
+            states = states,
+        },
+    }
+end
+
 local function runLoop(reason, level)
     baseL = hookmgr.gethost()
+    skipFrame = level or 0
+    reason.prefetch = prefetchStop()
     --TODO: 只在lua栈帧时需要text？
     sendToMaster 'eventStop' (reason)
-    skipFrame = level or 0
 
     while true do
         workerThreadUpdate(0.01)
@@ -579,6 +865,7 @@ local function runLoop(reason, level)
             break
         end
     end
+    hookmgr.stall_reset()
 end
 
 local event = {}
@@ -631,16 +918,20 @@ function event.step(line)
     if not debuggeeReady() then return end
     rdebug.getinfo(0, "S", info)
     local src = source.create(info.source)
-    if event_breakpoint(src, line) then
-        return
-    end
-    if not source.valid(src) then
-        return
+    -- An instruction step stops even without a source, the disassembly is
+    -- still there to show.
+    if state ~= 'stepInstruction' then
+        if event_breakpoint(src, line) then
+            return
+        end
+        if not source.valid(src) then
+            return
+        end
     end
     workerThreadUpdate()
     if state == 'running' then
         return
-    elseif state == 'stepOver' or state == 'stepOut' or state == 'stepIn' then
+    elseif state == 'stepOver' or state == 'stepOut' or state == 'stepIn' or state == 'stepInstruction' then
         state = 'stopped'
         stopReason = 'step'
         hookmgr.step_cancel()
@@ -665,11 +956,49 @@ end
 function event.update()
     debuggeeReady()
     workerThreadUpdate()
+    heatmap.update()
+end
+
+function event.heatproto(proto, level)
+    if not debuggeeReady() then return end
+    heatmap.newproto(proto, level)
+end
+
+function event.stall(elapsed)
+    if not debuggeeReady() then return end
+    state = 'stopped'
+    runLoop {
+        reason = 'pause',
+        description = 'Stalled',
+        text = ('The debuggee has not returned for %d ms.'):format(elapsed),
+    }
+end
+
+-- The host pumps the debugger from its own loop, so the update hook is
+-- dropped on the first call and messages are only handled here.
+function event.poll(budget)
+    if not cooperative then
+        cooperative = true
+        hookmgr.update_open(false)
+    end
+    debuggeeReady()
+    local deadline = utility.monotonic() + (budget or 0)
+    while true do
+        local ok, msg = workerThread:pop()
+        if not ok then
+            break
+        end
+        dispatch(msg)
+        if utility.monotonic() >= deadline then
+            break
+        end
+    end
+    heatmap.update()
 end
 
 function event.autoUpdate(flag)
     autoUpdate = flag
-    hookmgr.update_open(not noDebug and autoUpdate)
+    hookmgr.update_open(not noDebug and autoUpdate and not cooperative)
 end
 
 function event.print(...)
@@ -778,9 +1107,12 @@ local function runException(flags, errobj)
     if not bp then
         return
     end
-    currentException = {
-        message = message,
-        trace = trace,
+    sendToMaster 'eventException' {
+        breakMode = 'always',
+        exceptionId = message,
+        details = {
+            stackTrace = trace,
+        }
     }
     state = 'stopped'
     runLoop({
@@ -849,7 +1181,7 @@ end
 
 ev.on('initializing', function(config)
     noDebug = config.noDebug
-    hookmgr.update_open(not noDebug and autoUpdate)
+    hookmgr.update_open(not noDebug and autoUpdate and not cooperative)
     if hookmgr.thread_open then
         hookmgr.thread_open(true)
     end
@@ -857,6 +1189,8 @@ ev.on('initializing', function(config)
     if outputCapture["print"] then
         stdio.open_print(true)
     end
+    utility.forkattach(config.autoAttachChildProcess == true)
+    hookmgr.stall_open(config.stallBudget or 0, config.stallPause == true)
     if outputCapture["io.write"] then
         stdio.open_iowrite(true)
     end
@@ -864,6 +1198,8 @@ end)
 
 ev.on('terminated', function()
     hookmgr.step_cancel()
+    hookmgr.stall_open(0)
+    utility.forkattach(false)
     if outputCapture["print"] then
         stdio.open_print(false)
     end
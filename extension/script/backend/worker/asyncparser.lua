@@ -0,0 +1,81 @@
+local thread = require 'bee.thread'
+
+-- Runs backend.worker.parser on a helper thread, so that large sources are
+-- parsed without blocking the debuggee. The results come back through the
+-- worker channel as a `parsed` command, see m.finish.
+
+local m = {}
+
+local requestName
+local requestChannel
+local responseName
+local parserThread
+local callbacks = {}
+local id = 0
+
+local function start()
+    if parserThread then
+        return
+    end
+    parserThread = thread.thread(([[
+        package.path = %q
+        local thread = require "bee.thread"
+        local parser = require "backend.worker.parser"
+        local req = thread.channel(%q)
+        local res = thread.channel(%q)
+        while true do
+            local ok, id, content = req:pop(1)
+            if ok then
+                if id == nil then
+                    break
+                end
+                local suc, lineinfo = pcall(parser, content)
+                res:push {
+                    cmd = "parsed",
+                    id = id,
+                    lineinfo = suc and lineinfo or nil,
+                }
+            end
+        end
+    ]]):format(
+        package.path,
+        requestName,
+        responseName
+    ))
+end
+
+function m.init(ident, response)
+    requestName = ('DbgParser(%s)'):format(ident)
+    responseName = response
+    thread.newchannel(requestName)
+    requestChannel = thread.channel(requestName)
+end
+
+function m.parse(content, callback)
+    start()
+    id = id + 1
+    callbacks[id] = callback
+    requestChannel:push(id, content)
+end
+
+function m.finish(i, lineinfo)
+    local callback = callbacks[i]
+    if callback then
+        callbacks[i] = nil
+        callback(lineinfo)
+    end
+end
+
+function m.cancel()
+    callbacks = {}
+end
+
+ParserGuard = setmetatable({}, {__gc=function()
+    if parserThread then
+        requestChannel:push(nil)
+        thread.wait(parserThread)
+        parserThread = nil
+    end
+end})
+
+return m
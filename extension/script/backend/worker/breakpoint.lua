@@ -5,10 +5,13 @@ local eval = require 'backend.worker.eval'
 local ev = require 'backend.event'
 local hookmgr = require 'luadebug.hookmgr'
 local parser = require 'backend.worker.parser'
+local asyncparser = require 'backend.worker.asyncparser'
 local stdout = require 'backend.worker.stdout'
 
 local currentactive = {}
 local waitverify = {}
+local pendingLineInfo = {}
+local setVersion = {}
 local info = {}
 local m = {}
 local enable = false
@@ -187,8 +190,7 @@ function m.find(src, currentline)
     return currentBP[currentline]
 end
 
-local function parserInlineLineinfo(src)
-    local old = parser(src.content)
+local function inlineLineinfo(src, old)
     if not old then
         return
     end
@@ -213,19 +215,67 @@ local function parserInlineLineinfo(src)
     return new
 end
 
-local function calcLineInfo(src, content)
+local function lineinfoContent(src, content)
+    if src.content then
+        return src.content
+    elseif content then
+        return content
+    elseif src.sourceReference then
+        return source.getCode(src.sourceReference)
+    end
+end
+
+local function finishLineInfo(src, lineinfo)
+    if src.content then
+        return inlineLineinfo(src, lineinfo)
+    end
+    return lineinfo
+end
+
+local function calcLineInfo(src, content, lineinfo)
     if not src.lineinfo then
-        if src.content then
-            src.lineinfo = parserInlineLineinfo(src)
-        elseif content then
-            src.lineinfo = parser(content)
-        elseif src.sourceReference then
-            src.lineinfo = parser(source.getCode(src.sourceReference))
+        if lineinfo and not src.content then
+            src.lineinfo = lineinfo
+        else
+            local code = lineinfoContent(src, content)
+            if code then
+                src.lineinfo = finishLineInfo(src, parser(code))
+            end
         end
     end
     return src.lineinfo
 end
 
+-- Same as calcLineInfo, but the source is parsed on the helper thread and
+-- f is called from the worker once the result is back.
+local function asyncLineInfo(src, content, f)
+    if src.lineinfo then
+        f(src.lineinfo)
+        return
+    end
+    local wait = pendingLineInfo[src]
+    if wait then
+        wait[#wait+1] = f
+        return
+    end
+    local code = lineinfoContent(src, content)
+    if not code then
+        f(nil)
+        return
+    end
+    pendingLineInfo[src] = { f }
+    asyncparser.parse(code, function(lineinfo)
+        if not src.lineinfo then
+            src.lineinfo = finishLineInfo(src, lineinfo)
+        end
+        local callbacks = pendingLineInfo[src]
+        pendingLineInfo[src] = nil
+        for _, callback in ipairs(callbacks) do
+            callback(src.lineinfo)
+        end
+    end)
+end
+
 local function cantVerifyBreakpoints(breakpoints)
     for _, bp in ipairs(breakpoints) do
         setBreakPointUnverified(bp, "The source file has no line information.")
@@ -235,27 +285,45 @@ end
 function m.set_bp(clientsrc, breakpoints, content)
     verifyBreakpoint(breakpoints)
 
+    local clientkey = bpClientKey(clientsrc)
+    local version = (setVersion[clientkey] or 0) + 1
+    setVersion[clientkey] = version
+
     local srcarray = source.c2s(clientsrc)
     if srcarray then
         local ok = false
+        local n = #srcarray
         for _, src in ipairs(srcarray) do
-            if calcLineInfo(src, content) then
-                ok = true
-            end
-        end
-        if ok then
-            for _, src in ipairs(srcarray) do
-                verifyBreakpointByLineInfo(src, breakpoints)
-                updateBreakpoint(src, breakpoints)
-            end
-        else
-            cantVerifyBreakpoints(breakpoints)
+            asyncLineInfo(src, content, function(lineinfo)
+                if lineinfo then
+                    ok = true
+                end
+                n = n - 1
+                if n > 0 or setVersion[clientkey] ~= version then
+                    return
+                end
+                if ok then
+                    for _, s in ipairs(srcarray) do
+                        verifyBreakpointByLineInfo(s, breakpoints)
+                        updateBreakpoint(s, breakpoints)
+                    end
+                else
+                    cantVerifyBreakpoints(breakpoints)
+                end
+            end)
         end
     else
-        waitverify[bpClientKey(clientsrc)] = {
+        local wv = {
             breakpoints = breakpoints,
             content = content,
         }
+        waitverify[clientkey] = wv
+        if content then
+            -- Parse ahead, so that newproto doesn't have to.
+            asyncparser.parse(content, function(lineinfo)
+                wv.lineinfo = lineinfo
+            end)
+        end
         updateHook()
     end
 end
@@ -301,7 +369,7 @@ function m.newproto(proto, src, key)
         if not src.content then
             waitverify[bpkey] = nil
         end
-        if not calcLineInfo(src, wv.content) then
+        if not calcLineInfo(src, wv.content, wv.lineinfo) then
             cantVerifyBreakpoints(wv.breakpoints)
             return
         end
@@ -333,6 +401,10 @@ function m.set_funcbp(breakpoints)
     hookmgr.funcbp_open(#funcs > 0)
 end
 
+function m.active()
+    return enable or #funcs > 0
+end
+
 function m.hit_bp(src, currentline)
     local bp = m.find(src, currentline)
     if bp and m.exec(bp) then
@@ -399,9 +471,23 @@ function m.setExceptionBreakpoints(breakpoints)
     end
 end
 
+-- The source is created again the next time one of its protos runs, and
+-- newproto then adds the proto to it.
+ev.on('evictSource', function(src)
+    if not src.protos then
+        return
+    end
+    for proto in pairs(src.protos) do
+        hookmgr.break_reset(proto)
+    end
+end)
+
 ev.on('terminated', function()
     currentactive = {}
     waitverify = {}
+    pendingLineInfo = {}
+    setVersion = {}
+    asyncparser.cancel()
     info = {}
     enable = false
     hookmgr.break_open(false)
@@ -0,0 +1,133 @@
+local rdebug = require 'luadebug.visitor'
+local fs = require 'backend.worker.filesystem'
+local source = require 'backend.worker.source'
+local ev = require 'backend.event'
+local hookmgr = require 'luadebug.hookmgr'
+
+-- Per-line execution counts of the functions of some sources. The counters
+-- live in hookmgr, this module picks the functions and turns the counters
+-- into one run-length encoded event per source.
+
+local REPORT_INTERVAL <const> = 1
+
+local m = {}
+local enabled
+local protos = {}
+local lastReport = 0
+local info = {}
+
+local function sourceKey(s)
+    if s.sourceReference then
+        return s.sourceReference
+    end
+    if s.path then
+        return fs.path_native(fs.path_normalize(s.path))
+    end
+end
+
+local function rle(counts, first, last)
+    local res = {}
+    local value, length = counts[first] or 0, 0
+    for line = first, last do
+        local n = counts[line] or 0
+        if n == value then
+            length = length + 1
+        else
+            res[#res+1] = value
+            res[#res+1] = length
+            value, length = n, 1
+        end
+    end
+    res[#res+1] = value
+    res[#res+1] = length
+    return res
+end
+
+function m.open(sources)
+    protos = {}
+    if not sources or #sources == 0 then
+        enabled = nil
+        hookmgr.heat_open(false)
+        return
+    end
+    enabled = {}
+    for _, s in ipairs(sources) do
+        local key = sourceKey(s)
+        if key then
+            enabled[key] = true
+        end
+    end
+    hookmgr.heat_open(true)
+end
+
+function m.newproto(proto, level)
+    if not enabled then
+        hookmgr.heat_del(proto)
+        return
+    end
+    rdebug.getinfo(level, "S", info)
+    local src = source.create(info.source)
+    local key = source.valid(src) and sourceKey(src)
+    if key and enabled[key] then
+        protos[proto] = src
+        hookmgr.heat_add(proto)
+    else
+        hookmgr.heat_del(proto)
+    end
+end
+
+function m.report()
+    if not enabled then
+        return
+    end
+    local files = {}
+    for _, h in ipairs(hookmgr.heat_report(true)) do
+        local src = protos[h.proto]
+        if src then
+            local file = files[src]
+            if not file then
+                file = { counts = {}, first = math.huge, last = 0, total = 0 }
+                files[src] = file
+            end
+            for i, n in ipairs(h.counts) do
+                if n > 0 then
+                    local line = source.line(src, h.linedefined + i - 1)
+                    file.counts[line] = (file.counts[line] or 0) + n
+                    file.total = file.total + n
+                    if line < file.first then file.first = line end
+                    if line > file.last then file.last = line end
+                end
+            end
+        end
+    end
+    for src, file in pairs(files) do
+        if file.total > 0 then
+            ev.emit('heatmap', {
+                source = source.output(src),
+                line = file.first,
+                counts = rle(file.counts, file.first, file.last),
+            })
+        end
+    end
+end
+
+function m.update()
+    if not enabled then
+        return
+    end
+    local now = os.time()
+    if now - lastReport >= REPORT_INTERVAL then
+        lastReport = now
+        m.report()
+    end
+end
+
+ev.on('terminated', function()
+    if enabled then
+        enabled = nil
+        protos = {}
+        hookmgr.heat_open(false)
+    end
+end)
+
+return m
@@ -1,9 +1,20 @@
 local fs = require 'backend.worker.filesystem'
 local ev = require 'backend.event'
-local crc32 = require 'backend.worker.crc32'
+local sourcepool = require 'luadebug.sourcepool'
 
+local RECENT_SIZE <const> = 4096
+
+-- Live sources, keyed by the source string. A source lives as long as it
+-- is in one of the two tiers of recently used source strings, and is
+-- created again if it shows up once more.
 local sourcePool = {}
-local codePool = {}
+-- Live sources without a path, keyed by sourceReference. Their text lives
+-- in codePool, which the master reads to answer the client.
+local memoryPool = {}
+local recentPool = {}
+local recentOld = {}
+local recentSize = 0
+local codePool = sourcepool.get()
 local knownClientPath = {}
 local skipFiles = {}
 local sourceMaps = {}
@@ -90,18 +101,6 @@ local function serverPathToClientPath(p)
     return skip, covertPath(fs.source_normalize(p))
 end
 
-local function codeReference(s)
-    local hash = crc32(s)
-    while codePool[hash] do
-        if codePool[hash] == s then
-            return hash
-        end
-        hash = hash + 1
-    end
-    codePool[hash] = s
-    return hash
-end
-
 local function splitline(source)
     local path, line, content = source:match "^--@([^:]+):(%d+)\n(.*)$"
     if path and line and content then
@@ -144,7 +143,7 @@ local function create(source)
             }
         end
         return {
-            sourceReference = codeReference(source),
+            sourceReference = codePool:add(source),
             protos = {},
         }
     end
@@ -152,13 +151,42 @@ end
 
 local m = {}
 
+local function recent(source, src)
+    recentPool[source] = src
+    recentSize = recentSize + 1
+    if recentSize >= RECENT_SIZE then
+        for source, old in pairs(recentOld) do
+            if recentPool[source] == nil then
+                sourcePool[source] = nil
+                if old.sourceReference then
+                    memoryPool[old.sourceReference] = nil
+                end
+                ev.emit('evictSource', old)
+                ev.emit('loadedSource', 'removed', old)
+            end
+        end
+        recentOld = recentPool
+        recentPool = {}
+        recentSize = 0
+    end
+    return src
+end
+
 function m.create(source)
-    local src = sourcePool[source]
+    local src = recentPool[source]
     if src then
         return src
     end
+    src = recentOld[source]
+    if src then
+        return recent(source, src)
+    end
     local newSource = create(source)
+    if newSource.sourceReference then
+        memoryPool[newSource.sourceReference] = newSource
+    end
     sourcePool[source] = newSource
+    recent(source, newSource)
     ev.emit('loadedSource', 'new', newSource)
     return newSource
 end
@@ -166,17 +194,15 @@ end
 function m.c2s(clientsrc)
     -- TODO: 不遍历？
     if clientsrc.sourceReference then
-        local ref = clientsrc.sourceReference
-        for _, source in pairs(sourcePool) do
-            if source.sourceReference == ref then
-                return {source}
-            end
+        local source = memoryPool[clientsrc.sourceReference]
+        if source then
+            return {source}
         end
     else
         local results = {}
         local nativepath = fs.path_native(fs.path_normalize(clientsrc.path))
         for _, source in pairs(sourcePool) do
-            if source.path and not source.sourceReference and fs.path_native(fs.path_normalize(source.path)) == nativepath then
+            if source.path and fs.path_native(fs.path_normalize(source.path)) == nativepath then
                 source.path = clientsrc.path
                 results[#results+1] = source
             end
@@ -215,13 +241,7 @@ function m.line(s, currentline)
 end
 
 function m.getCode(ref)
-    return codePool[ref]
-end
-
-function m.removeCode(ref)
-    local code = codePool[ref]
-    sourcePool[code]  = nil
-    codePool[ref] = nil
+    return codePool:get(ref)
 end
 
 function m.clientPath(p)
@@ -231,10 +251,4 @@ function m.clientPath(p)
     return fs.path_normalize(p)
 end
 
-function m.all_loaded()
-    for _, source in pairs(sourcePool) do
-        ev.emit('loadedSource', 'new', source)
-    end
-end
-
 return m
@@ -285,12 +285,12 @@ local function varGetShortName(value)
         end
     end
     if type == 'string' then
-        local str = rdebug.value(value)
+        local str, len = rdebug.strsub(value, 1, 32)
         ---@cast str string
-        if #str < 32 then
+        if len < 32 then
             return str
         end
-        return quotedString(str:sub(1, 32))..'...'
+        return quotedString(str)..'...'
     elseif type == 'boolean' then
         if rdebug.value(value) then
             return 'true'
@@ -358,12 +358,12 @@ end
 local function varGetShortValue(value)
     local type = rdebug.type(value)
     if type == 'string' then
-        local str = rdebug.value(value)
+        local str, len = rdebug.strsub(value, 1, 16)
         ---@cast str string
-        if #str < 16 then
+        if len < 16 then
             return ("'%s'"):format(quotedString(str))
         end
-        return ("'%s...'"):format(quotedString(str:sub(1, 16)))
+        return ("'%s...'"):format(quotedString(str))
     elseif type == 'boolean' then
         if rdebug.value(value) then
             return 'true'
@@ -524,21 +524,22 @@ end
 local function varGetValue(context, allow_lazy, value)
     local type = rdebug.type(value)
     if type == 'string' then
-        local str = rdebug.value(value)
-        ---@cast str string
+        -- Large strings stay in the debuggee, only the part shown is read.
         if context == "repl" or context == "clipboard" then
-            return ("'%s'"):format(str), 'string'
+            return ("'%s'"):format(rdebug.value(value)), 'string'
         end
         if context == "hover" then
-            if #str < 2048 then
+            local str, len = rdebug.strsub(value, 1, 2048)
+            if len < 2048 then
                 return ("'%s'"):format(str), 'string'
             end
-            return ("'%s...'"):format(str:sub(1, 2048)), 'string'
+            return ("'%s...'"):format(str), 'string'
         end
-        if #str < 1024 then
+        local str, len = rdebug.strsub(value, 1, 1024)
+        if len < 1024 then
             return ("'%s'"):format(quotedString(str)), 'string'
         end
-        return ("'%s...'"):format(quotedString(str:sub(1, 1024))), 'string'
+        return ("'%s...'"):format(quotedString(str)), 'string'
     elseif type == 'boolean' then
         if rdebug.value(value) then
             return 'true', 'boolean'
@@ -810,6 +811,36 @@ local function extandTableNamed(varRef)
     return vars
 end
 
+-- Keys of the array and hash parts in serialize order, filtered by a
+-- substring or a prefix of the key. The order is built natively once per table per stop.
+local function extandTableSorted(varRef, keyFilter, prefix, start, count)
+    varRef.extand = varRef.extand or {}
+    local t = varRef.v
+    local evaluateName = varRef.eval
+    local vars = {}
+    local loct, total = rdebug.tablesort(t, start, count, keyFilter, prefix)
+    if not loct then
+        return vars, 0
+    end
+    for i = 1, #loct, 3 do
+        local key, value, valueref = loct[i], loct[i + 1], loct[i + 2]
+        local key_type = rdebug.type(key)
+        if varCanExtand(key_type, key) then
+            vars[#vars + 1] = varCreateTableKV(key, value, "variables")
+        else
+            varCreate {
+                vars = vars,
+                varRef = varRef,
+                name = varGetName(key),
+                value = value,
+                evaluateName = evaluateTabelKey(evaluateName, key),
+                calcValue = function() return valueref end,
+            }
+        end
+    end
+    return vars, total
+end
+
 local function extandTable(varRef, filter, start, count)
     if filter == 'indexed' then
         return extandTableIndexed(varRef, start, count)
@@ -1350,6 +1381,17 @@ function m.extand(valueId, filter, start, count)
     return vars
 end
 
+function m.view(valueId, keyFilter, prefix, start, count)
+    local varRef = varPool[valueId]
+    if not varRef then
+        return nil, 'Error variablesReference'
+    end
+    if varRef.special or rdebug.type(varRef.v) ~= 'table' then
+        return nil, 'Not a table'
+    end
+    return extandTableSorted(varRef, keyFilter, prefix, start or 0, count)
+end
+
 function m.set(valueId, name, value)
     local varRef = varPool[valueId]
     if not varRef then
@@ -1375,9 +1417,7 @@ function m.readMemory(memoryReference, offset, count)
     end
     offset = offset or 0
     if memoryRef.type == "string" then
-        local str = rdebug.value(memoryRef.value)
-        ---@cast str string
-        local slice = str:sub(offset + 1, offset + count)
+        local slice = rdebug.strsub(memoryRef.value, offset + 1, offset + count)
         if not slice then
             return {
                 address = tostring(offset),
@@ -1438,6 +1478,7 @@ function m.clean()
     globalCache = {}
     cfunctionInfo = {}
     rdebug.cleanwatch()
+    rdebug.cleantablesort()
 end
 
 function m.createText(value, context)
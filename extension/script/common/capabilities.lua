@@ -18,8 +18,12 @@ return {
     supportsTerminateRequest = true,
     supportsReadMemoryRequest = true,
     supportsWriteMemoryRequest = true,
+    supportsDisassembleRequest = true,
+    supportsSteppingGranularity = true,
+    supportsStepInTargetsRequest = true,
     supportsClipboardContext = true,
     supportsExceptionFilterOptions = true,
+    supportsCompressedTransport = true,
     exceptionBreakpointFilters = {
         {
             default = false,
@@ -0,0 +1,144 @@
+local string_byte = string.byte
+local string_char = string.char
+local string_sub = string.sub
+local string_rep = string.rep
+local string_pack = string.pack
+local string_unpack = string.unpack
+local table_concat = table.concat
+local table_unpack = table.unpack
+
+-- LZ4 block format, see https://github.com/lz4/lz4/blob/dev/doc/lz4_Block_format.md
+local MINMATCH <const> = 4
+local LASTLITERALS <const> = 5
+local MFLIMIT <const> = 12
+local MAXDISTANCE <const> = 0xFFFF
+local SKIPSTRENGTH <const> = 6
+
+local m = {}
+
+local function writeLength(out, n)
+    out[#out + 1] = string_rep("\255", n // 255)..string_char(n % 255)
+end
+
+local function writeSequence(out, src, anchor, litEnd, offset, matchLen)
+    local litLen = litEnd - anchor
+    local token = (litLen >= 15 and 15 or litLen) << 4
+    if matchLen then
+        local ml = matchLen - MINMATCH
+        token = token | (ml >= 15 and 15 or ml)
+    end
+    out[#out + 1] = string_char(token)
+    if litLen >= 15 then
+        writeLength(out, litLen - 15)
+    end
+    if litLen > 0 then
+        out[#out + 1] = string_sub(src, anchor, litEnd - 1)
+    end
+    if matchLen then
+        out[#out + 1] = string_pack("<I2", offset)
+        if matchLen - MINMATCH >= 15 then
+            writeLength(out, matchLen - MINMATCH - 15)
+        end
+    end
+end
+
+local function matchLength(src, i, ref, maxlen)
+    local len = MINMATCH
+    while len + 8 <= maxlen and string_unpack("<i8", src, i + len) == string_unpack("<i8", src, ref + len) do
+        len = len + 8
+    end
+    while len < maxlen and string_byte(src, i + len) == string_byte(src, ref + len) do
+        len = len + 1
+    end
+    return len
+end
+
+function m.compress(src)
+    local n = #src
+    local out = {}
+    local anchor = 1
+    if n > MFLIMIT then
+        local dict = {}
+        local matchlimit = n - LASTLITERALS
+        local i = 1
+        local misses = 0
+        while i <= n - MFLIMIT do
+            local seq = string_unpack("<I4", src, i)
+            local ref = dict[seq]
+            dict[seq] = i
+            if ref and i - ref <= MAXDISTANCE then
+                local len = matchLength(src, i, ref, matchlimit - i + 1)
+                writeSequence(out, src, anchor, i, i - ref, len)
+                i = i + len
+                anchor = i
+                misses = 0
+            else
+                misses = misses + 1
+                i = i + 1 + (misses >> SKIPSTRENGTH)
+            end
+        end
+    end
+    writeSequence(out, src, anchor, n + 1)
+    return table_concat(out)
+end
+
+local function readLength(src, p, len)
+    if len == 15 then
+        repeat
+            local b = string_byte(src, p)
+            if not b then
+                error "Invalid lz4 block."
+            end
+            p = p + 1
+            len = len + b
+        until b ~= 255
+    end
+    return len, p
+end
+
+function m.decompress(src, size)
+    local dst = {}
+    local o = 0
+    local p = 1
+    local n = #src
+    while p <= n do
+        local token = string_byte(src, p)
+        p = p + 1
+        local litLen
+        litLen, p = readLength(src, p, token >> 4)
+        if p + litLen - 1 > n then
+            error "Invalid lz4 block."
+        end
+        for j = 0, litLen - 1 do
+            dst[o + j + 1] = string_byte(src, p + j)
+        end
+        o = o + litLen
+        p = p + litLen
+        if p > n then
+            break
+        end
+        local offset = string_unpack("<I2", src, p)
+        p = p + 2
+        local matchLen
+        matchLen, p = readLength(src, p, token & 0xF)
+        matchLen = matchLen + MINMATCH
+        if offset == 0 or offset > o then
+            error "Invalid lz4 block."
+        end
+        local ref = o - offset
+        for j = 1, matchLen do
+            dst[o + j] = dst[ref + j]
+        end
+        o = o + matchLen
+    end
+    if size and o ~= size then
+        error "Invalid lz4 block."
+    end
+    local res = {}
+    for i = 1, o, 4096 do
+        res[#res + 1] = string_char(table_unpack(dst, i, math.min(i + 4095, o)))
+    end
+    return table_concat(res)
+end
+
+return m
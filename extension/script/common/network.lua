@@ -40,23 +40,31 @@ local function open(param)
     local e_send = function(_) end
     local e_close = function() end
     local stat = {}
+    local wantconnect
+    local cancelled = false
+    local function connect()
+        if not cancelled then
+            wantconnect = select.wantconnect(t)
+        end
+    end
     function t.event(status, fd)
         if status == 'connect start' then
             assert(t.mode == "connect")
+            wantconnect = nil
             srvfd = fd
             return
         end
         if status == 'connect failed' then
             assert(t.mode == "connect")
             select.close(srvfd)
-            select.wantconnect(t)
+            connect()
             return
         end
         if status == 'close' then
             if session == fd then
                 if t.mode == "connect" then
                     srvfd = nil
-                    select.wantconnect(t)
+                    connect()
                 end
                 e_close()
                 session = nil
@@ -72,7 +80,7 @@ local function open(param)
         write = ''
     end
     if t.mode == "connect" then
-        select.wantconnect(t)
+        connect()
     else
         srvfd = assert(select.listen(t))
     end
@@ -111,9 +119,30 @@ local function open(param)
         select.close(session)
         write = ''
     end
+    function m.isconnected()
+        return session ~= nil
+    end
+    -- Stops connecting again, for a connection that is given up.
+    function m.cancel()
+        cancelled = true
+        if wantconnect then
+            select.dontwantconnect(wantconnect)
+            wantconnect = nil
+        end
+        if srvfd and not session then
+            select.close(srvfd)
+            srvfd = nil
+        end
+    end
     function m.debug(v)
         stat.debug = v
     end
+    function m.compress(v)
+        stat.compress = v
+    end
+    function m.isremote()
+        return t.protocol ~= 'unix'
+    end
     function m.sendmsg(pkg)
         m.send(proto.send(pkg, stat))
     end
@@ -1,7 +1,37 @@
 local json = require 'common.json'
+local lz4 = require 'common.lz4'
+
+local COMPRESS_THRESHOLD <const> = 4096
 
 local m = {}
 
+local function parseHeader(s, header)
+    local length, options = header:match "^(%d+)(.*)$"
+    length = tonumber(length)
+    if not length then
+        return
+    end
+    if options ~= '' then
+        s.encoding = options:match "\r\nContent%-Encoding: ([%w%-]+)"
+        s.decodedLength = tonumber(options:match "\r\nContent%-Decoded%-Length: (%d+)")
+    end
+    return length
+end
+
+local function decode(s, res)
+    local encoding = s.encoding
+    if not encoding then
+        return res
+    end
+    local decodedLength = s.decodedLength
+    s.encoding = nil
+    s.decodedLength = nil
+    if encoding == 'lz4' then
+        return lz4.decompress(res, decodedLength)
+    end
+    return error('Invalid protocol.')
+end
+
 local function recv(s, bytes)
     bytes = bytes or ''
     s.bytes = s.bytes and (s.bytes .. bytes) or bytes
@@ -11,7 +41,7 @@ local function recv(s, bytes)
                 local res = s.bytes:sub(1, s.length)
                 s.bytes = s.bytes:sub(s.length + 1)
                 s.length = nil
-                return res
+                return decode(s, res)
             end
             return
         end
@@ -22,7 +52,7 @@ local function recv(s, bytes)
         if pos <= 15 or s.bytes:sub(1, 16) ~= 'Content-Length: ' then
             return error('Invalid protocol.')
         end
-        local length = tonumber(s.bytes:sub(17, pos-1))
+        local length = parseHeader(s, s.bytes:sub(17, pos-1))
         if not length then
             return error('Invalid protocol.')
         end
@@ -45,6 +75,12 @@ function m.send(cmd, stat)
     --end
     local pkg = json.encode(cmd)
     if stat.debug then print('[send]', pkg) end
+    if stat.compress and #pkg >= COMPRESS_THRESHOLD then
+        local data = lz4.compress(pkg)
+        if #data < #pkg then
+            return ('Content-Length: %d\r\nContent-Encoding: lz4\r\nContent-Decoded-Length: %d\r\n\r\n%s'):format(#data, #pkg, data)
+        end
+    end
     return ('Content-Length: %d\r\n\r\n%s'):format(#pkg, pkg)
 end
 
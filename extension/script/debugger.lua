@@ -166,7 +166,31 @@ end
 local dbg = {}
 
 function dbg:start(cfg)
+    if type(cfg) == "string" then
+        cfg = { address = cfg }
+    end
     initDebugger(self, cfg)
+    if cfg.headless then
+        -- Runs the collectors chosen by the config file, without a client.
+        self.rdebug.start(([[
+            local rootpath = %q
+            package.path = rootpath..'/script/?.lua'
+            require 'backend.bootstrap'. headless(rootpath, %q)
+        ]]):format(
+            self.root,
+            cfg.headless
+        ))
+        return self
+    end
+    self.rdebug.onfork(function(pid)
+        -- Called in a forked child, when the frontend asks to attach to child
+        -- processes, on the next event/poll/heartbeat of the host.
+        self:start {
+            address = ("@%s/tmp/pid_%d"):format(root, pid),
+            ansi = cfg.ansi,
+            luaVersion = cfg.luaVersion,
+        }
+    end)
 
     self.rdebug.start(([[
         local rootpath = %q
@@ -198,6 +222,16 @@ function dbg:event(...)
     return self
 end
 
+function dbg:poll(budget)
+    self.rdebug.poll(budget)
+    return self
+end
+
+function dbg:heartbeat()
+    self.rdebug.heartbeat()
+    return self
+end
+
 function dbg:set_wait(name, f)
     _G[name] = function(...)
         _G[name] = nil
@@ -0,0 +1,487 @@
+local network = require 'common.network'
+
+-- One session over the masters of several debuggee processes. It looks like
+-- a single server to the proxy: requests are routed to the process that owns
+-- the ids in their arguments, or sent to every process at once and their
+-- responses merged when the last one arrives.
+--
+-- The ids of a master already carry its worker in the high bits (see
+-- backend/master/threads.lua), the index of the process goes above them.
+
+local PROCESS_SHIFT <const> = 44
+local ID_MASK <const> = (1 << PROCESS_SHIFT) - 1
+
+-- Seconds to wait for a process to accept the connection. A process that is
+-- not there by then is given up, so that nothing waits on it forever.
+local CONNECT_TIMEOUT <const> = 10
+
+local Broadcast <const> = {
+    initialize = true,
+    attach = true,
+    launch = true,
+    configurationDone = true,
+    setBreakpoints = true,
+    setFunctionBreakpoints = true,
+    setExceptionBreakpoints = true,
+    continue = true,
+    threads = true,
+    loadedSources = true,
+    disconnect = true,
+    terminate = true,
+    restart = true,
+    customRequestShowIntegerAsDec = true,
+    customRequestShowIntegerAsHex = true,
+}
+
+local PerBreakpoint <const> = {
+    setBreakpoints = true,
+    setFunctionBreakpoints = true,
+    setExceptionBreakpoints = true,
+}
+
+local IdKeys <const> = {
+    threadId = true,
+    frameId = true,
+    variablesReference = true,
+    sourceReference = true,
+}
+
+local StringKeys <const> = {
+    memoryReference = true,
+    instructionPointerReference = true,
+}
+
+local function encode(p, body)
+    if type(body) ~= 'table' then
+        return
+    end
+    for k, v in pairs(body) do
+        if IdKeys[k] then
+            if math.type(v) == 'integer' and v > 0 then
+                body[k] = (p << PROCESS_SHIFT) | v
+            end
+        elseif StringKeys[k] then
+            if type(v) == 'string' then
+                body[k] = p .. ':' .. v
+            end
+        elseif type(v) == 'table' then
+            encode(p, v)
+        end
+    end
+end
+
+-- Decodes the ids of the arguments in place, and returns the process that
+-- owns them.
+local function decode(args)
+    local owner
+    local function walk(t)
+        for k, v in pairs(t) do
+            if IdKeys[k] then
+                if math.type(v) == 'integer' and v > 0 then
+                    owner = owner or (v >> PROCESS_SHIFT)
+                    t[k] = v & ID_MASK
+                end
+            elseif StringKeys[k] then
+                if type(v) == 'string' then
+                    local p, ref = v:match '^(%d+):(.*)$'
+                    if p then
+                        owner = owner or tonumber(p)
+                        t[k] = ref
+                    end
+                end
+            elseif type(v) == 'table' then
+                walk(v)
+            end
+        end
+    end
+    if type(args) == 'table' then
+        walk(args)
+    end
+    return owner
+end
+
+local function copy(t)
+    if type(t) ~= 'table' then
+        return t
+    end
+    local r = {}
+    for k, v in pairs(t) do
+        r[k] = copy(v)
+    end
+    return r
+end
+
+return function (addresses)
+    local m = {}
+    local procs = {}
+    local pending = {}
+    local queue = {}
+    local onclose = function() end
+    local alive = #addresses
+    local initialized = false
+    local terminated = 0
+    local capabilities = false
+    -- Each process numbers its breakpoints on its own. The client sees one
+    -- breakpoint per position in a request, with an id of the session, and
+    -- what every process last said about it.
+    local breakpointID = 0
+    local breakpoints = {}
+    local breakpointIds = {}
+
+    local function label(p, name)
+        return ('[%s] %s'):format(procs[p + 1].address, name)
+    end
+
+    local function push(pkg)
+        queue[#queue + 1] = pkg
+    end
+
+    -- The client sends its breakpoints once it sees `initialized`, so it
+    -- waits for every process that is still there.
+    local function checkInitialized()
+        if initialized then
+            return
+        end
+        for _, proc in ipairs(procs) do
+            if not proc.initialized and not proc.closed then
+                return
+            end
+        end
+        initialized = true
+        push {
+            type = 'event',
+            seq = 0,
+            event = 'initialized',
+        }
+    end
+
+    -- A breakpoint is verified as soon as one process verified it.
+    local function mergedBreakpoint(id)
+        local states = breakpoints[id]
+        local res
+        for p = 0, #procs - 1 do
+            local bp = states[p]
+            if bp and (not res or (bp.verified and not res.verified)) then
+                res = bp
+            end
+        end
+        res = copy(res)
+        res.id = id
+        return res
+    end
+
+    local function registerBreakpoints(responses)
+        local list = {}
+        for p = 0, #procs - 1 do
+            local res = responses[p]
+            if res and res.success and res.body and res.body.breakpoints then
+                local ids = breakpointIds[p]
+                if not ids then
+                    ids = {}
+                    breakpointIds[p] = ids
+                end
+                for i, bp in ipairs(res.body.breakpoints) do
+                    local id = list[i]
+                    if not id then
+                        breakpointID = breakpointID + 1
+                        id = breakpointID
+                        breakpoints[id] = {}
+                        list[i] = id
+                    end
+                    breakpoints[id][p] = bp
+                    if bp.id then
+                        ids[bp.id] = id
+                    end
+                end
+            end
+        end
+        for i, id in ipairs(list) do
+            list[i] = mergedBreakpoint(id)
+        end
+        return list
+    end
+
+    local function breakpointEvent(p, pkg)
+        local bp = pkg.body.breakpoint
+        local id = bp and bp.id and breakpointIds[p] and breakpointIds[p][bp.id]
+        if not id then
+            return
+        end
+        local state = breakpoints[id][p] or {}
+        for k, v in pairs(bp) do
+            state[k] = v
+        end
+        breakpoints[id][p] = state
+        pkg.body.breakpoint = mergedBreakpoint(id)
+    end
+
+    local function merge(req)
+        local first
+        for p = 0, #procs - 1 do
+            local res = req.responses[p]
+            if res and (res.success or not first) then
+                first = res
+                if res.success then
+                    break
+                end
+            end
+        end
+        if not first then
+            push {
+                type = 'response',
+                seq = 0,
+                command = req.command,
+                request_seq = req.seq,
+                success = false,
+                message = 'no process',
+            }
+            return
+        end
+        local field = req.command == 'threads' and 'threads' or req.command == 'loadedSources' and 'sources'
+        if field and first.success then
+            local list = {}
+            for p = 0, #procs - 1 do
+                local res = req.responses[p]
+                if res and res.success and res.body then
+                    for _, v in ipairs(res.body[field]) do
+                        list[#list + 1] = v
+                    end
+                end
+            end
+            first.body[field] = list
+        end
+        if PerBreakpoint[req.command] and first.success then
+            first.body.breakpoints = registerBreakpoints(req.responses)
+        end
+        push(first)
+    end
+
+    local function finish(seq, p, res)
+        local req = pending[seq]
+        if not req.waiting[p] then
+            return
+        end
+        req.waiting[p] = nil
+        req.n = req.n - 1
+        req.responses[p] = res
+        if req.n == 0 then
+            pending[seq] = nil
+            merge(req)
+        end
+    end
+
+    local function recv(p, pkg)
+        local proc = procs[p + 1]
+        if pkg.type == 'response' then
+            encode(p, pkg.body)
+            if pkg.success and pkg.command == 'threads' then
+                for _, thread in ipairs(pkg.body.threads) do
+                    thread.id = (p << PROCESS_SHIFT) | thread.id
+                    thread.name = label(p, thread.name)
+                end
+            elseif pkg.success and pkg.command == 'stackTrace' then
+                for _, frame in ipairs(pkg.body.stackFrames) do
+                    frame.id = (p << PROCESS_SHIFT) | frame.id
+                end
+            end
+            if pending[pkg.request_seq] then
+                finish(pkg.request_seq, p, pkg)
+                return
+            end
+            if PerBreakpoint[pkg.command] and pkg.success then
+                pkg.body.breakpoints = registerBreakpoints { [p] = pkg }
+            end
+            push(pkg)
+            return
+        end
+        if pkg.type == 'event' then
+            local name = pkg.event
+            if name == 'initialized' then
+                proc.initialized = true
+                checkInitialized()
+                return
+            end
+            if name == 'capabilities' then
+                if pkg.body.capabilities.supportsCompressedTransport and proc.server.isremote() then
+                    proc.server.compress(true)
+                end
+                if capabilities then
+                    return
+                end
+                capabilities = true
+            end
+            if name == 'terminated' then
+                if not proc.terminated then
+                    proc.terminated = true
+                    terminated = terminated + 1
+                end
+                if terminated < #procs then
+                    return
+                end
+            end
+            encode(p, pkg.body)
+            if name == 'breakpoint' then
+                breakpointEvent(p, pkg)
+            end
+            push(pkg)
+            return
+        end
+        push(pkg)
+    end
+
+    local function close(p)
+        local proc = procs[p + 1]
+        if proc.closed then
+            return
+        end
+        proc.closed = true
+        proc.server.cancel()
+        alive = alive - 1
+        if not proc.terminated then
+            proc.terminated = true
+            terminated = terminated + 1
+        end
+        for seq in pairs(pending) do
+            finish(seq, p, nil)
+        end
+        checkInitialized()
+        if alive == 0 then
+            onclose()
+        end
+    end
+
+    local function checkConnected(p)
+        local proc = procs[p + 1]
+        if proc.connected then
+            return
+        end
+        if proc.server.isconnected() then
+            proc.connected = true
+            return
+        end
+        if os.time() < proc.deadline then
+            return
+        end
+        push {
+            type = 'event',
+            seq = 0,
+            event = 'output',
+            body = {
+                category = 'stderr',
+                output = ('Cannot connect to `%s`.\n'):format(proc.address),
+            },
+        }
+        close(p)
+    end
+
+    for i, address in ipairs(addresses) do
+        local proc = {
+            address = address,
+            server = network("connect:" .. address),
+            deadline = os.time() + CONNECT_TIMEOUT,
+        }
+        procs[i] = proc
+        proc.server.event_close(function()
+            close(i - 1)
+        end)
+    end
+
+    local function send(p, pkg)
+        local proc = procs[p + 1]
+        if proc.closed then
+            return false
+        end
+        if pkg.command == 'initialize' and proc.server.isremote() then
+            pkg.arguments.supportsCompressedTransport = true
+        end
+        proc.server.sendmsg(pkg)
+        return true
+    end
+
+    local function broadcast(pkg)
+        if pkg.__norepl then
+            for p = 0, #procs - 1 do
+                send(p, copy(pkg))
+            end
+            return
+        end
+        local req = {
+            seq = pkg.seq,
+            command = pkg.command,
+            n = 0,
+            waiting = {},
+            responses = {},
+        }
+        for p = 0, #procs - 1 do
+            local copied = copy(pkg)
+            decode(copied.arguments)
+            if send(p, copied) then
+                req.n = req.n + 1
+                req.waiting[p] = true
+            end
+        end
+        if req.n > 0 then
+            pending[pkg.seq] = req
+        else
+            merge(req)
+        end
+    end
+
+    function m.sendmsg(pkg)
+        if pkg.type ~= 'request' then
+            return
+        end
+        -- A source that has a reference exists in its own process only.
+        local args = pkg.arguments
+        local owned = pkg.command == 'setBreakpoints' and args and args.source and (args.source.sourceReference or 0) > 0
+        if Broadcast[pkg.command] and not owned then
+            broadcast(pkg)
+            return
+        end
+        local p = decode(pkg.arguments) or 0
+        if p >= #procs or not send(p, pkg) then
+            push {
+                type = 'response',
+                seq = 0,
+                command = pkg.command,
+                request_seq = pkg.seq,
+                success = false,
+                message = ('Process `%d` is not connected.'):format(p),
+            }
+        end
+    end
+
+    function m.recvmsg()
+        for p, proc in ipairs(procs) do
+            if not proc.closed then
+                checkConnected(p - 1)
+            end
+            if not proc.closed then
+                while true do
+                    local pkg = proc.server.recvmsg()
+                    if not pkg then
+                        break
+                    end
+                    recv(p - 1, pkg)
+                end
+            end
+        end
+        if #queue > 0 then
+            return table.remove(queue, 1)
+        end
+    end
+
+    function m.event_close(f)
+        onclose = f
+    end
+
+    -- Compression is negotiated with each process on its own.
+    function m.isremote()
+        return false
+    end
+
+    function m.compress()
+    end
+
+    return m
+end
@@ -7,6 +7,7 @@ local process_inject = require 'frontend.process_inject'
 local server
 local client
 local initReq
+local startReq
 local m = {}
 
 local function getUnixAddress(pid)
@@ -45,6 +46,29 @@ local function response_error(req, msg)
     }
 end
 
+local function initialize_server()
+    if not server.isremote() then
+        server.sendmsg(initReq)
+        return
+    end
+    local req = {}
+    for k, v in pairs(initReq) do
+        req[k] = v
+    end
+    req.arguments = {}
+    for k, v in pairs(initReq.arguments) do
+        req.arguments[k] = v
+    end
+    req.arguments.supportsCompressedTransport = true
+    server.sendmsg(req)
+end
+
+local function update_capabilities(capabilities)
+    if capabilities.supportsCompressedTransport and server.isremote() then
+        server.compress(true)
+    end
+end
+
 local function request_runinterminal(args)
     client.sendmsg {
         type = 'request',
@@ -54,10 +78,52 @@ local function request_runinterminal(args)
     }
 end
 
-local function attach_process(pkg, pid)
+local LaunchOnly <const> = {
+    program = true,
+    arg = true,
+    arg0 = true,
+    cwd = true,
+    env = true,
+    luaexe = true,
+    runtimeExecutable = true,
+    runtimeArgs = true,
+    console = true,
+    inject = true,
+    processId = true,
+    processName = true,
+}
+
+local function request_startdebugging(pid)
+    if not initReq.arguments.supportsStartDebuggingRequest then
+        return
+    end
+    local configuration = {}
+    for k, v in pairs(startReq.arguments) do
+        if not LaunchOnly[k] then
+            configuration[k] = v
+        end
+    end
+    configuration.name = ("%s (%d)"):format(startReq.arguments.name, pid)
+    configuration.request = "attach"
+    configuration.address = getUnixAddress(pid)
+    configuration.client = true
+    configuration.stopOnEntry = false
+    client.sendmsg {
+        type = 'request',
+        seq = 0,
+        command = 'startDebugging',
+        arguments = {
+            request = "attach",
+            configuration = configuration,
+        }
+    }
+end
+
+local function attach_process(pkg, pid, luaVersion)
     local args = pkg.arguments
-    if args.luaVersion:match "^lua%-" then
-        ipc_send_luaversion(pid, args.luaVersion)
+    luaVersion = luaVersion or args.luaVersion
+    if luaVersion:match "^lua%-" then
+        ipc_send_luaversion(pid, luaVersion)
     end
     local ok, errmsg = process_inject.inject(pid, "attach", args)
     if not ok then
@@ -65,20 +131,30 @@ local function attach_process(pkg, pid)
 	end
 
     server = network("connect:"..getUnixAddress(pid))
-    server.sendmsg(initReq)
+    initialize_server()
     server.sendmsg(pkg)
     return true
 end
 
 local function attach_tcp(pkg, args)
     server = network((args.client and "connect:" or "listen:") .. args.address)
-    server.sendmsg(initReq)
+    initialize_server()
+    server.sendmsg(pkg)
+end
+
+local function attach_cluster(pkg, args)
+    server = require 'frontend.cluster'(args.addresses)
+    initialize_server()
     server.sendmsg(pkg)
 end
 
 local function proxy_attach(pkg)
     local args = pkg.arguments
     platform_os.init(args)
+    if args.addresses then
+        attach_cluster(pkg, args)
+        return
+    end
     if platform_os() ~= "Windows" and platform_os() ~= "macOS" then
 		attach_tcp(pkg, args)
 		return
@@ -92,17 +168,28 @@ local function proxy_attach(pkg)
         return
     end
     if args.processName then
-        local pids = require "frontend.query_process"(args.processName)
-        if #pids == 0 then
+        local processes = require "frontend.query_process"(args.processName)
+        if #processes == 0 then
             response_error(pkg, ('Cannot found process `%s`.'):format(args.processName))
             return
-        elseif #pids > 1 then
-            response_error(pkg, ('There are %d processes `%s`.'):format(#pids, args.processName))
+        elseif #processes > 1 then
+            local list = {}
+            for i, process in ipairs(processes) do
+                list[i] = ('%d%s%s'):format(
+                    process.pid,
+                    process.luaVersion and (' ' .. process.luaVersion) or '',
+                    process.debugger and ' (debugger loaded)' or ''
+                )
+            end
+            response_error(pkg, ('There are %d processes `%s`: %s.'):format(#processes, args.processName, table.concat(list, ', ')))
             return
         end
-        local ok, errmsg = attach_process(pkg, pids[1])
+        local process = processes[1]
+        -- A process that already loaded the debugger must be attached with
+        -- the runtime it loaded.
+        local ok, errmsg = attach_process(pkg, process.pid, process.debugger and process.luaVersion or nil)
         if not ok then
-            response_error(pkg, ('Cannot attach process `%s` `%d`. %s'):format(args.processName, pids[1], errmsg))
+            response_error(pkg, ('Cannot attach process `%s` `%d`. %s'):format(args.processName, process.pid, errmsg))
         end
         return
     end
@@ -196,11 +283,12 @@ local function proxy_launch(pkg)
             return
         end
     end
-    server.sendmsg(initReq)
+    initialize_server()
     server.sendmsg(pkg)
 end
 
 local function proxy_start(pkg)
+    startReq = pkg
     if pkg.arguments.request == 'attach' then
         proxy_attach(pkg)
     elseif pkg.arguments.request == 'launch' then
@@ -210,7 +298,7 @@ end
 
 function m.send(pkg)
     if server then
-        if pkg.type == 'response' and pkg.command == 'runInTerminal' then
+        if pkg.type == 'response' and (pkg.command == 'runInTerminal' or pkg.command == 'startDebugging') then
             return
         end
         server.sendmsg(pkg)
@@ -241,7 +329,14 @@ function m.update()
         while true do
             local pkg = server.recvmsg()
             if pkg then
-                client.sendmsg(pkg)
+                if pkg.type == 'event' and pkg.event == 'capabilities' then
+                    update_capabilities(pkg.body.capabilities)
+                end
+                if pkg.type == 'event' and pkg.event == 'childProcess' then
+                    request_startdebugging(pkg.body.processId)
+                else
+                    client.sendmsg(pkg)
+                end
             else
                 break
             end
@@ -11,6 +11,16 @@ if platform.OS == "Windows" then
         SKIP = 1
     end
 elseif platform.OS == "Linux" then
+    local ok, query = pcall(require, "query_process")
+    if ok then
+        -- Scans /proc natively and reports processes with Lua loaded, with
+        -- their luaVersion and whether the debugger is loaded. With byName,
+        -- the processes of that name are reported when none of them has a
+        -- Lua runtime mapped.
+        return function (n, byName)
+            return query.scan(n, byName)
+        end
+    end
     COMMAND = "ps axww -o comm=,pid="
 elseif platform.OS == "macOS" then
     COMMAND = "ps axww -o comm=,pid= -c"
@@ -26,7 +36,10 @@ return function (n)
     for line in f:lines() do
         local name, processid = line:match "^([^%s].*[^%s])%s+(%d+)%s*$"
         if n == name then
-            res[#res+1] = tonumber(processid)
+            res[#res+1] = {
+                pid = tonumber(processid),
+                name = name,
+            }
         end
     end
     return res
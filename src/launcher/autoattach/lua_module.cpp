@@ -22,7 +22,7 @@ namespace luadebug::autoattach {
         return lua_version::unknown;
     }
 
-    static const char* lua_version_to_string(lua_version v) {
+    const char* lua_version_to_string(lua_version v) {
         switch (v) {
         case lua_version::lua51:
             return "lua51";
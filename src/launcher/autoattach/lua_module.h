@@ -15,6 +15,8 @@ namespace luadebug::autoattach {
         lua53,
         lua54,
     };
+    const char* lua_version_to_string(lua_version v);
+
     struct lua_module {
         std::string path;
         std::string name;
@@ -60,6 +60,18 @@ namespace luadebug::autoattach {
         if (!context->init()) {
             return nullptr;
         }
+        switch (version) {
+        case lua_version::lua52:
+        case lua_version::lua53:
+        case lua_version::lua54:
+            // lua_resume of 5.1 has no `from`, and LuaJIT sets the hook of
+            // all coroutines at once.
+            context->init_thread(resolver);
+            break;
+        default:
+            break;
+        }
+        context->init_inventory(resolver, version);
         if (context->init_watch(resolver, get_watch_points(mode, version))) {
             // TODO: fix other thread pc
             context->hook();
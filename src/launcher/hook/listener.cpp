@@ -2,6 +2,8 @@
 #include <hook/luajit_listener.h>
 #include <hook/watchdog.h>
 
+#include <vector>
+
 namespace luadebug::autoattach {
 
     void common_listener::on_enter(Gum::InvocationContext* context) {
@@ -24,4 +26,35 @@ namespace luadebug::autoattach {
         w->watch_entry((uintptr_t)context->get_return_value_ptr());
     }
 
+    void close_listener::on_enter(Gum::InvocationContext* context) {
+        watchdog* w = (watchdog*)context->get_listener_function_data_ptr();
+        w->close_entry((uintptr_t)context->get_nth_argument_ptr(0));
+    }
+
+    // lua_resume(L, from, ...) doesn't throw, so every entry has a leave on
+    // the same thread, and nested resumes are matched by a stack.
+    struct resume_call {
+        lua::state L;
+        lua::state from;
+    };
+    static thread_local std::vector<resume_call> resume_calls;
+
+    void thread_listener::on_enter(Gum::InvocationContext* context) {
+        watchdog* w     = (watchdog*)context->get_listener_function_data_ptr();
+        lua::state L    = (uintptr_t)context->get_nth_argument_ptr(0);
+        lua::state from = (uintptr_t)context->get_nth_argument_ptr(1);
+        resume_calls.push_back({ L, from });
+        w->thread_event(L, from, 0);
+    }
+
+    void thread_listener::on_leave(Gum::InvocationContext* context) {
+        if (resume_calls.empty()) {
+            return;
+        }
+        watchdog* w   = (watchdog*)context->get_listener_function_data_ptr();
+        resume_call c = resume_calls.back();
+        resume_calls.pop_back();
+        w->thread_event(c.from, c.L, 1);
+    }
+
 }
@@ -23,4 +23,15 @@ namespace luadebug::autoattach {
         virtual ~ret_listener() = default;
         virtual void on_leave(Gum::InvocationContext* context) override;
     };
+
+    struct close_listener : Gum::NoLeaveInvocationListener {
+        virtual ~close_listener() = default;
+        virtual void on_enter(Gum::InvocationContext* context) override;
+    };
+
+    struct thread_listener : Gum::InvocationListener {
+        virtual ~thread_listener() = default;
+        virtual void on_enter(Gum::InvocationContext* context) override;
+        virtual void on_leave(Gum::InvocationContext* context) override;
+    };
 }
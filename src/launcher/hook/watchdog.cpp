@@ -168,6 +168,9 @@ namespace luadebug::autoattach {
                 log::info("interceptor attach failed:{}[{}]", point.address, point.funcname);
             }
         }
+        if (close_address && !interceptor->attach(close_address, &listener_close, this)) {
+            log::info("interceptor attach failed:{}[lua_close]", close_address);
+        }
         return true;
     }
 
@@ -176,6 +179,8 @@ namespace luadebug::autoattach {
         interceptor->detach(&listener_luajit_global);
         interceptor->detach(&listener_luajit_jit);
         interceptor->detach(&listener_ret);
+        interceptor->detach(&listener_thread);
+        interceptor->detach(&listener_close);
     }
 
     bool watchdog::init() {
@@ -202,14 +207,126 @@ namespace luadebug::autoattach {
         return ok;
     }
 
+    // A Lua that isn't patched has no LUA_HOOKTHREAD, so the debugger doesn't
+    // know when a coroutine is resumed. lua_resume is intercepted instead,
+    // once the debugger is loaded and exports the receiver of the events.
+    bool watchdog::init_thread(const lua::resolver& resolver) {
+        resume_address = (void*)resolver.find("lua_resume");
+        return !!resume_address;
+    }
+
+    void watchdog::hook_thread() {
+        std::lock_guard guard(mtx);
+        if (!resume_address || threadevent) {
+            return;
+        }
+        threadevent = (decltype(threadevent))Gum::Process::module_find_export_by_name(nullptr, "luadebug_threadevent");
+        if (!threadevent) {
+            log::info("can't find luadebug_threadevent");
+            return;
+        }
+        if (!interceptor->attach(resume_address, &listener_thread, this)) {
+            log::info("interceptor attach failed:{}[lua_resume]", resume_address);
+        }
+    }
+
+    void watchdog::thread_event(lua::state L, lua::state from, int type) {
+        threadevent(L, from, type);
+    }
+
+    // The states that ran the attach hook are kept for the debugger, which
+    // only knows the one it is attached to. lua_close drops them, so that a
+    // new state at the same address is watched again.
+    bool watchdog::init_inventory(const lua::resolver& resolver, lua_version v) {
+        version       = v;
+        close_address = (void*)resolver.find("lua_close");
+        return !!close_address;
+    }
+
+    void watchdog::close_entry(lua::state L) {
+        std::lock_guard guard(mtx);
+        lua_state_hooked.erase(L);
+        lua_states.erase(L);
+    }
+
+    // The compat layer of the debugger isn't there, and the launcher doesn't
+    // know the layout of lua_State, so only the public API is used. Lua 5.1
+    // and LuaJIT can't reach the main thread from a coroutine.
+    lua::state watchdog::mainthread(lua::state L) {
+        int ismain = lua::call<lua_pushthread>(L);
+        lua::pop(L, 1);
+        if (ismain) {
+            return L;
+        }
+        switch (version) {
+        case lua_version::lua52:
+        case lua_version::lua53:
+        case lua_version::lua54: {
+            lua::call<lua_rawgeti>(L, LUA_REGISTRYINDEX, LUA_RIDX_MAINTHREAD);
+            lua::state main = lua::call<lua_tothread>(L, -1);
+            lua::pop(L, 1);
+            return main;
+        }
+        default:
+            return 0;
+        }
+    }
+
+    void watchdog::update_entry(lua::state L, const char* status, size_t heap) {
+        lua::state main = mainthread(L);
+        if (!main) {
+            return;
+        }
+        std::lock_guard guard(mtx);
+        auto& info  = lua_states[main];
+        info.status = status;
+        info.heap   = heap;
+    }
+
+    void watchdog::visit_states(state_visitor f, void* ud) {
+        std::lock_guard guard(mtx);
+        const char* name = lua_version_to_string(version);
+        for (auto& [L, info] : lua_states) {
+            f(ud, L, info.status, name, info.heap, lua::call<lua_gethookmask>(L));
+        }
+    }
+
+    void watchdog::publish_inventory() {
+        using visit_t        = void (*)(void* self, state_visitor f, void* ud);
+        using setinventory_t = void (*)(visit_t f, void* self);
+        {
+            std::lock_guard guard(mtx);
+            if (inventory_published) {
+                return;
+            }
+            inventory_published = true;
+        }
+        auto setinventory = (setinventory_t)Gum::Process::module_find_export_by_name(nullptr, "luadebug_setinventory");
+        if (!setinventory) {
+            log::info("can't find luadebug_setinventory");
+            return;
+        }
+        setinventory([](void* self, state_visitor f, void* ud) { ((watchdog*)self)->visit_states(f, ud); }, this);
+    }
+
     void watchdog::attach_lua(lua::state L, lua::debug ar) {
-        switch (autoattach::attach_lua(L)) {
-        case attach_status::fatal:
+        attach_status status = autoattach::attach_lua(L);
+        size_t heap          = ((size_t)lua::call<lua_gc>(L, LUA_GCCOUNT, 0) << 10) + (size_t)lua::call<lua_gc>(L, LUA_GCCOUNTB, 0);
+        switch (status) {
         case attach_status::success:
+            update_entry(L, "attached", heap);
+            hook_thread();
+            publish_inventory();
+            // TODO: how to free so
+            // TODO: free all resources
+            break;
+        case attach_status::fatal:
+            update_entry(L, "failed", heap);
             // TODO: how to free so
             // TODO: free all resources
             break;
         case attach_status::wait:
+            update_entry(L, "watching", heap);
             luahook_set(L);
             break;
         default:
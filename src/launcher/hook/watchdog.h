@@ -1,11 +1,13 @@
 #pragma once
 
 #include <autoattach/autoattach.h>
+#include <autoattach/lua_module.h>
 #include <hook/listener.h>
 #include <hook/watch_point.h>
 #include <resolver/lua_delayload.h>
 
 #include <gumpp.hpp>
+#include <map>
 #include <mutex>
 #include <set>
 #include <string>
@@ -25,6 +27,14 @@ namespace luadebug::autoattach {
         void unhook();
         void watch_entry(lua::state L);
         void attach_lua(lua::state L, lua::debug ar);
+        bool init_thread(const lua::resolver& resolver);
+        void hook_thread();
+        void thread_event(lua::state L, lua::state from, int type);
+        bool init_inventory(const lua::resolver& resolver, lua_version version);
+        void close_entry(lua::state L);
+
+        using state_visitor = void (*)(void* ud, lua::state L, const char* status, const char* version, size_t heap, int hookmask);
+        void visit_states(state_visitor f, void* ud);
 
     private:
         std::mutex mtx;
@@ -34,7 +44,25 @@ namespace luadebug::autoattach {
         luajit_global_listener listener_luajit_global;
         luajit_jit_listener listener_luajit_jit;
         ret_listener listener_ret;
+        thread_listener listener_thread;
+        void* resume_address = nullptr;
+        void (*threadevent)(lua::state L, lua::state from, int type) = nullptr;
+        close_listener listener_close;
+        void* close_address = nullptr;
+        lua_version version = lua_version::unknown;
+        bool inventory_published = false;
+        struct state_info {
+            const char* status = "watching";
+            // Sampled when the state runs the attach hook, the only time the
+            // launcher is on its thread at a safe point.
+            size_t heap = 0;
+        };
         std::set<lua::state> lua_state_hooked;
+        // Keyed by the main thread: coroutines are freed without lua_close.
+        std::map<lua::state, state_info> lua_states;
+        lua::state mainthread(lua::state L);
+        void update_entry(lua::state L, const char* status, size_t heap);
+        void publish_inventory();
         uint8_t luahook_index;
         lua::cfunction luahook_set = nullptr;
     };
@@ -40,6 +40,10 @@ namespace luadebug::lua::impl {
     struct invocable<R (*)(Args...)> {
         using type = conv_t<R> (*)(conv_t<Args>...);
     };
+    template <class R, class... Args>
+    struct invocable<R (*)(Args..., ...)> {
+        using type = conv_t<R> (*)(conv_t<Args>..., ...);
+    };
 
     template <typename T>
     struct global {
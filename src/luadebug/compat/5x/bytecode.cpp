@@ -0,0 +1,802 @@
+#include <cstdio>
+#include <cstring>
+
+#include <ldebug.h>
+#include <lopcodes.h>
+#include <lstate.h>
+
+#include "compat/internal.h"
+
+// luaP_opnames and luaP_opmodes are internal to the host Lua, so the
+// opcode tables are repeated here. They follow lopcodes.c of each version.
+
+#if LUA_VERSION_NUM >= 504
+struct opinfo {
+    const char* name;
+    OpMode mode;
+};
+static const opinfo opcodes[] = {
+    { "MOVE", iABC },
+    { "LOADI", iAsBx },
+    { "LOADF", iAsBx },
+    { "LOADK", iABx },
+    { "LOADKX", iABx },
+    { "LOADFALSE", iABC },
+    { "LFALSESKIP", iABC },
+    { "LOADTRUE", iABC },
+    { "LOADNIL", iABC },
+    { "GETUPVAL", iABC },
+    { "SETUPVAL", iABC },
+    { "GETTABUP", iABC },
+    { "GETTABLE", iABC },
+    { "GETI", iABC },
+    { "GETFIELD", iABC },
+    { "SETTABUP", iABC },
+    { "SETTABLE", iABC },
+    { "SETI", iABC },
+    { "SETFIELD", iABC },
+    { "NEWTABLE", iABC },
+    { "SELF", iABC },
+    { "ADDI", iABC },
+    { "ADDK", iABC },
+    { "SUBK", iABC },
+    { "MULK", iABC },
+    { "MODK", iABC },
+    { "POWK", iABC },
+    { "DIVK", iABC },
+    { "IDIVK", iABC },
+    { "BANDK", iABC },
+    { "BORK", iABC },
+    { "BXORK", iABC },
+    { "SHRI", iABC },
+    { "SHLI", iABC },
+    { "ADD", iABC },
+    { "SUB", iABC },
+    { "MUL", iABC },
+    { "MOD", iABC },
+    { "POW", iABC },
+    { "DIV", iABC },
+    { "IDIV", iABC },
+    { "BAND", iABC },
+    { "BOR", iABC },
+    { "BXOR", iABC },
+    { "SHL", iABC },
+    { "SHR", iABC },
+    { "MMBIN", iABC },
+    { "MMBINI", iABC },
+    { "MMBINK", iABC },
+    { "UNM", iABC },
+    { "BNOT", iABC },
+    { "NOT", iABC },
+    { "LEN", iABC },
+    { "CONCAT", iABC },
+    { "CLOSE", iABC },
+    { "TBC", iABC },
+    { "JMP", isJ },
+    { "EQ", iABC },
+    { "LT", iABC },
+    { "LE", iABC },
+    { "EQK", iABC },
+    { "EQI", iABC },
+    { "LTI", iABC },
+    { "LEI", iABC },
+    { "GTI", iABC },
+    { "GEI", iABC },
+    { "TEST", iABC },
+    { "TESTSET", iABC },
+    { "CALL", iABC },
+    { "TAILCALL", iABC },
+    { "RETURN", iABC },
+    { "RETURN0", iABC },
+    { "RETURN1", iABC },
+    { "FORLOOP", iABx },
+    { "FORPREP", iABx },
+    { "TFORPREP", iABx },
+    { "TFORCALL", iABC },
+    { "TFORLOOP", iABx },
+    { "SETLIST", iABC },
+    { "CLOSURE", iABx },
+    { "VARARG", iABC },
+    { "VARARGPREP", iABC },
+    { "EXTRAARG", iAx },
+};
+#else
+struct opinfo {
+    const char* name;
+    OpMode mode;
+    OpArgMask b;
+    OpArgMask c;
+};
+static const opinfo opcodes[] = {
+#    if LUA_VERSION_NUM == 503
+    { "MOVE", iABC, OpArgR, OpArgN },
+    { "LOADK", iABx, OpArgK, OpArgN },
+    { "LOADKX", iABx, OpArgN, OpArgN },
+    { "LOADBOOL", iABC, OpArgU, OpArgU },
+    { "LOADNIL", iABC, OpArgU, OpArgN },
+    { "GETUPVAL", iABC, OpArgU, OpArgN },
+    { "GETTABUP", iABC, OpArgU, OpArgK },
+    { "GETTABLE", iABC, OpArgR, OpArgK },
+    { "SETTABUP", iABC, OpArgK, OpArgK },
+    { "SETUPVAL", iABC, OpArgU, OpArgN },
+    { "SETTABLE", iABC, OpArgK, OpArgK },
+    { "NEWTABLE", iABC, OpArgU, OpArgU },
+    { "SELF", iABC, OpArgR, OpArgK },
+    { "ADD", iABC, OpArgK, OpArgK },
+    { "SUB", iABC, OpArgK, OpArgK },
+    { "MUL", iABC, OpArgK, OpArgK },
+    { "MOD", iABC, OpArgK, OpArgK },
+    { "POW", iABC, OpArgK, OpArgK },
+    { "DIV", iABC, OpArgK, OpArgK },
+    { "IDIV", iABC, OpArgK, OpArgK },
+    { "BAND", iABC, OpArgK, OpArgK },
+    { "BOR", iABC, OpArgK, OpArgK },
+    { "BXOR", iABC, OpArgK, OpArgK },
+    { "SHL", iABC, OpArgK, OpArgK },
+    { "SHR", iABC, OpArgK, OpArgK },
+    { "UNM", iABC, OpArgR, OpArgN },
+    { "BNOT", iABC, OpArgR, OpArgN },
+    { "NOT", iABC, OpArgR, OpArgN },
+    { "LEN", iABC, OpArgR, OpArgN },
+    { "CONCAT", iABC, OpArgR, OpArgR },
+    { "JMP", iAsBx, OpArgR, OpArgN },
+    { "EQ", iABC, OpArgK, OpArgK },
+    { "LT", iABC, OpArgK, OpArgK },
+    { "LE", iABC, OpArgK, OpArgK },
+    { "TEST", iABC, OpArgN, OpArgU },
+    { "TESTSET", iABC, OpArgR, OpArgU },
+    { "CALL", iABC, OpArgU, OpArgU },
+    { "TAILCALL", iABC, OpArgU, OpArgU },
+    { "RETURN", iABC, OpArgU, OpArgN },
+    { "FORLOOP", iAsBx, OpArgR, OpArgN },
+    { "FORPREP", iAsBx, OpArgR, OpArgN },
+    { "TFORCALL", iABC, OpArgN, OpArgU },
+    { "TFORLOOP", iAsBx, OpArgR, OpArgN },
+    { "SETLIST", iABC, OpArgU, OpArgU },
+    { "CLOSURE", iABx, OpArgU, OpArgN },
+    { "VARARG", iABC, OpArgU, OpArgN },
+    { "EXTRAARG", iAx, OpArgU, OpArgU },
+#    elif LUA_VERSION_NUM == 502
+    { "MOVE", iABC, OpArgR, OpArgN },
+    { "LOADK", iABx, OpArgK, OpArgN },
+    { "LOADKX", iABx, OpArgN, OpArgN },
+    { "LOADBOOL", iABC, OpArgU, OpArgU },
+    { "LOADNIL", iABC, OpArgU, OpArgN },
+    { "GETUPVAL", iABC, OpArgU, OpArgN },
+    { "GETTABUP", iABC, OpArgU, OpArgK },
+    { "GETTABLE", iABC, OpArgR, OpArgK },
+    { "SETTABUP", iABC, OpArgK, OpArgK },
+    { "SETUPVAL", iABC, OpArgU, OpArgN },
+    { "SETTABLE", iABC, OpArgK, OpArgK },
+    { "NEWTABLE", iABC, OpArgU, OpArgU },
+    { "SELF", iABC, OpArgR, OpArgK },
+    { "ADD", iABC, OpArgK, OpArgK },
+    { "SUB", iABC, OpArgK, OpArgK },
+    { "MUL", iABC, OpArgK, OpArgK },
+    { "DIV", iABC, OpArgK, OpArgK },
+    { "MOD", iABC, OpArgK, OpArgK },
+    { "POW", iABC, OpArgK, OpArgK },
+    { "UNM", iABC, OpArgR, OpArgN },
+    { "NOT", iABC, OpArgR, OpArgN },
+    { "LEN", iABC, OpArgR, OpArgN },
+    { "CONCAT", iABC, OpArgR, OpArgR },
+    { "JMP", iAsBx, OpArgR, OpArgN },
+    { "EQ", iABC, OpArgK, OpArgK },
+    { "LT", iABC, OpArgK, OpArgK },
+    { "LE", iABC, OpArgK, OpArgK },
+    { "TEST", iABC, OpArgN, OpArgU },
+    { "TESTSET", iABC, OpArgR, OpArgU },
+    { "CALL", iABC, OpArgU, OpArgU },
+    { "TAILCALL", iABC, OpArgU, OpArgU },
+    { "RETURN", iABC, OpArgU, OpArgN },
+    { "FORLOOP", iAsBx, OpArgR, OpArgN },
+    { "FORPREP", iAsBx, OpArgR, OpArgN },
+    { "TFORCALL", iABC, OpArgN, OpArgU },
+    { "TFORLOOP", iAsBx, OpArgR, OpArgN },
+    { "SETLIST", iABC, OpArgU, OpArgU },
+    { "CLOSURE", iABx, OpArgU, OpArgN },
+    { "VARARG", iABC, OpArgU, OpArgN },
+    { "EXTRAARG", iAx, OpArgU, OpArgU },
+#    else
+    { "MOVE", iABC, OpArgR, OpArgN },
+    { "LOADK", iABx, OpArgK, OpArgN },
+    { "LOADBOOL", iABC, OpArgU, OpArgU },
+    { "LOADNIL", iABC, OpArgR, OpArgN },
+    { "GETUPVAL", iABC, OpArgU, OpArgN },
+    { "GETGLOBAL", iABx, OpArgK, OpArgN },
+    { "GETTABLE", iABC, OpArgR, OpArgK },
+    { "SETGLOBAL", iABx, OpArgK, OpArgN },
+    { "SETUPVAL", iABC, OpArgU, OpArgN },
+    { "SETTABLE", iABC, OpArgK, OpArgK },
+    { "NEWTABLE", iABC, OpArgU, OpArgU },
+    { "SELF", iABC, OpArgR, OpArgK },
+    { "ADD", iABC, OpArgK, OpArgK },
+    { "SUB", iABC, OpArgK, OpArgK },
+    { "MUL", iABC, OpArgK, OpArgK },
+    { "DIV", iABC, OpArgK, OpArgK },
+    { "MOD", iABC, OpArgK, OpArgK },
+    { "POW", iABC, OpArgK, OpArgK },
+    { "UNM", iABC, OpArgR, OpArgN },
+    { "NOT", iABC, OpArgR, OpArgN },
+    { "LEN", iABC, OpArgR, OpArgN },
+    { "CONCAT", iABC, OpArgR, OpArgR },
+    { "JMP", iAsBx, OpArgR, OpArgN },
+    { "EQ", iABC, OpArgK, OpArgK },
+    { "LT", iABC, OpArgK, OpArgK },
+    { "LE", iABC, OpArgK, OpArgK },
+    { "TEST", iABC, OpArgR, OpArgU },
+    { "TESTSET", iABC, OpArgR, OpArgU },
+    { "CALL", iABC, OpArgU, OpArgU },
+    { "TAILCALL", iABC, OpArgU, OpArgU },
+    { "RETURN", iABC, OpArgU, OpArgN },
+    { "FORLOOP", iAsBx, OpArgR, OpArgN },
+    { "FORPREP", iAsBx, OpArgR, OpArgN },
+    { "TFORLOOP", iABC, OpArgN, OpArgU },
+    { "SETLIST", iABC, OpArgU, OpArgU },
+    { "CLOSE", iABC, OpArgN, OpArgN },
+    { "CLOSURE", iABx, OpArgU, OpArgN },
+    { "VARARG", iABC, OpArgU, OpArgN },
+#    endif
+};
+#endif
+
+static_assert(sizeof(opcodes) / sizeof(opcodes[0]) == NUM_OPCODES);
+
+#if LUA_VERSION_NUM >= 504
+static int proto_line(Proto* p, int pc) {
+    if (p->lineinfo == NULL) {
+        return -1;
+    }
+    int basepc;
+    int baseline;
+    if (p->sizeabslineinfo == 0 || pc < p->abslineinfo[0].pc) {
+        basepc   = -1;
+        baseline = p->linedefined;
+    }
+    else {
+        int i = (int)((unsigned int)pc / MAXIWTHABS) - 1;
+        while (i + 1 < p->sizeabslineinfo && pc >= p->abslineinfo[i + 1].pc)
+            i++;
+        basepc   = p->abslineinfo[i].pc;
+        baseline = p->abslineinfo[i].line;
+    }
+    while (basepc++ < pc) {
+        baseline += p->lineinfo[basepc];
+    }
+    return baseline;
+}
+#else
+static int proto_line(Proto* p, int pc) {
+    return p->lineinfo ? p->lineinfo[pc] : -1;
+}
+#endif
+
+static void format_string(char* buf, size_t size, const char* s, size_t len) {
+    size_t n   = 0;
+    buf[n++]   = '"';
+    size_t max = size - 5;
+    for (size_t i = 0; i < len; ++i) {
+        if (n >= max) {
+            strcpy(buf + n, "...");
+            return;
+        }
+        unsigned char c = (unsigned char)s[i];
+        buf[n++]        = (c < 0x20 || c == 0x7f) ? '?' : (char)c;
+    }
+    buf[n++] = '"';
+    buf[n]   = '\0';
+}
+
+static void format_constant(char* buf, size_t size, Proto* p, int idx) {
+    if (idx < 0 || idx >= p->sizek) {
+        snprintf(buf, size, "?");
+        return;
+    }
+    const TValue* o = &p->k[idx];
+    if (ttisstring(o)) {
+#if LUA_VERSION_NUM >= 503
+        format_string(buf, size, svalue(o), tsslen(tsvalue(o)));
+#else
+        format_string(buf, size, svalue(o), tsvalue(o)->len);
+#endif
+        return;
+    }
+#if LUA_VERSION_NUM >= 503
+    if (ttisinteger(o)) {
+        snprintf(buf, size, LUA_INTEGER_FMT, (LUAI_UACINT)ivalue(o));
+        return;
+    }
+    if (ttisfloat(o)) {
+        snprintf(buf, size, LUA_NUMBER_FMT, (LUAI_UACNUMBER)fltvalue(o));
+        return;
+    }
+#else
+    if (ttisnumber(o)) {
+        snprintf(buf, size, LUA_NUMBER_FMT, nvalue(o));
+        return;
+    }
+#endif
+#if LUA_VERSION_NUM >= 504
+    if (ttisfalse(o)) {
+        snprintf(buf, size, "false");
+        return;
+    }
+    if (ttistrue(o)) {
+        snprintf(buf, size, "true");
+        return;
+    }
+#else
+    if (ttisboolean(o)) {
+        snprintf(buf, size, bvalue(o) ? "true" : "false");
+        return;
+    }
+#endif
+    snprintf(buf, size, "nil");
+}
+
+static void format_jump(char* buf, size_t size, int target) {
+    snprintf(buf, size, "to %d", target + 1);
+}
+
+#if LUA_VERSION_NUM >= 504
+static void format_comment(Proto* p, int pc, Instruction i, lua_instruction* inst) {
+    char* buf   = inst->comment;
+    size_t size = sizeof(inst->comment);
+    switch (GET_OPCODE(i)) {
+    case OP_LOADK:
+        format_constant(buf, size, p, GETARG_Bx(i));
+        break;
+    case OP_GETTABUP:
+    case OP_GETFIELD:
+    case OP_ADDK:
+    case OP_SUBK:
+    case OP_MULK:
+    case OP_MODK:
+    case OP_POWK:
+    case OP_DIVK:
+    case OP_IDIVK:
+    case OP_BANDK:
+    case OP_BORK:
+    case OP_BXORK:
+        format_constant(buf, size, p, GETARG_C(i));
+        break;
+    case OP_SETTABUP:
+    case OP_SETFIELD: {
+        char key[32];
+        format_constant(key, sizeof(key), p, GETARG_B(i));
+        if (GETARG_k(i)) {
+            char value[32];
+            format_constant(value, sizeof(value), p, GETARG_C(i));
+            snprintf(buf, size, "%s %s", key, value);
+        }
+        else {
+            snprintf(buf, size, "%s", key);
+        }
+        break;
+    }
+    case OP_SETTABLE:
+    case OP_SETI:
+    case OP_SELF:
+        if (GETARG_k(i)) {
+            format_constant(buf, size, p, GETARG_C(i));
+        }
+        break;
+    case OP_EQK:
+    case OP_MMBINK:
+        format_constant(buf, size, p, GETARG_B(i));
+        break;
+    case OP_JMP:
+        format_jump(buf, size, pc + 1 + GETARG_sJ(i));
+        break;
+    case OP_FORLOOP:
+    case OP_TFORLOOP:
+        format_jump(buf, size, pc + 1 - GETARG_Bx(i));
+        break;
+    case OP_FORPREP:
+        format_jump(buf, size, pc + 2 + GETARG_Bx(i));
+        break;
+    case OP_TFORPREP:
+        format_jump(buf, size, pc + 1 + GETARG_Bx(i));
+        break;
+    default:
+        break;
+    }
+}
+
+static void format_operands(Instruction i, lua_instruction* inst) {
+    char* buf   = inst->operands;
+    size_t size = sizeof(inst->operands);
+    switch (opcodes[GET_OPCODE(i)].mode) {
+    case iABC: {
+        // The immediate operands are signed, luac -l shows them that way.
+        int b = GETARG_B(i);
+        int c = GETARG_C(i);
+        switch (GET_OPCODE(i)) {
+        case OP_ADDI:
+        case OP_SHRI:
+        case OP_SHLI:
+            c = GETARG_sC(i);
+            break;
+        case OP_MMBINI:
+        case OP_EQI:
+        case OP_LTI:
+        case OP_LEI:
+        case OP_GTI:
+        case OP_GEI:
+            b = GETARG_sB(i);
+            break;
+        default:
+            break;
+        }
+        if (GETARG_k(i))
+            snprintf(buf, size, "%d %d %d k", GETARG_A(i), b, c);
+        else
+            snprintf(buf, size, "%d %d %d", GETARG_A(i), b, c);
+        break;
+    }
+    case iABx:
+        snprintf(buf, size, "%d %d", GETARG_A(i), GETARG_Bx(i));
+        break;
+    case iAsBx:
+        snprintf(buf, size, "%d %d", GETARG_A(i), GETARG_sBx(i));
+        break;
+    case iAx:
+        snprintf(buf, size, "%d", GETARG_Ax(i));
+        break;
+    case isJ:
+        snprintf(buf, size, "%d", GETARG_sJ(i));
+        break;
+    }
+}
+#else
+// Constants of RK operands are shown as negative numbers, like luac does.
+static int rk(OpArgMask mask, int v) {
+    return (mask == OpArgK && ISK(v)) ? -1 - INDEXK(v) : v;
+}
+
+static void format_comment(Proto* p, int pc, Instruction i, lua_instruction* inst) {
+    const opinfo& op = opcodes[GET_OPCODE(i)];
+    char* buf        = inst->comment;
+    size_t size      = sizeof(inst->comment);
+    switch (op.mode) {
+    case iABC: {
+        int b = GETARG_B(i);
+        int c = GETARG_C(i);
+        bool kb = op.b == OpArgK && ISK(b);
+        bool kc = op.c == OpArgK && ISK(c);
+        char key[32];
+        char value[32];
+        if (kb && kc) {
+            format_constant(key, sizeof(key), p, INDEXK(b));
+            format_constant(value, sizeof(value), p, INDEXK(c));
+            snprintf(buf, size, "%s %s", key, value);
+        }
+        else if (kb) {
+            format_constant(buf, size, p, INDEXK(b));
+        }
+        else if (kc) {
+            format_constant(buf, size, p, INDEXK(c));
+        }
+        break;
+    }
+    case iABx:
+        if (op.b == OpArgK) {
+            format_constant(buf, size, p, GETARG_Bx(i));
+        }
+        break;
+    case iAsBx:
+        format_jump(buf, size, pc + 1 + GETARG_sBx(i));
+        break;
+    default:
+        break;
+    }
+}
+
+static void format_operands(Instruction i, lua_instruction* inst) {
+    const opinfo& op = opcodes[GET_OPCODE(i)];
+    char* buf        = inst->operands;
+    size_t size      = sizeof(inst->operands);
+    switch (op.mode) {
+    case iABC:
+        snprintf(buf, size, "%d %d %d", GETARG_A(i), rk(op.b, GETARG_B(i)), rk(op.c, GETARG_C(i)));
+        break;
+    case iABx:
+        snprintf(buf, size, "%d %d", GETARG_A(i), GETARG_Bx(i));
+        break;
+    case iAsBx:
+        snprintf(buf, size, "%d %d", GETARG_A(i), GETARG_sBx(i));
+        break;
+#    if LUA_VERSION_NUM >= 502
+    case iAx:
+        snprintf(buf, size, "%d", GETARG_Ax(i));
+        break;
+#    endif
+    }
+}
+#endif
+
+int lua_proto_sizecode(Proto* p) {
+    return p->sizecode;
+}
+
+bool lua_proto_instruction(Proto* p, int pc, lua_instruction* inst) {
+    if (pc < 0 || pc >= p->sizecode) {
+        return false;
+    }
+    Instruction i      = p->code[pc];
+    OpCode op          = GET_OPCODE(i);
+    inst->address      = &p->code[pc];
+    inst->line         = proto_line(p, pc);
+    inst->operands[0]  = '\0';
+    inst->comment[0]   = '\0';
+    if ((int)op >= NUM_OPCODES) {
+        inst->opname = "?";
+        return true;
+    }
+    inst->opname = opcodes[op].name;
+    format_operands(i, inst);
+    format_comment(p, pc, i, inst);
+    return true;
+}
+
+int lua_ci2pc(lua_State* L, CallInfo* ci) {
+    Proto* p = lua_ci2proto(ci);
+    if (!p) {
+        return -1;
+    }
+#if LUA_VERSION_NUM >= 502
+    return pcRel(ci->u.l.savedpc, p);
+#else
+    return pcRel(ci == L->ci ? L->savedpc : ci->savedpc, p);
+#endif
+}
+
+// Names of the called functions, found like getobjname of ldebug.c. The
+// opmodes of the host are internal too, so the instructions that don't set
+// register A are listed here.
+
+static bool sets_a(OpCode op) {
+    switch (op) {
+#if LUA_VERSION_NUM >= 504
+    case OP_SETUPVAL:
+    case OP_SETTABUP:
+    case OP_SETTABLE:
+    case OP_SETI:
+    case OP_SETFIELD:
+    case OP_MMBIN:
+    case OP_MMBINI:
+    case OP_MMBINK:
+    case OP_CLOSE:
+    case OP_TBC:
+    case OP_JMP:
+    case OP_EQ:
+    case OP_LT:
+    case OP_LE:
+    case OP_EQK:
+    case OP_EQI:
+    case OP_LTI:
+    case OP_LEI:
+    case OP_GTI:
+    case OP_GEI:
+    case OP_TEST:
+    case OP_RETURN:
+    case OP_RETURN0:
+    case OP_RETURN1:
+    case OP_TFORPREP:
+    case OP_TFORCALL:
+    case OP_SETLIST:
+    case OP_EXTRAARG:
+        return false;
+#else
+#    if LUA_VERSION_NUM >= 502
+    case OP_SETTABUP:
+    case OP_TFORCALL:
+    case OP_EXTRAARG:
+    case OP_TEST:
+#    else
+    case OP_SETGLOBAL:
+    case OP_TFORLOOP:
+    case OP_CLOSE:
+#    endif
+    case OP_SETUPVAL:
+    case OP_SETTABLE:
+    case OP_JMP:
+    case OP_EQ:
+    case OP_LT:
+    case OP_LE:
+    case OP_RETURN:
+    case OP_SETLIST:
+        return false;
+#endif
+    default:
+        return true;
+    }
+}
+
+static int findsetreg(Proto* p, int lastpc, int reg) {
+    int setreg    = -1;
+    int jmptarget = 0;
+    for (int pc = 0; pc < lastpc; pc++) {
+        Instruction i = p->code[pc];
+        OpCode op     = GET_OPCODE(i);
+        int a         = GETARG_A(i);
+        bool change;
+        switch (op) {
+        case OP_LOADNIL:
+#if LUA_VERSION_NUM >= 502
+            change = a <= reg && reg <= a + GETARG_B(i);
+#else
+            change = a <= reg && reg <= GETARG_B(i);
+#endif
+            break;
+#if LUA_VERSION_NUM >= 502
+        case OP_TFORCALL:
+#else
+        case OP_TFORLOOP:
+#endif
+            change = reg >= a + 2;
+            break;
+        case OP_CALL:
+        case OP_TAILCALL:
+            change = reg >= a;
+            break;
+        case OP_JMP: {
+#if LUA_VERSION_NUM >= 504
+            int dest = pc + 1 + GETARG_sJ(i);
+#else
+            int dest = pc + 1 + GETARG_sBx(i);
+#endif
+            if (dest <= lastpc && dest > jmptarget) {
+                jmptarget = dest;
+            }
+            change = false;
+            break;
+        }
+        default:
+            change = sets_a(op) && reg == a;
+            break;
+        }
+        if (change) {
+            // A set inside a jump can be skipped, so it tells nothing.
+            setreg = pc < jmptarget ? -1 : pc;
+        }
+    }
+    return setreg;
+}
+
+static const char* kstring(Proto* p, int idx) {
+    if (idx < 0 || idx >= p->sizek || !ttisstring(&p->k[idx])) {
+        return nullptr;
+    }
+    return svalue(&p->k[idx]);
+}
+
+static const char* upvalname(Proto* p, int idx) {
+    if (idx < 0 || idx >= p->sizeupvalues) {
+        return nullptr;
+    }
+#if LUA_VERSION_NUM >= 502
+    TString* s = p->upvalues[idx].name;
+#else
+    TString* s = p->upvalues[idx];
+#endif
+    return s ? getstr(s) : nullptr;
+}
+
+static const char* localname(Proto* p, int reg, int pc) {
+    int n = reg + 1;
+    for (int i = 0; i < p->sizelocvars && p->locvars[i].startpc <= pc; i++) {
+        if (pc < p->locvars[i].endpc) {
+            if (--n == 0) {
+                return getstr(p->locvars[i].varname);
+            }
+        }
+    }
+    return nullptr;
+}
+
+static bool regname(Proto* p, int pc, int reg, char* buf, size_t size, int depth);
+
+// `t.key`, or only `key` if t has no name.
+static bool fieldname(Proto* p, int pc, int t, const char* key, const char* sep, char* buf, size_t size, int depth) {
+    if (!key) {
+        return false;
+    }
+    char table[64];
+    if (depth > 0 && regname(p, pc, t, table, sizeof(table), depth - 1)) {
+        snprintf(buf, size, "%s%s%s", table, sep, key);
+    }
+    else {
+        snprintf(buf, size, "%s", key);
+    }
+    return true;
+}
+
+static bool upfieldname(Proto* p, int up, const char* key, char* buf, size_t size) {
+    if (!key) {
+        return false;
+    }
+    const char* table = upvalname(p, up);
+    if (!table || strcmp(table, "_ENV") == 0) {
+        snprintf(buf, size, "%s", key);
+    }
+    else {
+        snprintf(buf, size, "%s.%s", table, key);
+    }
+    return true;
+}
+
+static bool regname(Proto* p, int pc, int reg, char* buf, size_t size, int depth) {
+    if (const char* name = localname(p, reg, pc)) {
+        snprintf(buf, size, "%s", name);
+        return true;
+    }
+    int setreg = findsetreg(p, pc, reg);
+    if (setreg < 0) {
+        return false;
+    }
+    Instruction i = p->code[setreg];
+    int b         = GETARG_B(i);
+    switch (GET_OPCODE(i)) {
+    case OP_MOVE:
+        return b < GETARG_A(i) && regname(p, setreg, b, buf, size, depth);
+    case OP_GETUPVAL:
+        if (const char* name = upvalname(p, b)) {
+            snprintf(buf, size, "%s", name);
+            return true;
+        }
+        return false;
+#if LUA_VERSION_NUM >= 504
+    case OP_GETTABUP:
+        return upfieldname(p, b, kstring(p, GETARG_C(i)), buf, size);
+    case OP_GETFIELD:
+        return fieldname(p, setreg, b, kstring(p, GETARG_C(i)), ".", buf, size, depth);
+    case OP_SELF:
+        return GETARG_k(i) && fieldname(p, setreg, b, kstring(p, GETARG_C(i)), ":", buf, size, depth);
+#else
+#    if LUA_VERSION_NUM >= 502
+    case OP_GETTABUP: {
+        int c = GETARG_C(i);
+        return ISK(c) && upfieldname(p, b, kstring(p, INDEXK(c)), buf, size);
+    }
+#    else
+    case OP_GETGLOBAL:
+        if (const char* name = kstring(p, GETARG_Bx(i))) {
+            snprintf(buf, size, "%s", name);
+            return true;
+        }
+        return false;
+#    endif
+    case OP_GETTABLE: {
+        int c = GETARG_C(i);
+        return ISK(c) && fieldname(p, setreg, b, kstring(p, INDEXK(c)), ".", buf, size, depth);
+    }
+    case OP_SELF: {
+        int c = GETARG_C(i);
+        return ISK(c) && fieldname(p, setreg, b, kstring(p, INDEXK(c)), ":", buf, size, depth);
+    }
+#endif
+    default:
+        return false;
+    }
+}
+
+int lua_proto_calltargets(Proto* p, int pc, lua_calltarget* targets, int max) {
+    if (pc < 0 || pc >= p->sizecode) {
+        return 0;
+    }
+    int line = proto_line(p, pc);
+    int n    = 0;
+    for (int i = pc; i < p->sizecode && n < max && proto_line(p, i) == line; ++i) {
+        OpCode op = GET_OPCODE(p->code[i]);
+        if (op != OP_CALL && op != OP_TAILCALL) {
+            continue;
+        }
+        lua_calltarget& t = targets[n++];
+        t.pc              = i;
+        if (!regname(p, i, GETARG_A(p->code[i]), t.name, sizeof(t.name), 2)) {
+            snprintf(t.name, sizeof(t.name), "?");
+        }
+    }
+    return n;
+}
@@ -5,3 +5,30 @@
 lua_State* lua_getmainthread(lua_State* L) {
     return L->l_G->mainthread;
 }
+
+int lua_thread_count(lua_State* L) {
+    global_State* g = L->l_G;
+    int n           = 0;
+#if LUA_VERSION_NUM >= 504
+    for (GCObject* o = g->allgc; o; o = o->next) {
+        if (o->tt == LUA_VTHREAD) n++;
+    }
+    return n + 1;
+#elif LUA_VERSION_NUM >= 503
+    for (GCObject* o = g->allgc; o; o = o->next) {
+        if (o->tt == LUA_TTHREAD) n++;
+    }
+    return n + 1;
+#elif LUA_VERSION_NUM >= 502
+    for (GCObject* o = g->allgc; o; o = o->gch.next) {
+        if (o->gch.tt == LUA_TTHREAD) n++;
+    }
+    return n + 1;
+#else
+    // The main thread is the first object of rootgc.
+    for (GCObject* o = g->rootgc; o; o = o->gch.next) {
+        if (o->gch.tt == LUA_TTHREAD) n++;
+    }
+    return n;
+#endif
+}
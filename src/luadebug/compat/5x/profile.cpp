@@ -0,0 +1,13 @@
+#include "compat/internal.h"
+
+bool lua_profile_start(lua_State* L, const char* mode, lua_profile_callback cb, void* data) {
+    return false;
+}
+
+void lua_profile_stop(lua_State* L) {
+}
+
+const char* lua_profile_dumpstack(lua_State* L, const char* fmt, int depth, size_t* len) {
+    *len = 0;
+    return "";
+}
@@ -0,0 +1,120 @@
+#include <lstate.h>
+
+#include <cstring>
+
+#include "compat/internal.h"
+
+#if LUA_VERSION_NUM >= 504
+#    define LUA_STKID(s) s.p
+#else
+#    define LUA_STKID(s) s
+#    define s2v(o) (o)
+#endif
+
+static bool instack(lua_State* L, StkId o) {
+    return o >= LUA_STKID(L->stack) && o < LUA_STKID(L->stack_last);
+}
+
+static void copysource(lua_sample_frame& frame, TString* source) {
+    if (!source) {
+        strcpy(frame.source, "=?");
+        return;
+    }
+    const char* s = getstr(source);
+    size_t i      = 0;
+    for (; i < sizeof(frame.source) - 1 && s[i]; ++i) {
+        frame.source[i] = s[i];
+    }
+    frame.source[i] = '\0';
+}
+
+// A thread running a C function whose first argument, or first upvalue, is a
+// running coroutine is resuming it: coroutine.resume and coroutine.wrap.
+static lua_State* resumed(lua_State* L, CallInfo* ci) {
+    StkId func = LUA_STKID(ci->func);
+    const TValue* co = nullptr;
+    if (func + 1 < LUA_STKID(L->top) && ttisthread(s2v(func + 1))) {
+        co = s2v(func + 1);
+    }
+#if LUA_VERSION_NUM >= 502
+    else if (ttisCclosure(s2v(func)) && clCvalue(s2v(func))->nupvalues > 0 && ttisthread(&clCvalue(s2v(func))->upvalue[0])) {
+        co = &clCvalue(s2v(func))->upvalue[0];
+    }
+#else
+    else if (ttisfunction(func) && clvalue(func)->c.isC && clvalue(func)->c.nupvalues > 0 && ttisthread(&clvalue(func)->c.upvalue[0])) {
+        co = &clvalue(func)->c.upvalue[0];
+    }
+#endif
+    if (!co) {
+        return nullptr;
+    }
+    lua_State* co_L = thvalue(co);
+#if LUA_VERSION_NUM >= 502
+    if (co_L == L || co_L->status != LUA_OK || co_L->ci == &co_L->base_ci) {
+        return nullptr;
+    }
+#else
+    if (co_L == L || co_L->status != 0 || co_L->ci == co_L->base_ci) {
+        return nullptr;
+    }
+#endif
+    return co_L;
+}
+
+static int samplethread(lua_State* L, lua_sample_frame* frames, int max, int depth) {
+    int n         = 0;
+    CallInfo* top = L->ci;
+#if LUA_VERSION_NUM >= 502
+    for (CallInfo* ci = &L->base_ci; ci && n < max; ci = ci->next) {
+#else
+    for (CallInfo* ci = L->base_ci; ci <= top && n < max; ++ci) {
+#endif
+        StkId func = LUA_STKID(ci->func);
+        if (instack(L, func)) {
+            const TValue* f = s2v(func);
+#if LUA_VERSION_NUM >= 502
+            if (ttisLclosure(f)) {
+                Proto* p                = clLvalue(f)->p;
+                frames[n].cfunction   = nullptr;
+                frames[n].linedefined = p->linedefined;
+                copysource(frames[n], p->source);
+                n++;
+            }
+            else if (ttislcf(f) || ttisCclosure(f)) {
+                frames[n].cfunction   = (const void*)(ttislcf(f) ? fvalue(f) : clCvalue(f)->f);
+                frames[n].linedefined = -1;
+                frames[n].source[0]   = '\0';
+                n++;
+            }
+#else
+            if (ttisfunction(f)) {
+                Closure* cl = clvalue(f);
+                if (cl->c.isC) {
+                    frames[n].cfunction   = (const void*)cl->c.f;
+                    frames[n].linedefined = -1;
+                    frames[n].source[0]   = '\0';
+                }
+                else {
+                    frames[n].cfunction   = nullptr;
+                    frames[n].linedefined = cl->l.p->linedefined;
+                    copysource(frames[n], cl->l.p->source);
+                }
+                n++;
+            }
+#endif
+        }
+        if (ci == top) {
+            if (n < max && depth < 8 && instack(L, func)) {
+                if (lua_State* co = resumed(L, ci)) {
+                    n += samplethread(co, frames + n, max - n, depth + 1);
+                }
+            }
+            break;
+        }
+    }
+    return n;
+}
+
+int lua_sample_stack(lua_State* L, lua_sample_frame* frames, int max) {
+    return samplethread(lua_getmainthread(L), frames, max, 0);
+}
@@ -0,0 +1,74 @@
+#include <lstate.h>
+#include <lstring.h>
+
+#include "compat/internal.h"
+
+#if LUA_VERSION_NUM >= 504
+#    define LUA_LNGSTR LUA_VLNGSTR
+#elif LUA_VERSION_NUM >= 502
+#    define LUA_LNGSTR LUA_TLNGSTR
+#endif
+
+#if LUA_VERSION_NUM >= 503
+static bool visit(TString* ts, lua_string_visitor f, void* ud, bool islong) {
+    return f(ud, getstr(ts), tsslen(ts), islong);
+}
+#else
+static bool visit(GCObject* o, lua_string_visitor f, void* ud, bool islong) {
+    TString* ts = rawgco2ts(o);
+    return f(ud, getstr(ts), ts->tsv.len, islong);
+}
+#endif
+
+#if LUA_VERSION_NUM >= 502
+static bool visit_list(GCObject* o, lua_string_visitor f, void* ud) {
+#    if LUA_VERSION_NUM >= 503
+    for (; o; o = o->next) {
+        if (o->tt == LUA_LNGSTR && !visit(gco2ts(o), f, ud, true)) {
+            return false;
+        }
+    }
+#    else
+    for (; o; o = o->gch.next) {
+        if (o->gch.tt == LUA_LNGSTR && !visit(o, f, ud, true)) {
+            return false;
+        }
+    }
+#    endif
+    return true;
+}
+#endif
+
+bool lua_foreach_string(lua_State* L, lua_string_visitor f, void* ud) {
+    global_State* g = G(L);
+    for (int i = 0; i < g->strt.size; ++i) {
+#if LUA_VERSION_NUM >= 503
+        for (TString* ts = g->strt.hash[i]; ts; ts = ts->u.hnext) {
+            if (!visit(ts, f, ud, false)) {
+                return false;
+            }
+        }
+#else
+        for (GCObject* o = g->strt.hash[i]; o; o = o->gch.next) {
+            if (!visit(o, f, ud, false)) {
+                return false;
+            }
+        }
+#endif
+    }
+#if LUA_VERSION_NUM >= 503
+    return visit_list(g->allgc, f, ud) && visit_list(g->finobj, f, ud) && visit_list(g->fixedgc, f, ud);
+#elif LUA_VERSION_NUM >= 502
+    return visit_list(g->allgc, f, ud) && visit_list(g->finobj, f, ud);
+#else
+    return true;
+#endif
+}
+
+bool lua_gcisrunning(lua_State* L) {
+#if LUA_VERSION_NUM >= 502
+    return lua_gc(L, LUA_GCISRUNNING, 0) != 0;
+#else
+    return G(L)->GCthreshold != MAX_LUMEM;
+#endif
+}
@@ -30,3 +30,54 @@ int lua_isluafunc(lua_State* L, lua_Debug* ar);
 
 int lua_stacklevel(lua_State* L);
 lua_State* lua_getmainthread(lua_State* L);
+// Walks every object of the VM, the main thread included.
+int lua_thread_count(lua_State* L);
+
+// VM profiler, only LuaJIT has one. lua_profile_start returns false if the
+// runtime doesn't support it.
+using lua_profile_callback = void (*)(void* data, lua_State* L, int samples, int vmstate);
+bool lua_profile_start(lua_State* L, const char* mode, lua_profile_callback cb, void* data);
+void lua_profile_stop(lua_State* L);
+const char* lua_profile_dumpstack(lua_State* L, const char* fmt, int depth, size_t* len);
+
+// Lua frames as seen by a sampler that interrupted the thread. Nothing is
+// allocated and no lock is taken, so it can run in a signal handler or while
+// the thread is suspended. Frames are ordered from the outermost one.
+struct lua_sample_frame {
+    const void* cfunction;  // nullptr for a Lua function
+    int linedefined;
+    char source[64];
+};
+int lua_sample_stack(lua_State* L, lua_sample_frame* frames, int max);
+
+// Visits every string of the VM, including dead ones not yet swept. Short
+// strings are interned, so only long strings can have duplicates. Returns
+// false if the visitor stopped the walk, or if the runtime doesn't support it.
+using lua_string_visitor = bool (*)(void* ud, const char* s, size_t len, bool islong);
+bool lua_foreach_string(lua_State* L, lua_string_visitor f, void* ud);
+// Whether the collector runs, so that it can be stopped for a while and
+// left as it was.
+bool lua_gcisrunning(lua_State* L);
+
+// Bytecode of a live function. Operands and comment are formatted like the
+// listing of luac -l; the comment holds constants and jump targets.
+struct lua_instruction {
+    const void* address;
+    int line;
+    const char* opname;
+    char operands[48];
+    char comment[64];
+};
+int lua_proto_sizecode(Proto* p);
+bool lua_proto_instruction(Proto* p, int pc, lua_instruction* inst);
+// Index of the instruction running in a Lua frame, or -1 if it can't be
+// known (a C frame, or LuaJIT).
+int lua_ci2pc(lua_State* L, CallInfo* ci);
+
+// Calls of the line at pc, from pc on, in the order they run. The names are
+// guessed from the bytecode like lua_getinfo does for "n", "?" if unknown.
+struct lua_calltarget {
+    int pc;
+    char name[64];
+};
+int lua_proto_calltargets(Proto* p, int pc, lua_calltarget* targets, int max);
@@ -0,0 +1,144 @@
+#include <lj_bc.h>
+#include <lj_obj.h>
+
+#include <cstdio>
+#include <cstring>
+
+#include "compat/internal.h"
+
+// lj_bc_mode and lj_debug_line are internal to LuaJIT, so the opcode table
+// and the line lookup are repeated here.
+
+struct opinfo {
+    const char* name;
+    int a;
+    int b;
+    int c;
+};
+
+#define BCINFO(name, ma, mb, mc, mt) { #name, BCM##ma, BCM##mb, BCM##mc },
+static const opinfo opcodes[] = {
+    BCDEF(BCINFO)
+};
+#undef BCINFO
+
+static int proto_line(GCproto* pt, BCPos pc) {
+    const void* lineinfo = proto_lineinfo(pt);
+    if (pc > pt->sizebc || !lineinfo) {
+        return -1;
+    }
+    BCLine first = pt->firstline;
+    if (pc == pt->sizebc)
+        return first + pt->numline;
+    if (pc-- == 0)
+        return first;
+    if (pt->numline < 256)
+        return first + (BCLine)((const uint8_t*)lineinfo)[pc];
+    if (pt->numline < 65536)
+        return first + (BCLine)((const uint16_t*)lineinfo)[pc];
+    return first + (BCLine)((const uint32_t*)lineinfo)[pc];
+}
+
+static void format_string(char* buf, size_t size, const char* s, size_t len) {
+    size_t n   = 0;
+    buf[n++]   = '"';
+    size_t max = size - 5;
+    for (size_t i = 0; i < len; ++i) {
+        if (n >= max) {
+            strcpy(buf + n, "...");
+            return;
+        }
+        unsigned char c = (unsigned char)s[i];
+        buf[n++]        = (c < 0x20 || c == 0x7f) ? '?' : (char)c;
+    }
+    buf[n++] = '"';
+    buf[n]   = '\0';
+}
+
+static void format_comment(GCproto* pt, BCPos pc, BCIns ins, const opinfo& op, lua_instruction* inst) {
+    char* buf   = inst->comment;
+    size_t size = sizeof(inst->comment);
+    BCReg d     = bc_d(ins);
+    switch (op.b == BCMnone ? op.c : BCMnone) {
+    case BCMstr:
+        if (d < pt->sizekgc) {
+            GCstr* s = gco2str(proto_kgc(pt, ~(ptrdiff_t)d));
+            format_string(buf, size, strdata(s), s->len);
+        }
+        break;
+    case BCMnum:
+        if (d < pt->sizekn) {
+            cTValue* o = proto_knumtv(pt, d);
+            if (tvisint(o))
+                snprintf(buf, size, "%d", (int)intV(o));
+            else
+                snprintf(buf, size, LUA_NUMBER_FMT, numV(o));
+        }
+        break;
+    case BCMpri:
+        snprintf(buf, size, "%s", d == 0 ? "nil" : d == 1 ? "false" : "true");
+        break;
+    case BCMjump:
+        snprintf(buf, size, "to %d", (int)(pc + 1 + bc_j(ins)));
+        break;
+    default:
+        break;
+    }
+}
+
+static void format_operands(BCIns ins, const opinfo& op, lua_instruction* inst) {
+    char* buf   = inst->operands;
+    size_t size = sizeof(inst->operands);
+    if (op.b != BCMnone) {
+        snprintf(buf, size, "%d %d %d", (int)bc_a(ins), (int)bc_b(ins), (int)bc_c(ins));
+        return;
+    }
+    int d = (int)bc_d(ins);
+    if (op.c == BCMjump)
+        d = (int)bc_j(ins);
+    else if (op.c == BCMlits)
+        d = (int)(int16_t)d;
+    if (op.c == BCMnone)
+        snprintf(buf, size, "%d", (int)bc_a(ins));
+    else if (op.a == BCMnone)
+        snprintf(buf, size, "%d", d);
+    else
+        snprintf(buf, size, "%d %d", (int)bc_a(ins), d);
+}
+
+int lua_proto_sizecode(Proto* p) {
+    return (int)p->sizebc;
+}
+
+bool lua_proto_instruction(Proto* p, int pc, lua_instruction* inst) {
+    if (pc < 0 || pc >= (int)p->sizebc) {
+        return false;
+    }
+    const BCIns* code = proto_bc(p);
+    BCIns ins         = code[pc];
+    BCOp op           = bc_op(ins);
+    inst->address     = &code[pc];
+    inst->line        = proto_line(p, (BCPos)pc);
+    inst->operands[0] = '\0';
+    inst->comment[0]  = '\0';
+    if (op >= BC__MAX) {
+        inst->opname = "?";
+        return true;
+    }
+    inst->opname = opcodes[op].name;
+    format_operands(ins, opcodes[op], inst);
+    format_comment(p, (BCPos)pc, ins, opcodes[op], inst);
+    return true;
+}
+
+// lj_debug_framepc needs the frame above the one asked for, which a
+// CallInfo doesn't carry.
+int lua_ci2pc(lua_State* L, CallInfo* ci) {
+    return -1;
+}
+
+// The running pc of a frame isn't known (see lua_ci2pc), so neither are the
+// calls still to come on its line.
+int lua_proto_calltargets(Proto* p, int pc, lua_calltarget* targets, int max) {
+    return 0;
+}
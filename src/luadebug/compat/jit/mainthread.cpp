@@ -5,3 +5,11 @@
 lua_State* lua_getmainthread(lua_State* L) {
     return mainthread(G(L));
 }
+
+int lua_thread_count(lua_State* L) {
+    int n = 0;
+    for (GCobj* o = gcref(G(L)->gc.root); o; o = gcref(o->gch.nextgc)) {
+        if (o->gch.gct == ~LJ_TTHREAD) n++;
+    }
+    return n;
+}
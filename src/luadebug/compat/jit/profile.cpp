@@ -0,0 +1,35 @@
+#include <lj_arch.h>
+#include <luajit.h>
+
+#include "compat/internal.h"
+
+#if LJ_HASPROFILE
+
+bool lua_profile_start(lua_State* L, const char* mode, lua_profile_callback cb, void* data) {
+    luaJIT_profile_start(L, mode, (luaJIT_profile_callback)cb, data);
+    return true;
+}
+
+void lua_profile_stop(lua_State* L) {
+    luaJIT_profile_stop(L);
+}
+
+const char* lua_profile_dumpstack(lua_State* L, const char* fmt, int depth, size_t* len) {
+    return luaJIT_profile_dumpstack(L, fmt, depth, len);
+}
+
+#else
+
+bool lua_profile_start(lua_State* L, const char* mode, lua_profile_callback cb, void* data) {
+    return false;
+}
+
+void lua_profile_stop(lua_State* L) {
+}
+
+const char* lua_profile_dumpstack(lua_State* L, const char* fmt, int depth, size_t* len) {
+    *len = 0;
+    return "";
+}
+
+#endif
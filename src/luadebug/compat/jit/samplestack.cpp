@@ -0,0 +1,7 @@
+#include "compat/internal.h"
+
+// LuaJIT frames are only consistent at the VM's own safe points, use the VM
+// profiler instead (lua_profile_start).
+int lua_sample_stack(lua_State* L, lua_sample_frame* frames, int max) {
+    return 0;
+}
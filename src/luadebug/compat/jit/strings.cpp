@@ -0,0 +1,13 @@
+#include <lj_obj.h>
+
+#include "compat/internal.h"
+
+// LuaJIT interns every string, and its string table layout differs between
+// versions.
+bool lua_foreach_string(lua_State* L, lua_string_visitor f, void* ud) {
+    return false;
+}
+
+bool lua_gcisrunning(lua_State* L) {
+    return G(L)->gc.threshold != LJ_MAX_MEM;
+}
@@ -32,6 +32,10 @@
 #endif
 
 extern "C" int luaopen_luadebug_hookmgr(luadbg_State* L);
+extern "C" int luaopen_luadebug_sourcepool(luadbg_State* L);
+extern "C" int luaopen_luadebug_profiler(luadbg_State* L);
+extern "C" int luaopen_luadebug_sampler(luadbg_State* L);
+extern "C" int luaopen_luadebug_strings(luadbg_State* L);
 extern "C" int luaopen_luadebug_stdio(luadbg_State* L);
 extern "C" int luaopen_luadebug_utility(luadbg_State* L);
 extern "C" int luaopen_luadebug_visitor(luadbg_State* L);
@@ -44,6 +48,10 @@ extern "C" int luaopen_bee_unicode(luadbg_State* L);
 
 static luadbgL_Reg cmodule[] = {
     { "luadebug.hookmgr", luaopen_luadebug_hookmgr },
+    { "luadebug.sourcepool", luaopen_luadebug_sourcepool },
+    { "luadebug.profiler", luaopen_luadebug_profiler },
+    { "luadebug.sampler", luaopen_luadebug_sampler },
+    { "luadebug.strings", luaopen_luadebug_strings },
     { "luadebug.stdio", luaopen_luadebug_stdio },
     { "luadebug.utility", luaopen_luadebug_utility },
     { "luadebug.visitor", luaopen_luadebug_visitor },
@@ -1,8 +1,10 @@
 ﻿#include "rdebug_debughost.h"
 
 #include <cstdlib>
+#include <new>
 
 #include "luadbg/bee_module.h"
+#include "rdebug_fork.h"
 #include "rdebug_lua.h"
 
 #if defined(_WIN32)
@@ -12,59 +14,109 @@
 #    endif
 #endif
 
-static int DEBUG_HOST   = 0;
-static int DEBUG_CLIENT = 0;
-
-bool event(luadbg_State* L, lua_State* hL, const char* name, int start);
+static int DEBUG_CONTEXT = 0;
+static int FORK_CALLBACK = 0;
 
 namespace luadebug::debughost {
-    luadbg_State* get_client(lua_State* hL) {
-        if (lua::rawgetp(hL, LUA_REGISTRYINDEX, &DEBUG_CLIENT) != LUA_TLIGHTUSERDATA) {
+    context* find_context(lua_State* hL) {
+        if (lua::rawgetp(hL, LUA_REGISTRYINDEX, &DEBUG_CONTEXT) != LUA_TUSERDATA) {
             lua_pop(hL, 1);
-            return 0;
+            return nullptr;
         }
-        luadbg_State* L = (luadbg_State*)lua_touserdata(hL, -1);
+        context* ctx = (context*)lua_touserdata(hL, -1);
         lua_pop(hL, 1);
-        return L;
+        return ctx;
     }
 
-    void set(luadbg_State* L, lua_State* hL) {
-        luadbg_pushlightuserdata(L, hL);
-        luadbg_rawsetp(L, LUADBG_REGISTRYINDEX, &DEBUG_HOST);
+    static context* new_context(lua_State* hL) {
+        context* ctx = find_context(hL);
+        if (ctx) {
+            return ctx;
+        }
+        ctx = (context*)lua_newuserdata(hL, sizeof(context));
+        new (ctx) context;
+        lua_rawsetp(hL, LUA_REGISTRYINDEX, &DEBUG_CONTEXT);
+        return ctx;
     }
 
-    lua_State* get(luadbg_State* L) {
-        if (luadbg_rawgetp(L, LUADBG_REGISTRYINDEX, &DEBUG_HOST) != LUA_TLIGHTUSERDATA) {
+    context* get_context(luadbg_State* L) {
+        if (luadbg_rawgetp(L, LUADBG_REGISTRYINDEX, &DEBUG_CONTEXT) != LUA_TLIGHTUSERDATA) {
             luadbg_pushstring(L, "Must call in debug client");
             luadbg_error(L);
             return 0;
         }
-        lua_State* hL = (lua_State*)luadbg_touserdata(L, -1);
+        context* ctx = (context*)luadbg_touserdata(L, -1);
         luadbg_pop(L, 1);
-        return hL;
+        return ctx;
+    }
+
+    luadbg_State* get_client(context* ctx) {
+        if (ctx->generation != fork::generation()) {
+            // The client was created by the parent process. Its threads and
+            // sockets do not exist in this process, so it must not run again.
+            return 0;
+        }
+        return ctx->client;
+    }
+
+    static void reset(context* ctx) {
+        ctx->client   = nullptr;
+        ctx->current  = nullptr;
+        ctx->callback = LUA_NOREF;
     }
 
     static void clear_client(lua_State* hL) {
-        luadbg_State* L = get_client(hL);
-        lua_pushnil(hL);
-        lua_rawsetp(hL, LUA_REGISTRYINDEX, &DEBUG_CLIENT);
+        context* ctx = find_context(hL);
+        if (!ctx) {
+            return;
+        }
+        luadbg_State* L = get_client(ctx);
+        reset(ctx);
         if (L) {
             luadbg_close(L);
         }
     }
 
+    // Called from a hook, where the debugger can't be restarted: it runs
+    // the whole client script. The restart waits for the host instead.
+    void forked(lua_State* hL) {
+        context* ctx = find_context(hL);
+        if (!ctx) {
+            return;
+        }
+        // Drop the inherited client without closing it.
+        reset(ctx);
+        ctx->restart = fork::attach();
+    }
+
+    static void restart(lua_State* hL, context* ctx) {
+        if (!ctx->restart) {
+            return;
+        }
+        ctx->restart = false;
+        if (lua::rawgetp(hL, LUA_REGISTRYINDEX, &FORK_CALLBACK) != LUA_TFUNCTION) {
+            lua_pop(hL, 1);
+            return;
+        }
+        lua_pushinteger(hL, fork::pid());
+        if (lua_pcall(hL, 1, 0, 0) != LUA_OK) {
+            lua_pop(hL, 1);
+        }
+    }
+
     static int clear(lua_State* hL) {
-        luadbg_State* L = get_client(hL);
-        if (L) {
-            event(L, hL, "exit", 1);
+        context* ctx = find_context(hL);
+        if (ctx && get_client(ctx)) {
+            event(ctx, hL, "exit", 1);
         }
         clear_client(hL);
         return 0;
     }
 
     static int client_main(luadbg_State* L) {
-        lua_State* hL = (lua_State*)luadbg_touserdata(L, 2);
-        set(L, hL);
+        context* ctx = (context*)luadbg_touserdata(L, 2);
+        luadbg_pushlightuserdata(L, ctx);
+        luadbg_rawsetp(L, LUADBG_REGISTRYINDEX, &DEBUG_CONTEXT);
         luadbg_pushboolean(L, 1);
         luadbg_setfield(L, LUADBG_REGISTRYINDEX, "LUA_NOENV");
         luadbgL_openlibs(L);
@@ -117,12 +169,16 @@ namespace luadebug::debughost {
             return lua_error(hL);
         }
 
-        lua_pushlightuserdata(hL, L);
-        lua_rawsetp(hL, LUA_REGISTRYINDEX, &DEBUG_CLIENT);
+        fork::init();
+        context* ctx    = new_context(hL);
+        ctx->client     = L;
+        ctx->current    = hL;
+        ctx->callback   = LUA_NOREF;
+        ctx->generation = fork::generation();
 
         luadbg_pushcfunction(L, client_main);
         luadbg_pushlightuserdata(L, (void*)mainscript);
-        luadbg_pushlightuserdata(L, (void*)hL);
+        luadbg_pushlightuserdata(L, (void*)ctx);
         if (preprocessor) {
             // TODO: convert C function？
             luadbg_pushcfunction(L, (luadbg_CFunction)preprocessor);
@@ -140,11 +196,14 @@ namespace luadebug::debughost {
     }
 
     static int event(lua_State* hL) {
-        luadbg_State* L = get_client(hL);
-        if (!L) {
+        context* ctx = find_context(hL);
+        if (ctx) {
+            restart(hL, ctx);
+        }
+        if (!ctx || !get_client(ctx)) {
             return 0;
         }
-        bool ok = event(L, hL, luaL_checkstring(hL, 1), 2);
+        bool ok = event(ctx, hL, luaL_checkstring(hL, 1), 2);
         if (!ok) {
             return 0;
         }
@@ -152,6 +211,30 @@ namespace luadebug::debughost {
         return 1;
     }
 
+    static int poll(lua_State* hL) {
+        context* ctx = find_context(hL);
+        if (ctx) {
+            restart(hL, ctx);
+        }
+        if (!ctx || !get_client(ctx)) {
+            return 0;
+        }
+        ctx->heartbeat.fetch_add(1, std::memory_order_relaxed);
+        luaL_optinteger(hL, 1, 0);
+        lua_settop(hL, 1);
+        event(ctx, hL, "poll", 1);
+        return 0;
+    }
+
+    static int heartbeat(lua_State* hL) {
+        context* ctx = find_context(hL);
+        if (ctx) {
+            restart(hL, ctx);
+            ctx->heartbeat.fetch_add(1, std::memory_order_relaxed);
+        }
+        return 0;
+    }
+
 #if defined(_WIN32) && !defined(LUADBG_DISABLE)
     static bee::zstring_view to_strview(lua_State* hL, int idx) {
         size_t len      = 0;
@@ -166,6 +249,13 @@ namespace luadebug::debughost {
     }
 #endif
 
+    static int onfork(lua_State* hL) {
+        luaL_checktype(hL, 1, LUA_TFUNCTION);
+        lua_settop(hL, 1);
+        lua_rawsetp(hL, LUA_REGISTRYINDEX, &FORK_CALLBACK);
+        return 0;
+    }
+
     static int setenv(lua_State* hL) {
         const char* name  = luaL_checkstring(hL, 1);
         const char* value = luaL_checkstring(hL, 2);
@@ -182,7 +272,10 @@ namespace luadebug::debughost {
             { "start", start },
             { "clear", clear },
             { "event", event },
+            { "poll", poll },
+            { "heartbeat", heartbeat },
             { "setenv", setenv },
+            { "onfork", onfork },
 #if defined(_WIN32) && !defined(LUADBG_DISABLE)
             { "a2u", a2u },
 #endif
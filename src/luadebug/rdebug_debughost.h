@@ -1,12 +1,34 @@
 #pragma once
 
+#include <atomic>
+#include <cstdint>
+
 #include "rdebug_lua.h"
 
 struct lua_State;
 struct luadbg_State;
 
 namespace luadebug::debughost {
-    luadbg_State* get_client(lua_State* hL);
-    lua_State* get(luadbg_State* L);
-    void set(luadbg_State* L, lua_State* hL);
+    // One per debugged lua_State, shared by every restart of the debugger.
+    // The hooks, visitors and stdio redirects keep a pointer to it, so they
+    // don't have to look up the registry on each call.
+    struct context {
+        luadbg_State* client = nullptr;
+        lua_State* current   = nullptr;
+        int callback         = LUA_NOREF;
+        int generation       = 0;
+        // Set by forked in a child process that should attach, the restart
+        // runs on the next event/poll/heartbeat of the host.
+        bool restart = false;
+        // Bumped by the host from its main loop, watched by the stall
+        // detector of hookmgr.
+        std::atomic<uint64_t> heartbeat { 0 };
+    };
+
+    context* find_context(lua_State* hL);
+    context* get_context(luadbg_State* L);
+    luadbg_State* get_client(context* ctx);
+    void forked(lua_State* hL);
 }
+
+bool event(luadebug::debughost::context* ctx, lua_State* hL, const char* name, int start);
@@ -0,0 +1,100 @@
+#include "rdebug_fork.h"
+
+#if defined(_WIN32)
+#    include <Windows.h>
+#else
+#    include <fcntl.h>
+#    include <pthread.h>
+#    include <unistd.h>
+
+#    include <atomic>
+#    include <mutex>
+#endif
+
+namespace luadebug::fork {
+#if defined(_WIN32)
+    void init() {}
+    int generation() {
+        return 0;
+    }
+    int pid() {
+        return (int)GetCurrentProcessId();
+    }
+    void set_attach(bool enable) {}
+    bool attach() {
+        return false;
+    }
+    std::vector<int> children() {
+        return {};
+    }
+#else
+    // Incremented in every child, so that state created before fork() can be
+    // recognized as inherited.
+    static std::atomic<int> fork_generation = 0;
+    static std::atomic<bool> attach_children = false;
+    // The child writes its pid here, the parent's master reads it.
+    static int notify[2] = { -1, -1 };
+
+    static void close_notify() {
+        for (int& fd : notify) {
+            if (fd != -1) {
+                close(fd);
+                fd = -1;
+            }
+        }
+    }
+
+    static void open_notify() {
+        if (pipe(notify) != 0) {
+            notify[0] = notify[1] = -1;
+            return;
+        }
+        for (int fd : notify) {
+            fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+            fcntl(fd, F_SETFD, FD_CLOEXEC);
+        }
+    }
+
+    static void atfork_child() {
+        fork_generation++;
+        if (attach_children && notify[1] != -1) {
+            int id = getpid();
+            (void)!write(notify[1], &id, sizeof(id));
+        }
+        close_notify();
+    }
+
+    void init() {
+        static std::once_flag flag;
+        std::call_once(flag, []() {
+            pthread_atfork(nullptr, nullptr, atfork_child);
+        });
+        if (notify[0] == -1) {
+            open_notify();
+        }
+    }
+    int generation() {
+        return fork_generation.load(std::memory_order_relaxed);
+    }
+    int pid() {
+        return (int)getpid();
+    }
+    void set_attach(bool enable) {
+        attach_children = enable;
+    }
+    bool attach() {
+        return attach_children;
+    }
+    std::vector<int> children() {
+        std::vector<int> res;
+        if (notify[0] == -1) {
+            return res;
+        }
+        int id;
+        while (read(notify[0], &id, sizeof(id)) == sizeof(id)) {
+            res.push_back(id);
+        }
+        return res;
+    }
+#endif
+}
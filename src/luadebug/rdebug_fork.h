@@ -0,0 +1,12 @@
+#pragma once
+
+#include <vector>
+
+namespace luadebug::fork {
+    void init();
+    int generation();
+    int pid();
+    void set_attach(bool enable);
+    bool attach();
+    std::vector<int> children();
+}
@@ -1,15 +1,25 @@
 #include <bee/utility/dynarray.h>
 
+#include <algorithm>
+#include <atomic>
 #include <chrono>
 #include <cstdint>
 #include <memory>
+#include <new>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
 
 #include "compat/internal.h"
 #include "rdebug_debughost.h"
 #include "rdebug_eventfree.h"
+#include "rdebug_fork.h"
 #include "rdebug_lua.h"
+#include "symbolize/symbolize.h"
 #include "thunk/thunk.h"
 #include "util/flatmap.h"
+#include "util/histogram.h"
 
 #if LUA_VERSION_NUM >= 502
 #    include <lstate.h>
@@ -59,14 +69,13 @@ private:
     luadebug::flatmap<intptr_t, bool> m_flatmap;
 };
 
-static int HOOK_MGR      = 0;
-static int HOOK_CALLBACK = 0;
+static int HOOK_MGR = 0;
 #if defined(LUADEBUG_DISABLE_THUNK)
 static int THUNK_MGR = 0;
 #endif
 
-static void push_callback(luadbg_State* L) {
-    if (luadbg_rawgetp(L, LUADBG_REGISTRYINDEX, &HOOK_CALLBACK) != LUADBG_TFUNCTION) {
+static void push_callback(luadbg_State* L, luadebug::debughost::context* ctx) {
+    if (luadbg_rawgeti(L, LUADBG_REGISTRYINDEX, ctx->callback) != LUADBG_TFUNCTION) {
         luadbgL_error(L, "miss hook callback");
     }
 }
@@ -134,8 +143,8 @@ struct hookmgr {
         break_del(hL, p);
 
         luadbgL_checkstack(L, 4, NULL);
-        push_callback(L);
-        luadebug::debughost::set(L, hL);
+        push_callback(L, ctx);
+        ctx->current = hL;
         luadbg_pushstring(L, "newproto");
         luadbg_pushlightuserdata(L, p);
         luadbg_pushinteger(L, event != LUA_HOOKRET ? 0 : 1);
@@ -202,8 +211,8 @@ struct hookmgr {
         const void* function = lua_topointer(hL, -1);
         lua_pop(hL, 1);
 
-        push_callback(L);
-        luadebug::debughost::set(L, hL);
+        push_callback(L, ctx);
+        ctx->current = hL;
         luadbg_pushstring(L, "funcbp");
         luadbg_pushfstring(L, "function: %p", function);
         if (luadbg_pcall(L, 2, 0, 0) != LUADBG_OK) {
@@ -220,6 +229,301 @@ struct hookmgr {
         }
     }
 
+    //
+    // heat
+    //
+    struct heatlines {
+        int linedefined = -1;
+        std::vector<uint32_t> counts;
+    };
+    bpmap heat_proto;
+    std::unordered_map<Proto*, heatlines> heat_lines;
+    int heat_mask = 0;
+    // The proto the callback of heat_new decided on.
+    Proto* heat_decided = nullptr;
+
+    void heat_add(lua_State* hL, Proto* p) {
+        heat_proto.set(p, bpmap::status::Break);
+        heat_decided = p;
+    }
+    void heat_del(lua_State* hL, Proto* p) {
+        heat_proto.set(p, bpmap::status::Ignore);
+        heat_decided = p;
+    }
+    void heat_freeobj(Proto* p) {
+        heat_proto.set(p, bpmap::status::None);
+        heat_lines.erase(p);
+    }
+    void heat_open(lua_State* hL, bool enable) {
+        heat_proto = bpmap();
+        heat_lines.clear();
+        if (enable)
+            heat_update(hL, lua_getcallinfo(hL), LUA_HOOKCALL);
+        else
+            heat_hookmask(hL, 0);
+    }
+    // The proto is ignored while the callback runs. If the callback fails or
+    // returns without deciding, e.g. the worker isn't ready yet, it is asked
+    // again the next time the proto runs.
+    bool heat_new(lua_State* hL, Proto* p, int event) {
+        heat_proto.set(p, bpmap::status::Ignore);
+        heat_decided = nullptr;
+
+        luadbgL_checkstack(L, 4, NULL);
+        push_callback(L, ctx);
+        ctx->current = hL;
+        luadbg_pushstring(L, "heatproto");
+        luadbg_pushlightuserdata(L, p);
+        luadbg_pushinteger(L, event != LUA_HOOKRET ? 0 : 1);
+        if (luadbg_pcall(L, 3, 0, 0) != LUADBG_OK) {
+            luadbg_pop(L, 1);
+            heat_proto.set(p, bpmap::status::None);
+            return false;
+        }
+        if (heat_decided != p) {
+            heat_proto.set(p, bpmap::status::None);
+            return false;
+        }
+        return heat_proto.get(p) == bpmap::status::Break;
+    }
+    bool heat_has(lua_State* hL, Proto* p, int event) {
+        if (!p) {
+            return false;
+        }
+        auto status = heat_proto.get(p);
+        if (status == bpmap::status::None) {
+            return heat_new(hL, p, event);
+        }
+        return status == bpmap::status::Break;
+    }
+    void heat_update(lua_State* hL, CallInfo* ci, int event) {
+        if (heat_has(hL, lua_ci2proto(ci), event)) {
+            heat_hookmask(hL, LUA_MASKCALL | LUA_MASKRET | LUA_MASKLINE);
+        }
+        else {
+            heat_hookmask(hL, LUA_MASKCALL | LUA_MASKRET);
+        }
+    }
+    void heat_hook_call(lua_State* hL, lua_Debug* ar) {
+#if LUA_VERSION_NUM < 502
+        if (ar->i_ci == 0) {
+            return;
+        }
+#endif
+        heat_update(hL, lua_debug2ci(hL, ar), ar->event);
+    }
+    void heat_hook_return(lua_State* hL, lua_Debug* ar) {
+#if LUA_VERSION_NUM >= 502
+        heat_update(hL, ar->i_ci->previous, ar->event);
+#else
+        lua_Debug caller;
+        if (!lua_getstack(hL, 1, &caller)) {
+            return;
+        }
+        if (caller.i_ci == 0) {
+            return;
+        }
+        heat_update(hL, lua_debug2ci(hL, &caller), ar->event);
+#endif
+    }
+    // Counters are indexed from linedefined, and only allocated once the
+    // function runs a line. They are sized from lastlinedefined, except for
+    // a main chunk, which has no last line and grows as it runs.
+    void heat_hook_line(lua_State* hL, lua_Debug* ar) {
+        Proto* p = lua_ci2proto(lua_getcallinfo(hL));
+        if (!p || heat_proto.get(p) != bpmap::status::Break) {
+            return;
+        }
+        heatlines& h = heat_lines[p];
+        if (h.linedefined < 0) {
+            if (0 == lua_getinfo(hL, "S", ar)) {
+                return;
+            }
+            h.linedefined = ar->linedefined;
+            if (ar->lastlinedefined > ar->linedefined) {
+                h.counts.resize((size_t)(ar->lastlinedefined - ar->linedefined) + 1);
+            }
+        }
+        int idx = ar->currentline - h.linedefined;
+        if (idx < 0) {
+            return;
+        }
+        if ((size_t)idx >= h.counts.size()) {
+            h.counts.resize((size_t)idx + 1);
+        }
+        if (h.counts[idx] != UINT32_MAX) {
+            h.counts[idx]++;
+        }
+    }
+    void heat_hookmask(lua_State* hL, int mask) {
+        if (heat_mask != mask) {
+            heat_mask = mask;
+            updatehookmask(hL);
+        }
+    }
+    void heat_report(luadbg_State* L, bool reset) {
+        luadbg_createtable(L, (int)heat_lines.size(), 0);
+        luadbg_Integer n = 0;
+        for (auto& [p, h] : heat_lines) {
+            if (h.counts.empty()) {
+                continue;
+            }
+            luadbg_createtable(L, 0, 3);
+            luadbg_pushlightuserdata(L, p);
+            luadbg_setfield(L, -2, "proto");
+            luadbg_pushinteger(L, h.linedefined);
+            luadbg_setfield(L, -2, "linedefined");
+            luadbg_createtable(L, (int)h.counts.size(), 0);
+            for (size_t i = 0; i < h.counts.size(); ++i) {
+                luadbg_pushinteger(L, (luadbg_Integer)h.counts[i]);
+                luadbg_rawseti(L, -2, (luadbg_Integer)i + 1);
+            }
+            luadbg_setfield(L, -2, "counts");
+            luadbg_rawseti(L, -2, ++n);
+            if (reset) {
+                std::fill(h.counts.begin(), h.counts.end(), 0);
+            }
+        }
+    }
+
+    //
+    // cstats
+    //
+    struct ccall {
+        lua_State* hL;
+        CallInfo* ci;
+        const void* func;
+        std::chrono::steady_clock::time_point start;
+    };
+    int cstats_mask = 0;
+    std::unordered_map<const void*, luadebug::histogram> cstats;
+    std::vector<ccall> cstats_calls;
+
+    void cstats_open(lua_State* hL, bool enable) {
+        cstats.clear();
+        cstats_calls.clear();
+        cstats_hookmask(hL, enable ? (LUA_MASKCALL | LUA_MASKRET) : 0);
+    }
+    void cstats_hookmask(lua_State* hL, int mask) {
+        if (cstats_mask != mask) {
+            cstats_mask = mask;
+            updatehookmask(hL);
+        }
+    }
+    static const void* cstats_func(lua_State* hL, lua_Debug* ar) {
+        if (0 == lua_getinfo(hL, "f", ar)) {
+            return nullptr;
+        }
+        const void* func = lua_tocfunction_pointer(hL, -1);
+        lua_pop(hL, 1);
+        return func;
+    }
+    void cstats_record(const ccall& c) {
+        auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - c.start);
+        cstats[c.func].add((uint64_t)ns.count());
+    }
+    void cstats_call(lua_State* hL, lua_Debug* ar) {
+#if LUA_VERSION_NUM < 502
+        if (ar->i_ci == 0) {
+            return;
+        }
+#endif
+        const void* func = cstats_func(hL, ar);
+        if (!func) {
+            return;
+        }
+        CallInfo* ci = lua_debug2ci(hL, ar);
+        // Calls left by an error never return. A call that reuses their
+        // CallInfo shows that they, and the calls they made, are over.
+        for (size_t i = cstats_calls.size(); i-- > 0;) {
+            if (cstats_calls[i].hL == hL && cstats_calls[i].ci == ci) {
+                cstats_calls.erase(std::remove_if(cstats_calls.begin() + i, cstats_calls.end(), [hL](const ccall& c) { return c.hL == hL; }), cstats_calls.end());
+                break;
+            }
+        }
+        if (cstats_calls.size() >= 256) {
+            cstats_calls.erase(cstats_calls.begin());
+        }
+        cstats_calls.push_back({ hL, ci, func, std::chrono::steady_clock::now() });
+    }
+    void cstats_return(lua_State* hL, lua_Debug* ar) {
+        if (cstats_calls.empty()) {
+            return;
+        }
+#if LUA_VERSION_NUM < 502
+        if (ar->i_ci == 0) {
+            return;
+        }
+#endif
+        CallInfo* ci = lua_debug2ci(hL, ar);
+        for (size_t i = cstats_calls.size(); i-- > 0;) {
+            ccall& c = cstats_calls[i];
+            if (c.hL != hL || c.ci != ci) {
+                continue;
+            }
+            if (c.func == cstats_func(hL, ar)) {
+                cstats_record(c);
+            }
+            cstats_calls.erase(cstats_calls.begin() + i);
+            return;
+        }
+    }
+#ifdef LUAJIT_VERSION
+    // LuaJIT has no return hook for C functions, the call ends at the next
+    // line hook of the same thread.
+    void cstats_return_jit(lua_State* hL) {
+        for (size_t i = cstats_calls.size(); i-- > 0;) {
+            if (cstats_calls[i].hL == hL) {
+                cstats_record(cstats_calls[i]);
+                cstats_calls.erase(cstats_calls.begin() + i);
+                return;
+            }
+        }
+    }
+#endif
+    void cstats_report(luadbg_State* L) {
+        luadbg_createtable(L, (int)cstats.size(), 0);
+        luadbg_Integer n = 0;
+        for (const auto& [func, h] : cstats) {
+            luadbg_createtable(L, 0, 7);
+            luadbg_pushfstring(L, "%p", func);
+            luadbg_setfield(L, -2, "func");
+            auto info = luadebug::symbolize(func);
+            if (info.function_name) {
+                luadbg_pushlstring(L, info.function_name->c_str(), info.function_name->size());
+            }
+            else {
+                luadbg_pushfstring(L, "%p", func);
+            }
+            luadbg_setfield(L, -2, "name");
+            if (info.module_name) {
+                luadbg_pushlstring(L, info.module_name->c_str(), info.module_name->size());
+                luadbg_setfield(L, -2, "module");
+            }
+            luadbg_pushinteger(L, (luadbg_Integer)h.count);
+            luadbg_setfield(L, -2, "count");
+            luadbg_pushinteger(L, (luadbg_Integer)h.total);
+            luadbg_setfield(L, -2, "total");
+            luadbg_pushinteger(L, (luadbg_Integer)h.max);
+            luadbg_setfield(L, -2, "max");
+            luadbg_newtable(L);
+            luadbg_Integer k = 0;
+            for (int i = 0; i < luadebug::histogram::size; ++i) {
+                if (h.buckets[i] == 0) {
+                    continue;
+                }
+                luadbg_createtable(L, 2, 0);
+                luadbg_pushinteger(L, (luadbg_Integer)luadebug::histogram::lower(i));
+                luadbg_rawseti(L, -2, 1);
+                luadbg_pushinteger(L, (luadbg_Integer)h.buckets[i]);
+                luadbg_rawseti(L, -2, 2);
+                luadbg_rawseti(L, -2, ++k);
+            }
+            luadbg_setfield(L, -2, "histogram");
+            luadbg_rawseti(L, -2, ++n);
+        }
+    }
+
     //
     // step
     //
@@ -227,11 +531,14 @@ struct hookmgr {
     int step_current_level = 0;
     int step_target_level  = 0;
     int step_mask          = 0;
+    int step_call_pc       = -1;
+    int step_call_line     = 0;
 
     void step_in(lua_State* hL) {
         step_current_level = 0;
         step_target_level  = 0;
         stepL              = 0;
+        step_call_pc       = -1;
 #if LUA_VERSION_NUM >= 504
         step_hookmask(hL, LUA_MASKCALL | LUA_MASKRET | LUA_MASKLINE);
 #else
@@ -242,18 +549,49 @@ struct hookmgr {
         step_current_level = lua_stacklevel(hL);
         step_target_level  = step_current_level - 1;
         stepL              = hL;
+        step_call_pc       = -1;
         step_hookmask(hL, LUA_MASKCALL | LUA_MASKRET);
     }
     void step_over(lua_State* hL) {
         step_current_level = lua_stacklevel(hL);
         step_target_level  = step_current_level;
         stepL              = hL;
+        step_call_pc       = -1;
         step_hookmask(hL, LUA_MASKCALL | LUA_MASKRET | LUA_MASKLINE);
     }
+    // Stops at the first line of the function called by the instruction pc
+    // of the frame at level. Until then every event is handled here, the
+    // debugger only sees the stop. If the frame leaves its line or returns
+    // without making the call, it stops there instead, like step over.
+    bool step_into_call(lua_State* hL, int level, int pc) {
+        lua_Debug ar;
+        if (!lua_getstack(hL, level, &ar) || !lua_getinfo(hL, "l", &ar)) {
+            return false;
+        }
+        step_current_level = lua_stacklevel(hL);
+        step_target_level  = step_current_level - level;
+        stepL              = hL;
+        step_call_pc       = pc;
+        step_call_line     = ar.currentline;
+        step_hookmask(hL, level > 0 ? LUA_MASKCALL | LUA_MASKRET : LUA_MASKCALL | LUA_MASKRET | LUA_MASKLINE);
+        return true;
+    }
+    // Stops before the next instruction of this coroutine. The count hook
+    // is set on hL only, so other coroutines keep running at full speed.
+    // With over, the instructions of the functions it calls are skipped: the
+    // count hook fires in them too, so it stops only back at this level.
+    void step_instruction(lua_State* hL, bool over) {
+        step_current_level = 0;
+        step_target_level  = over ? lua_stacklevel(hL) : 0;
+        stepL              = hL;
+        step_call_pc       = -1;
+        step_hookmask(hL, LUA_MASKCOUNT);
+    }
     void step_cancel(lua_State* hL) {
         step_current_level = 0;
         step_target_level  = 0;
         stepL              = 0;
+        step_call_pc       = -1;
         step_hookmask(hL, 0);
     }
     void step_hook_call(lua_State* hL, lua_Debug* ar) {
@@ -262,6 +600,10 @@ struct hookmgr {
         if (!lua_isluafunc(hL, ar))
             return;
 #endif
+        if (step_call_pc >= 0) {
+            step_call_hook_call(hL, ar);
+            return;
+        }
         step_current_level++;
         if (step_current_level > step_target_level) {
             step_hookmask(hL, LUA_MASKCALL | LUA_MASKRET);
@@ -272,6 +614,10 @@ struct hookmgr {
     }
     void step_hook_return(lua_State* hL, lua_Debug* ar) {
         step_current_level = lua_stacklevel(hL) - 1;
+        if (step_call_pc >= 0 && step_current_level < step_target_level) {
+            step_call_pc      = -1;
+            step_target_level = step_current_level;
+        }
         if (step_current_level > step_target_level) {
             step_hookmask(hL, LUA_MASKCALL | LUA_MASKRET);
         }
@@ -279,6 +625,57 @@ struct hookmgr {
             step_hookmask(hL, LUA_MASKCALL | LUA_MASKRET | LUA_MASKLINE);
         }
     }
+    void step_call_hook_call(lua_State* hL, lua_Debug* ar) {
+        step_current_level = lua_stacklevel(hL);
+        bool found;
+        if (step_current_level == step_target_level + 1) {
+            lua_Debug caller;
+            found = lua_getstack(hL, 1, &caller) && lua_ci2pc(hL, lua_debug2ci(hL, &caller)) == step_call_pc;
+        }
+        else {
+            // A tail call replaces the frame, it is the last call it makes.
+            found = step_current_level == step_target_level;
+        }
+        if (found) {
+            step_call_pc = -1;
+            // A C function has no line, so it is stepped over.
+            if (lua_getinfo(hL, "S", ar) && *ar->what != 'C') {
+                step_target_level = step_current_level;
+            }
+        }
+        if (step_current_level > step_target_level) {
+            step_hookmask(hL, LUA_MASKCALL | LUA_MASKRET);
+        }
+        else {
+            step_hookmask(hL, LUA_MASKCALL | LUA_MASKRET | LUA_MASKLINE);
+        }
+    }
+    // Returns false while the frame is still on the line of the call.
+    bool step_call_hook_line(lua_State* hL, lua_Debug* ar) {
+        if (step_current_level != step_target_level) {
+            return true;
+        }
+        if (ar->currentline == step_call_line) {
+            return false;
+        }
+        step_call_pc = -1;
+        return true;
+    }
+    void step_hook_count(lua_State* hL, lua_Debug* ar) {
+        if (step_target_level > 0 && lua_stacklevel(hL) > step_target_level) {
+            return;
+        }
+        if (!lua_getinfo(hL, "l", ar)) {
+            return;
+        }
+        push_callback(L, ctx);
+        ctx->current = hL;
+        luadbg_pushstring(L, "step");
+        luadbg_pushinteger(L, ar->currentline);
+        if (luadbg_pcall(L, 2, 0, 0) != LUADBG_OK) {
+            luadbg_pop(L, 1);
+        }
+    }
 #ifdef LUAJIT_VERSION
     void step_hook_line(lua_State* hL, lua_Debug* ar) {
         step_current_level = lua_stacklevel(hL);
@@ -312,9 +709,9 @@ struct hookmgr {
         exception_hookmask(hL, enable ? LUA_MASKEXCEPTION : 0);
     }
     void exception_hook(lua_State* hL, lua_Debug* ar) {
-        push_callback(L);
+        push_callback(L, ctx);
         int errcode;
-        luadebug::debughost::set(L, hL);
+        ctx->current = hL;
         luadbg_pushstring(L, "exception");
 #    if LUA_VERSION_NUM >= 504
         LUA_STKID(hL->top) = LUA_STKID(hL->stack) + ar->currentline;
@@ -347,9 +744,12 @@ struct hookmgr {
         thread_hookmask(hL, enable ? LUA_MASKTHREAD : 0);
     }
     void thread_hook(lua_State* co, lua_Debug* ar) {
-        lua_State* from = (lua_State*)lua_touserdata(co, -1);
+        // The hook runs on the thread that runs from now on.
+        stall_L.store(co, std::memory_order_relaxed);
+        thread_event(co, (lua_State*)lua_touserdata(co, -1), ar->currentline);
+    }
+    void thread_event(lua_State* co, lua_State* from, int type) {
         if (from) {
-            int type = ar->currentline;
             if (type == 0) {
                 coroutine_tree.insert_or_assign(co, from);
             }
@@ -371,22 +771,33 @@ struct hookmgr {
     //
     // common
     //
-    luadbg_State* L = 0;
+    luadbg_State* L                   = 0;
+    luadebug::debughost::context* ctx = 0;
     std::unique_ptr<thunk> sc_full_hook;
     std::unique_ptr<thunk> sc_idle_hook;
     void* eventfree = nullptr;
 
-    hookmgr(luadbg_State* L)
-        : L(L) {}
+    hookmgr(luadbg_State* L, luadebug::debughost::context* ctx)
+        : L(L)
+        , ctx(ctx) {}
 
 #ifdef LUAJIT_VERSION
     bool last_hook_call_in_c = false;
 #endif
     void full_hook(lua_State* hL, lua_Debug* ar) {
+        if (fork_check(hL)) {
+            return;
+        }
         switch (ar->event) {
         case LUA_HOOKLINE:
+            if (heat_mask & LUA_MASKLINE) {
+                heat_hook_line(hL, ar);
+            }
 #ifdef LUAJIT_VERSION
             if (last_hook_call_in_c) {
+                if (cstats_mask) {
+                    cstats_return_jit(hL);
+                }
 #    if defined(LUA_HOOKTHREAD)
                 thread_mask &= (~LUA_MASKTHREAD);
 #    endif
@@ -399,9 +810,17 @@ struct hookmgr {
                 if (step_mask & LUA_MASKRET) {
                     step_hook_line(hL, ar);
                 }
+                if (step_call_pc >= 0 && !step_call_hook_line(hL, ar)) {
+                    return;
+                }
             }
             if (!((step_mask & LUA_MASKLINE) && (!stepL || stepL == hL)) && !(break_mask & LUA_MASKLINE))
                 return;
+#else
+            if (step_call_pc >= 0 && stepL == hL && !step_call_hook_line(hL, ar))
+                return;
+            if (!(step_mask & LUA_MASKLINE) && !(break_mask & LUA_MASKLINE))
+                return;
 #endif
             break;
         case LUA_HOOKCALL:
@@ -413,6 +832,12 @@ struct hookmgr {
             if (funcbp_mask) {
                 funcbp_hook(hL, ar);
             }
+            if (cstats_mask) {
+                cstats_call(hL, ar);
+            }
+            if (heat_mask) {
+                heat_hook_call(hL, ar);
+            }
             if (break_mask & LUA_MASKCALL) {
                 break_hook_call(hL, ar);
             }
@@ -433,6 +858,12 @@ struct hookmgr {
 #endif
             return;
         case LUA_HOOKRET:
+            if (cstats_mask) {
+                cstats_return(hL, ar);
+            }
+            if (heat_mask) {
+                heat_hook_return(hL, ar);
+            }
             if (update_mask) {
                 update_hook(hL);
             }
@@ -452,7 +883,15 @@ struct hookmgr {
 #endif
             return;
         case LUA_HOOKCOUNT:
-            update_hook(hL);
+            if (stall_armed()) {
+                stall_hook(hL);
+            }
+            if (update_mask) {
+                update_hook(hL);
+            }
+            if ((step_mask & LUA_MASKCOUNT) && stepL == hL) {
+                step_hook_count(hL, ar);
+            }
             return;
 #if defined(LUA_HOOKEXCEPTION)
         case LUA_HOOKEXCEPTION:
@@ -467,8 +906,8 @@ struct hookmgr {
         default:
             return;
         }
-        push_callback(L);
-        luadebug::debughost::set(L, hL);
+        push_callback(L, ctx);
+        ctx->current = hL;
         if ((step_mask & LUA_MASKLINE) && (!stepL || stepL == hL)) {
             luadbg_pushstring(L, "step");
             luadbg_pushinteger(L, ar->currentline);
@@ -488,11 +927,21 @@ struct hookmgr {
     }
 
     void idle_hook(lua_State* hL, lua_Debug* ar) {
+        if (fork_check(hL)) {
+            return;
+        }
         switch (ar->event) {
         case LUA_HOOKRET:
-        case LUA_HOOKCOUNT:
             update_hook(hL);
             return;
+        case LUA_HOOKCOUNT:
+            if (stall_armed()) {
+                stall_hook(hL);
+            }
+            if (update_mask) {
+                update_hook(hL);
+            }
+            return;
 #if defined(LUA_HOOKEXCEPTION)
         case LUA_HOOKEXCEPTION:
             exception_hook(hL, ar);
@@ -520,11 +969,15 @@ struct hookmgr {
     }
 
     void updatehookmask(lua_State* hL) {
-        int mask = break_mask | funcbp_mask;
+        int mask = break_mask | funcbp_mask | cstats_mask | heat_mask;
         if (!stepL || stepL == hL) {
             mask |= step_mask;
         }
-        if (mask) {
+        if (mask & LUA_MASKCOUNT) {
+            sethook(hL, (lua_Hook)sc_full_hook->data, (mask & ~LUA_MASKCOUNT) | exception_mask | thread_mask, 0);
+            lua_sethook(hL, (lua_Hook)sc_full_hook->data, mask | exception_mask | thread_mask, 1);
+        }
+        else if (mask) {
             sethook(hL, (lua_Hook)sc_full_hook->data, mask | exception_mask | thread_mask, 0);
         }
         else if (update_mask) {
@@ -548,8 +1001,8 @@ struct hookmgr {
         if (!update_timer.update(200)) {
             return;
         }
-        push_callback(L);
-        luadebug::debughost::set(L, hL);
+        push_callback(L, ctx);
+        ctx->current = hL;
         luadbg_pushstring(L, "update");
         if (luadbg_pcall(L, 1, 0, 0) != LUADBG_OK) {
             luadbg_pop(L, 1);
@@ -557,9 +1010,268 @@ struct hookmgr {
         }
     }
 
+    //
+    // stall
+    //
+    struct stall_local {
+        std::string name;
+        std::string value;
+    };
+    struct stall_frame {
+        std::string source;
+        int currentline = 0;
+        std::string name;
+        std::vector<stall_local> locals;
+    };
+    struct stall_record {
+        uint64_t elapsed = 0;
+        int64_t time     = 0;
+        std::vector<stall_frame> frames;
+    };
+    static constexpr size_t stall_maxreports = 16;
+    static constexpr int stall_maxframes     = 256;
+    static constexpr int stall_localframes   = 3;
+    static constexpr size_t stall_maxstring  = 64;
+
+    std::thread stall_thread;
+    std::atomic<bool> stall_running { false };
+    std::atomic<uint64_t> stall_target { 0 };
+    std::atomic<uint64_t> stall_done { 0 };
+    std::atomic<int64_t> stall_since { 0 };
+    // The thread that is running, so that the count hook is set where it
+    // fires. It is kept by the thread hook, and is the main thread without.
+    std::atomic<lua_State*> stall_L { nullptr };
+    std::chrono::milliseconds stall_budget { 0 };
+    bool stall_pause = false;
+    std::vector<stall_record> stall_reports;
+
+    // The watchdog only reads the heartbeat that the host bumps, so a state
+    // that is never stalled pays nothing. When the heartbeat stops for longer
+    // than the budget, it arms a count hook from its own thread, the same way
+    // lua.c interrupts a running script, and the stack is captured by the
+    // debuggee's thread at the next instruction.
+    void stall_open(int budget_ms, bool pause) {
+        stall_close();
+        stall_pause = pause;
+        if (budget_ms <= 0 || !hL) {
+            return;
+        }
+        stall_budget  = std::chrono::milliseconds(budget_ms);
+        stall_running = true;
+        // Opened from the debugger, so the thread that called it is running.
+        stall_L.store(ctx->current ? ctx->current : hL, std::memory_order_relaxed);
+        stall_thread = std::thread([this]() { stall_run(); });
+    }
+    void stall_close() {
+        if (!stall_running) {
+            return;
+        }
+        stall_running = false;
+        stall_thread.join();
+    }
+    void stall_reset() {
+        // The time the debuggee spends stopped in the debugger is not a stall.
+        // A host that never beats stays unwatched.
+        if (ctx->heartbeat.load(std::memory_order_relaxed) != 0) {
+            ctx->heartbeat.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+    void stall_forked() {
+        if (stall_running) {
+            // The watchdog thread doesn't exist in the child process, so
+            // its handle is dropped without joining.
+            stall_running = false;
+            stall_thread.detach();
+        }
+    }
+    void stall_run() {
+        auto interval = std::clamp(stall_budget / 4, std::chrono::milliseconds(1), std::chrono::milliseconds(100));
+        uint64_t beat = ctx->heartbeat.load(std::memory_order_relaxed);
+        auto since    = std::chrono::steady_clock::now();
+        while (stall_running) {
+            std::this_thread::sleep_for(interval);
+            uint64_t now_beat = ctx->heartbeat.load(std::memory_order_relaxed);
+            auto now          = std::chrono::steady_clock::now();
+            if (now_beat != beat) {
+                beat  = now_beat;
+                since = now;
+                continue;
+            }
+            // Nothing to watch until the host beats for the first time.
+            if (beat == 0 || stall_done == beat || now - since < stall_budget) {
+                continue;
+            }
+            stall_since  = since.time_since_epoch().count();
+            stall_target = beat;
+            // Armed again at each tick until the hook runs, because the
+            // debuggee's thread may reset the mask in between.
+            lua_State* runL = stall_L.load(std::memory_order_relaxed);
+            lua_sethook(runL, (lua_Hook)sc_full_hook->data, lua_gethookmask(runL) | LUA_MASKCOUNT, 1);
+        }
+    }
+    bool stall_armed() const {
+        return stall_target != stall_done;
+    }
+    void stall_hook(lua_State* hL) {
+        uint64_t target = stall_target;
+        stall_done      = target;
+        updatehookmask(hL);
+        if (ctx->heartbeat.load(std::memory_order_relaxed) != target) {
+            return;
+        }
+        auto now   = std::chrono::steady_clock::now();
+        auto since = std::chrono::steady_clock::time_point(std::chrono::steady_clock::duration(stall_since.load()));
+        if (stall_reports.size() >= stall_maxreports) {
+            stall_reports.erase(stall_reports.begin());
+        }
+        stall_record& r = stall_reports.emplace_back();
+        r.elapsed       = (uint64_t)std::chrono::duration_cast<std::chrono::milliseconds>(now - since).count();
+        r.time          = (int64_t)std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+        stall_capture(hL, r);
+        if (!stall_pause) {
+            return;
+        }
+        push_callback(L, ctx);
+        ctx->current = hL;
+        luadbg_pushstring(L, "stall");
+        luadbg_pushinteger(L, (luadbg_Integer)r.elapsed);
+        if (luadbg_pcall(L, 2, 0, 0) != LUADBG_OK) {
+            luadbg_pop(L, 1);
+        }
+        stall_reset();
+    }
+    static void stall_value(lua_State* hL, int idx, std::string& s) {
+        char buf[64];
+        switch (lua_type(hL, idx)) {
+        case LUA_TNIL:
+            s = "nil";
+            break;
+        case LUA_TBOOLEAN:
+            s = lua_toboolean(hL, idx) ? "true" : "false";
+            break;
+        case LUA_TNUMBER:
+#if LUA_VERSION_NUM >= 503
+            if (lua_isinteger(hL, idx)) {
+                snprintf(buf, sizeof(buf), "%lld", (long long)lua_tointeger(hL, idx));
+                s = buf;
+                break;
+            }
+#endif
+            snprintf(buf, sizeof(buf), "%.14g", (double)lua_tonumber(hL, idx));
+            s = buf;
+            break;
+        case LUA_TSTRING: {
+            size_t len      = 0;
+            const char* str = lua_tolstring(hL, idx, &len);
+            s               = "\"";
+            s.append(str, std::min(len, stall_maxstring));
+            s += len > stall_maxstring ? "\"..." : "\"";
+            break;
+        }
+        default:
+            snprintf(buf, sizeof(buf), "%s: %p", lua_typename(hL, lua_type(hL, idx)), lua_topointer(hL, idx));
+            s = buf;
+            break;
+        }
+    }
+    static void stall_capture(lua_State* hL, stall_record& r) {
+        lua_Debug ar;
+        for (int level = 0; level < stall_maxframes && lua_getstack(hL, level, &ar); ++level) {
+            if (!lua_getinfo(hL, "Sln", &ar)) {
+                continue;
+            }
+            stall_frame& f = r.frames.emplace_back();
+            f.source       = ar.source ? ar.source : "?";
+            f.currentline  = ar.currentline;
+            f.name         = ar.name ? ar.name : "?";
+            if (level >= stall_localframes) {
+                continue;
+            }
+            for (int n = 1;; ++n) {
+                const char* name = lua_getlocal(hL, &ar, n);
+                if (!name) {
+                    break;
+                }
+                // Temporaries such as "(for state)" are not interesting.
+                if (name[0] != '(') {
+                    stall_local& l = f.locals.emplace_back();
+                    l.name         = name;
+                    stall_value(hL, -1, l.value);
+                }
+                lua_pop(hL, 1);
+            }
+        }
+    }
+    void stall_report(luadbg_State* L) {
+        luadbg_createtable(L, (int)stall_reports.size(), 0);
+        luadbg_Integer n = 0;
+        for (const auto& r : stall_reports) {
+            luadbg_createtable(L, 0, 3);
+            luadbg_pushinteger(L, (luadbg_Integer)r.elapsed);
+            luadbg_setfield(L, -2, "elapsed");
+            luadbg_pushinteger(L, (luadbg_Integer)r.time);
+            luadbg_setfield(L, -2, "time");
+            luadbg_createtable(L, (int)r.frames.size(), 0);
+            luadbg_Integer k = 0;
+            for (const auto& f : r.frames) {
+                luadbg_createtable(L, 0, 4);
+                luadbg_pushlstring(L, f.source.data(), f.source.size());
+                luadbg_setfield(L, -2, "source");
+                luadbg_pushinteger(L, f.currentline);
+                luadbg_setfield(L, -2, "line");
+                luadbg_pushlstring(L, f.name.data(), f.name.size());
+                luadbg_setfield(L, -2, "name");
+                if (!f.locals.empty()) {
+                    luadbg_createtable(L, (int)f.locals.size(), 0);
+                    luadbg_Integer i = 0;
+                    for (const auto& l : f.locals) {
+                        luadbg_createtable(L, 0, 2);
+                        luadbg_pushlstring(L, l.name.data(), l.name.size());
+                        luadbg_setfield(L, -2, "name");
+                        luadbg_pushlstring(L, l.value.data(), l.value.size());
+                        luadbg_setfield(L, -2, "value");
+                        luadbg_rawseti(L, -2, ++i);
+                    }
+                    luadbg_setfield(L, -2, "locals");
+                }
+                luadbg_rawseti(L, -2, ++k);
+            }
+            luadbg_setfield(L, -2, "frames");
+            luadbg_rawseti(L, -2, ++n);
+        }
+    }
+
+    //
+    // fork
+    //
+    int fork_generation = 0;
+    bool fork_check(lua_State* hL) {
+        if (fork_generation == luadebug::fork::generation()) {
+            return false;
+        }
+        // We are in a child process, the debugger threads are gone.
+        lua_sethook(hL, 0, 0, 0);
+        stall_forked();
+        if (this->hL) {
+            break_mask   = 0;
+            funcbp_mask  = 0;
+            cstats_mask  = 0;
+            heat_mask    = 0;
+            step_mask    = 0;
+            thread_mask  = 0;
+            update_mask  = 0;
+            stepL        = 0;
+            step_call_pc = -1;
+            detach();
+            luadebug::debughost::forked(hL);
+        }
+        return true;
+    }
+
     lua_State* hL = 0;
     void init(lua_State* hL) {
-        this->hL = hL;
+        this->hL        = hL;
+        fork_generation = luadebug::fork::generation();
 #if defined(LUADEBUG_DISABLE_THUNK)
         thunk_set(hL, &THUNK_MGR, (intptr_t)this);
 #endif
@@ -574,9 +1286,13 @@ struct hookmgr {
         eventfree = luadebug::eventfree::create(hL, freeobj_callback, this);
     }
     ~hookmgr() {
+        detach();
+    }
+    void detach() {
         if (!hL) {
             return;
         }
+        stall_close();
         luadebug::eventfree::destroy(hL, eventfree);
         lua_sethook(hL, 0, 0, 0);
 #if defined(LUA_HOOKEXCEPTION)
@@ -594,6 +1310,7 @@ struct hookmgr {
     }
     static void freeobj_callback(void* mgr, void* ptr) {
         ((hookmgr*)mgr)->break_freeobj((Proto*)ptr);
+        ((hookmgr*)mgr)->heat_freeobj((Proto*)ptr);
     }
 #if !defined(LUADEBUG_DISABLE_THUNK)
     static void full_hook_callback(hookmgr* mgr, lua_State* hL, lua_Debug* ar) {
@@ -616,23 +1333,28 @@ struct hookmgr {
 #endif
 };
 
+static lua_State* gethL(luadbg_State* L) {
+    return hookmgr::get_self(L)->ctx->current;
+}
+
 static int init(luadbg_State* L) {
     luadbgL_checktype(L, 1, LUA_TFUNCTION);
     luadbg_settop(L, 1);
-    luadbg_rawsetp(L, LUADBG_REGISTRYINDEX, &HOOK_CALLBACK);
-    lua_State* hL = luadebug::debughost::get(L);
-    hookmgr::get_self(L)->init(hL);
+    hookmgr* self = hookmgr::get_self(L);
+    luadbgL_unref(L, LUADBG_REGISTRYINDEX, self->ctx->callback);
+    self->ctx->callback = luadbgL_ref(L, LUADBG_REGISTRYINDEX);
+    self->init(self->ctx->current);
     return 0;
 }
 
 static int sethost(luadbg_State* L) {
     luadbgL_checktype(L, 1, LUA_TLIGHTUSERDATA);
-    luadebug::debughost::set(L, (lua_State*)luadbg_touserdata(L, 1));
+    hookmgr::get_self(L)->ctx->current = (lua_State*)luadbg_touserdata(L, 1);
     return 0;
 }
 
 static int gethost(luadbg_State* L) {
-    luadbg_pushlightuserdata(L, luadebug::debughost::get(L));
+    luadbg_pushlightuserdata(L, gethL(L));
     return 1;
 }
 
@@ -642,71 +1364,133 @@ static int updatehookmask(luadbg_State* L) {
 }
 
 static int stacklevel(luadbg_State* L) {
-    lua_State* hL = luadebug::debughost::get(L);
+    lua_State* hL = gethL(L);
     luadbg_pushinteger(L, lua_stacklevel(hL));
     return 1;
 }
 
 static int break_add(luadbg_State* L) {
-    hookmgr::get_self(L)->break_add(luadebug::debughost::get(L), checklightudata<Proto>(L, 1));
+    hookmgr::get_self(L)->break_add(gethL(L), checklightudata<Proto>(L, 1));
     return 0;
 }
 
 static int break_del(luadbg_State* L) {
-    hookmgr::get_self(L)->break_del(luadebug::debughost::get(L), checklightudata<Proto>(L, 1));
+    hookmgr::get_self(L)->break_del(gethL(L), checklightudata<Proto>(L, 1));
+    return 0;
+}
+
+static int break_reset(luadbg_State* L) {
+    hookmgr::get_self(L)->break_freeobj(checklightudata<Proto>(L, 1));
     return 0;
 }
 
 static int break_open(luadbg_State* L) {
-    hookmgr::get_self(L)->break_open(luadebug::debughost::get(L), luadbg_toboolean(L, 1));
+    hookmgr::get_self(L)->break_open(gethL(L), luadbg_toboolean(L, 1));
     return 0;
 }
 
 static int break_closeline(luadbg_State* L) {
-    hookmgr::get_self(L)->break_closeline(luadebug::debughost::get(L));
+    hookmgr::get_self(L)->break_closeline(gethL(L));
     return 0;
 }
 
 static int funcbp_open(luadbg_State* L) {
-    hookmgr::get_self(L)->funcbp_open(luadebug::debughost::get(L), luadbg_toboolean(L, 1));
+    hookmgr::get_self(L)->funcbp_open(gethL(L), luadbg_toboolean(L, 1));
+    return 0;
+}
+
+static int heat_add(luadbg_State* L) {
+    hookmgr::get_self(L)->heat_add(gethL(L), checklightudata<Proto>(L, 1));
+    return 0;
+}
+
+static int heat_del(luadbg_State* L) {
+    hookmgr::get_self(L)->heat_del(gethL(L), checklightudata<Proto>(L, 1));
+    return 0;
+}
+
+static int heat_open(luadbg_State* L) {
+    hookmgr::get_self(L)->heat_open(gethL(L), luadbg_toboolean(L, 1));
     return 0;
 }
 
+static int heat_report(luadbg_State* L) {
+    hookmgr::get_self(L)->heat_report(L, luadbg_toboolean(L, 1));
+    return 1;
+}
+
+static int cstats_open(luadbg_State* L) {
+    hookmgr::get_self(L)->cstats_open(gethL(L), luadbg_toboolean(L, 1));
+    return 0;
+}
+
+static int cstats_report(luadbg_State* L) {
+    hookmgr::get_self(L)->cstats_report(L);
+    return 1;
+}
+
 static int step_in(luadbg_State* L) {
-    hookmgr::get_self(L)->step_in(luadebug::debughost::get(L));
+    hookmgr::get_self(L)->step_in(gethL(L));
     return 0;
 }
 
 static int step_out(luadbg_State* L) {
-    hookmgr::get_self(L)->step_out(luadebug::debughost::get(L));
+    hookmgr::get_self(L)->step_out(gethL(L));
     return 0;
 }
 
 static int step_over(luadbg_State* L) {
-    hookmgr::get_self(L)->step_over(luadebug::debughost::get(L));
+    hookmgr::get_self(L)->step_over(gethL(L));
+    return 0;
+}
+
+static int step_into_call(luadbg_State* L) {
+    int level = (int)luadbgL_checkinteger(L, 1);
+    int pc    = (int)luadbgL_checkinteger(L, 2);
+    luadbg_pushboolean(L, hookmgr::get_self(L)->step_into_call(gethL(L), level, pc));
+    return 1;
+}
+
+static int step_instruction(luadbg_State* L) {
+    hookmgr::get_self(L)->step_instruction(gethL(L), luadbg_toboolean(L, 1));
     return 0;
 }
 
 static int step_cancel(luadbg_State* L) {
-    hookmgr::get_self(L)->step_cancel(luadebug::debughost::get(L));
+    hookmgr::get_self(L)->step_cancel(gethL(L));
     return 0;
 }
 
 static int update_open(luadbg_State* L) {
-    hookmgr::get_self(L)->update_open(luadebug::debughost::get(L), luadbg_toboolean(L, 1));
+    hookmgr::get_self(L)->update_open(gethL(L), luadbg_toboolean(L, 1));
     return 0;
 }
 
+static int stall_open(luadbg_State* L) {
+    hookmgr::get_self(L)->stall_open((int)luadbgL_optinteger(L, 1, 0), luadbg_toboolean(L, 2));
+    return 0;
+}
+
+static int stall_reset(luadbg_State* L) {
+    hookmgr::get_self(L)->stall_reset();
+    return 0;
+}
+
+static int stall_report(luadbg_State* L) {
+    hookmgr::get_self(L)->stall_report(L);
+    return 1;
+}
+
 #if defined(LUA_HOOKEXCEPTION)
 static int exception_open(luadbg_State* L) {
-    hookmgr::get_self(L)->exception_open(luadebug::debughost::get(L), luadbg_toboolean(L, 1));
+    hookmgr::get_self(L)->exception_open(gethL(L), luadbg_toboolean(L, 1));
     return 0;
 }
 #endif
 
 #if defined(LUA_HOOKTHREAD)
 static int thread_open(luadbg_State* L) {
-    hookmgr::get_self(L)->thread_open(luadebug::debughost::get(L), luadbg_toboolean(L, 1));
+    hookmgr::get_self(L)->thread_open(gethL(L), luadbg_toboolean(L, 1));
     return 0;
 }
 static int coroutine_from(luadbg_State* L) {
@@ -722,13 +1506,13 @@ static int coroutine_from(luadbg_State* L) {
 
 LUADEBUG_FUNC
 int luaopen_luadebug_hookmgr(luadbg_State* L) {
-    luadebug::debughost::get(L);
+    luadebug::debughost::context* ctx = luadebug::debughost::get_context(L);
 
     luadbg_newtable(L);
     if (LUADBG_TUSERDATA != luadbg_rawgetp(L, LUADBG_REGISTRYINDEX, &HOOK_MGR)) {
         luadbg_pop(L, 1);
         hookmgr* thd = (hookmgr*)luadbg_newuserdata(L, sizeof(hookmgr));
-        new (thd) hookmgr(L);
+        new (thd) hookmgr(L, ctx);
 
         luadbg_createtable(L, 0, 1);
         luadbg_pushcfunction(L, hookmgr::clear);
@@ -747,14 +1531,26 @@ int luaopen_luadebug_hookmgr(luadbg_State* L) {
         { "stacklevel", stacklevel },
         { "break_add", break_add },
         { "break_del", break_del },
+        { "break_reset", break_reset },
         { "break_open", break_open },
         { "break_closeline", break_closeline },
         { "funcbp_open", funcbp_open },
+        { "heat_add", heat_add },
+        { "heat_del", heat_del },
+        { "heat_open", heat_open },
+        { "heat_report", heat_report },
+        { "cstats_open", cstats_open },
+        { "cstats_report", cstats_report },
         { "step_in", step_in },
         { "step_out", step_out },
         { "step_over", step_over },
+        { "step_into_call", step_into_call },
+        { "step_instruction", step_instruction },
         { "step_cancel", step_cancel },
         { "update_open", update_open },
+        { "stall_open", stall_open },
+        { "stall_reset", stall_reset },
+        { "stall_report", stall_report },
 #if defined(LUA_HOOKEXCEPTION)
         { "exception_open", exception_open },
 #endif
@@ -768,6 +1564,35 @@ int luaopen_luadebug_hookmgr(luadbg_State* L) {
     return 1;
 }
 
+#if defined(LUA_HOOKTHREAD)
+// The same events as LUA_HOOKTHREAD, for a Lua that isn't patched. The
+// launcher intercepts lua_resume and calls it on entry with (co, from, 0)
+// and on return with (from, co, 1).
+LUADEBUG_FUNC
+void luadebug_threadevent(lua_State* hL, lua_State* from, int type) {
+    if (!hL) {
+        return;
+    }
+    luadebug::debughost::context* ctx = luadebug::debughost::find_context(hL);
+    if (!ctx) {
+        return;
+    }
+    luadbg_State* L = luadebug::debughost::get_client(ctx);
+    if (!L) {
+        return;
+    }
+    if (LUADBG_TUSERDATA != luadbg_rawgetp(L, LUADBG_REGISTRYINDEX, &HOOK_MGR)) {
+        luadbg_pop(L, 1);
+        return;
+    }
+    hookmgr* mgr = (hookmgr*)luadbg_touserdata(L, -1);
+    luadbg_pop(L, 1);
+    if (mgr->thread_mask & LUA_MASKTHREAD) {
+        mgr->thread_event(hL, from, type);
+    }
+}
+#endif
+
 static bool call_event(luadbg_State* L, int nargs) {
     if (luadbg_pcall(L, 1 + nargs, 1, 0) != LUADBG_OK) {
         luadbg_pop(L, 1);
@@ -782,14 +1607,15 @@ static bool call_event(luadbg_State* L, int nargs) {
     return ok;
 }
 
-bool event(luadbg_State* L, lua_State* hL, const char* name, int start) {
-    if (luadbg_rawgetp(L, LUADBG_REGISTRYINDEX, &HOOK_CALLBACK) != LUADBG_TFUNCTION) {
+bool event(luadebug::debughost::context* ctx, lua_State* hL, const char* name, int start) {
+    luadbg_State* L = ctx->client;
+    if (luadbg_rawgeti(L, LUADBG_REGISTRYINDEX, ctx->callback) != LUADBG_TFUNCTION) {
         // TODO cache event?
         luadbg_pop(L, 1);
         return false;
     }
-    int nargs = lua_gettop(hL) - start + 1;
-    luadebug::debughost::set(L, hL);
+    int nargs    = lua_gettop(hL) - start + 1;
+    ctx->current = hL;
     luadbg_pushstring(L, name);
     if (nargs <= 0) {
         return call_event(L, 0);
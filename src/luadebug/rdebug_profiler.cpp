@@ -0,0 +1,201 @@
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <new>
+#include <string>
+#include <unordered_map>
+
+#include "compat/internal.h"
+#include "rdebug_debughost.h"
+#include "rdebug_lua.h"
+
+namespace luadebug::profiler {
+    static int PROFILER = 0;
+
+    enum class vmstate {
+        compiled,
+        interpreted,
+        c,
+        gc,
+        jit,
+        max,
+    };
+
+    static const char* vmstate_name[] = {
+        "compiled",
+        "interpreted",
+        "c",
+        "gc",
+        "jit",
+    };
+
+    static vmstate tovmstate(int v) {
+        switch (v) {
+        case 'N':
+            return vmstate::compiled;
+        case 'I':
+            return vmstate::interpreted;
+        case 'C':
+            return vmstate::c;
+        case 'G':
+            return vmstate::gc;
+        default:
+            return vmstate::jit;
+        }
+    }
+
+    // Samples of the VM profiler, aggregated by stack. The callback runs on
+    // the debuggee's thread and must not touch the debugger VM.
+    struct jitprofiler {
+        lua_State* hL = nullptr;
+        std::string fmt;
+        int depth        = 64;
+        uint64_t samples = 0;
+        uint64_t states[(size_t)vmstate::max] = {};
+        std::unordered_map<std::string, uint64_t> stacks;
+        std::string key;
+
+        ~jitprofiler() {
+            stop();
+        }
+        void stop() {
+            if (hL) {
+                lua_profile_stop(hL);
+                hL = nullptr;
+            }
+        }
+        void reset() {
+            samples = 0;
+            for (auto& n : states) {
+                n = 0;
+            }
+            stacks.clear();
+        }
+        void sample(lua_State* L, int n, int v) {
+            vmstate state   = tovmstate(v);
+            size_t len      = 0;
+            const char* stk = lua_profile_dumpstack(L, fmt.c_str(), -depth, &len);
+            key.assign(stk, len);
+            if (!key.empty()) {
+                key += ';';
+            }
+            key += '[';
+            key += vmstate_name[(size_t)state];
+            key += ']';
+            stacks[key] += n;
+            states[(size_t)state] += n;
+            samples += n;
+        }
+        static void callback(void* data, lua_State* L, int samples, int vmstate) {
+            ((jitprofiler*)data)->sample(L, samples, vmstate);
+        }
+    };
+
+    static jitprofiler& get_self(luadbg_State* L) {
+        return *(jitprofiler*)luadbg_touserdata(L, luadbg_upvalueindex(1));
+    }
+
+    static int start(luadbg_State* L) {
+        jitprofiler& self = get_self(L);
+        luadbg_Integer interval = 1;
+        bool line               = false;
+        int depth               = 64;
+        if (luadbg_type(L, 1) == LUA_TTABLE) {
+            if (luadbg_getfield(L, 1, "interval") == LUA_TNUMBER) {
+                interval = luadbg_tointeger(L, -1);
+            }
+            luadbg_pop(L, 1);
+            if (luadbg_getfield(L, 1, "granularity") == LUA_TSTRING) {
+                line = strcmp(luadbg_tostring(L, -1), "line") == 0;
+            }
+            luadbg_pop(L, 1);
+            if (luadbg_getfield(L, 1, "depth") == LUA_TNUMBER) {
+                depth = (int)luadbg_tointeger(L, -1);
+            }
+            luadbg_pop(L, 1);
+        }
+        if (interval < 1) {
+            interval = 1;
+        }
+        if (depth < 1) {
+            depth = 1;
+        }
+        self.stop();
+        self.reset();
+        self.fmt   = line ? "plZ;" : "pfZ;";
+        self.depth = depth;
+        lua_State* hL = debughost::get_context(L)->current;
+        char mode[32];
+        snprintf(mode, sizeof(mode), "%ci%d", line ? 'l' : 'f', (int)interval);
+        if (!lua_profile_start(hL, mode, jitprofiler::callback, &self)) {
+            luadbg_pushboolean(L, 0);
+            luadbg_pushstring(L, "The VM profiler requires LuaJIT.");
+            return 2;
+        }
+        self.hL = hL;
+        luadbg_pushboolean(L, 1);
+        return 1;
+    }
+
+    static int stop(luadbg_State* L) {
+        jitprofiler& self = get_self(L);
+        self.stop();
+        luadbg_createtable(L, 0, 3);
+        luadbg_pushinteger(L, (luadbg_Integer)self.samples);
+        luadbg_setfield(L, -2, "samples");
+        luadbg_createtable(L, 0, (int)vmstate::max);
+        for (size_t i = 0; i < (size_t)vmstate::max; ++i) {
+            luadbg_pushinteger(L, (luadbg_Integer)self.states[i]);
+            luadbg_setfield(L, -2, vmstate_name[i]);
+        }
+        luadbg_setfield(L, -2, "vmstate");
+        luadbgL_Buffer b;
+        luadbgL_buffinit(L, &b);
+        for (const auto& [stack, n] : self.stacks) {
+            luadbgL_addlstring(&b, stack.data(), stack.size());
+            luadbgL_addchar(&b, ' ');
+            luadbg_pushinteger(L, (luadbg_Integer)n);
+            luadbgL_addvalue(&b);
+            luadbgL_addchar(&b, '\n');
+        }
+        luadbgL_pushresult(&b);
+        luadbg_setfield(L, -2, "folded");
+        self.reset();
+        return 1;
+    }
+
+    static int clear(luadbg_State* L) {
+        jitprofiler* self = (jitprofiler*)luadbg_touserdata(L, 1);
+        self->~jitprofiler();
+        return 0;
+    }
+
+    static int luaopen(luadbg_State* L) {
+        luadbg_newtable(L);
+        if (LUADBG_TUSERDATA != luadbg_rawgetp(L, LUADBG_REGISTRYINDEX, &PROFILER)) {
+            luadbg_pop(L, 1);
+            jitprofiler* self = (jitprofiler*)luadbg_newuserdata(L, sizeof(jitprofiler));
+            new (self) jitprofiler;
+
+            luadbg_createtable(L, 0, 1);
+            luadbg_pushcfunction(L, clear);
+            luadbg_setfield(L, -2, "__gc");
+            luadbg_setmetatable(L, -2);
+
+            luadbg_pushvalue(L, -1);
+            luadbg_rawsetp(L, LUADBG_REGISTRYINDEX, &PROFILER);
+        }
+        static luadbgL_Reg lib[] = {
+            { "start", start },
+            { "stop", stop },
+            { NULL, NULL },
+        };
+        luadbgL_setfuncs(L, lib, 1);
+        return 1;
+    }
+}
+
+LUADEBUG_FUNC
+int luaopen_luadebug_profiler(luadbg_State* L) {
+    return luadebug::profiler::luaopen(L);
+}
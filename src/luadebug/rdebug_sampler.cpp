@@ -0,0 +1,270 @@
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <new>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "rdebug_debughost.h"
+#include "rdebug_lua.h"
+#include "sampler/sampler.h"
+#include "symbolize/symbolize.h"
+
+namespace luadebug::sampler {
+    static int SAMPLER = 0;
+
+    // Samples the native and the Lua stack of the debuggee's thread together,
+    // and merges them into one stack per sample. Capturing, symbolizing and
+    // merging all happen on the sampling thread.
+    struct mixedprofiler {
+        target* t = nullptr;
+        std::thread thread;
+        std::atomic<bool> running { false };
+        std::chrono::microseconds interval { 10000 };
+        uint64_t samples = 0;
+        uint64_t missed  = 0;
+        std::unordered_map<std::string, uint64_t> stacks;
+        std::unordered_map<const void*, std::string> symbols;
+        std::vector<const std::string*> natives;
+        std::vector<std::string> pending;
+        std::string key;
+        sample s;
+
+        ~mixedprofiler() {
+            stop();
+        }
+
+        bool start(lua_State* hL, int interval_ms) {
+            stop();
+            reset();
+            t = attach(hL);
+            if (!t) {
+                return false;
+            }
+            interval = std::chrono::milliseconds(interval_ms);
+            running  = true;
+            thread   = std::thread([this]() { run(); });
+            return true;
+        }
+
+        void stop() {
+            if (!t) {
+                return;
+            }
+            running = false;
+            thread.join();
+            detach(t);
+            t = nullptr;
+        }
+
+        void reset() {
+            samples = 0;
+            missed  = 0;
+            stacks.clear();
+        }
+
+        void run() {
+            while (running) {
+                std::this_thread::sleep_for(interval);
+                if (!running) {
+                    break;
+                }
+                if (capture(t, s)) {
+                    record();
+                }
+                else {
+                    missed++;
+                }
+            }
+        }
+
+        // Return addresses point after the call, so they are looked up one
+        // byte earlier to land inside the calling function.
+        const std::string& symbol(const void* pc, bool exact) {
+            auto it = symbols.find(pc);
+            if (it != symbols.end()) {
+                return it->second;
+            }
+            auto info = symbolize(exact ? pc : (const void*)((const char*)pc - 1));
+            std::string name;
+            if (info.function_name) {
+                name = *info.function_name;
+            }
+            else {
+                char buf[32];
+                snprintf(buf, sizeof(buf), "%p", pc);
+                name = buf;
+            }
+            return symbols.emplace(pc, std::move(name)).first->second;
+        }
+
+        void push(const std::string& name) {
+            if (!key.empty()) {
+                key += ';';
+            }
+            key += name;
+        }
+
+        // Emits the native frames [from, to). The pending Lua frames run
+        // inside the innermost luaV_execute of that range. This goes by the
+        // symbol name, so it is a heuristic: it needs the symbols of the Lua
+        // VM, and LuaJIT has no such function. When no frame is named
+        // luaV_execute, the Lua frames go before the whole range.
+        size_t flush(size_t from, size_t to) {
+            size_t vm = from;
+            for (size_t i = from; i < to; ++i) {
+                if (*natives[i] == "luaV_execute") {
+                    vm = i + 1;
+                }
+            }
+            for (size_t i = from; i < vm; ++i) {
+                push(*natives[i]);
+            }
+            for (auto& name : pending) {
+                push(name);
+            }
+            pending.clear();
+            for (size_t i = vm; i < to; ++i) {
+                push(*natives[i]);
+            }
+            return to;
+        }
+
+        static std::string luaname(const lua_sample_frame& frame) {
+            std::string name;
+            const char* source = frame.source;
+            if (*source == '@' || *source == '=') {
+                name = source + 1;
+            }
+            else {
+                name = "[string]";
+            }
+            name += ':';
+            name += std::to_string(frame.linedefined);
+            return name;
+        }
+
+        // Lua calls a C function through luaD_precall, so the native frame
+        // of that C function is where the Lua stack continues on the native
+        // stack. Frames are matched by symbol.
+        void record() {
+            natives.clear();
+            for (int i = s.nnative - 1; i >= 0; --i) {
+                natives.push_back(&symbol(s.native[i], i == 0));
+            }
+            key.clear();
+            pending.clear();
+            size_t j = 0;
+            for (int i = 0; i < s.nlua; ++i) {
+                const lua_sample_frame& frame = s.lua[i];
+                if (!frame.cfunction) {
+                    pending.push_back(luaname(frame));
+                    continue;
+                }
+                const std::string& name = symbol(frame.cfunction, true);
+                size_t k                = j;
+                while (k < natives.size() && *natives[k] != name) {
+                    k++;
+                }
+                if (k < natives.size()) {
+                    j = flush(j, k) + 1;
+                }
+                else {
+                    flush(j, j);
+                }
+                push(name);
+            }
+            flush(j, natives.size());
+            if (!key.empty()) {
+                stacks[key]++;
+                samples++;
+            }
+        }
+    };
+
+    static mixedprofiler& get_self(luadbg_State* L) {
+        return *(mixedprofiler*)luadbg_touserdata(L, luadbg_upvalueindex(1));
+    }
+
+    static int start(luadbg_State* L) {
+        mixedprofiler& self = get_self(L);
+        luadbg_Integer interval = 10;
+        if (luadbg_type(L, 1) == LUA_TTABLE) {
+            if (luadbg_getfield(L, 1, "interval") == LUA_TNUMBER) {
+                interval = luadbg_tointeger(L, -1);
+            }
+            luadbg_pop(L, 1);
+        }
+        if (interval < 1) {
+            interval = 1;
+        }
+        lua_State* hL = debughost::get_context(L)->current;
+        if (!self.start(hL, (int)interval)) {
+            luadbg_pushboolean(L, 0);
+            luadbg_pushstring(L, "The native stack can't be sampled on this platform.");
+            return 2;
+        }
+        luadbg_pushboolean(L, 1);
+        return 1;
+    }
+
+    static int stop(luadbg_State* L) {
+        mixedprofiler& self = get_self(L);
+        self.stop();
+        luadbg_createtable(L, 0, 3);
+        luadbg_pushinteger(L, (luadbg_Integer)self.samples);
+        luadbg_setfield(L, -2, "samples");
+        luadbg_pushinteger(L, (luadbg_Integer)self.missed);
+        luadbg_setfield(L, -2, "missed");
+        luadbgL_Buffer b;
+        luadbgL_buffinit(L, &b);
+        for (const auto& [stack, n] : self.stacks) {
+            luadbgL_addlstring(&b, stack.data(), stack.size());
+            luadbgL_addchar(&b, ' ');
+            luadbg_pushinteger(L, (luadbg_Integer)n);
+            luadbgL_addvalue(&b);
+            luadbgL_addchar(&b, '\n');
+        }
+        luadbgL_pushresult(&b);
+        luadbg_setfield(L, -2, "folded");
+        self.reset();
+        return 1;
+    }
+
+    static int clear(luadbg_State* L) {
+        mixedprofiler* self = (mixedprofiler*)luadbg_touserdata(L, 1);
+        self->~mixedprofiler();
+        return 0;
+    }
+
+    static int luaopen(luadbg_State* L) {
+        luadbg_newtable(L);
+        if (LUADBG_TUSERDATA != luadbg_rawgetp(L, LUADBG_REGISTRYINDEX, &SAMPLER)) {
+            luadbg_pop(L, 1);
+            mixedprofiler* self = (mixedprofiler*)luadbg_newuserdata(L, sizeof(mixedprofiler));
+            new (self) mixedprofiler;
+
+            luadbg_createtable(L, 0, 1);
+            luadbg_pushcfunction(L, clear);
+            luadbg_setfield(L, -2, "__gc");
+            luadbg_setmetatable(L, -2);
+
+            luadbg_pushvalue(L, -1);
+            luadbg_rawsetp(L, LUADBG_REGISTRYINDEX, &SAMPLER);
+        }
+        static luadbgL_Reg lib[] = {
+            { "start", start },
+            { "stop", stop },
+            { NULL, NULL },
+        };
+        luadbgL_setfuncs(L, lib, 1);
+        return 1;
+    }
+}
+
+LUADEBUG_FUNC
+int luaopen_luadebug_sampler(luadbg_State* L) {
+    return luadebug::sampler::luaopen(L);
+}
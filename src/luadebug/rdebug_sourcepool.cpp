@@ -0,0 +1,283 @@
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <list>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "rdebug_fork.h"
+#include "rdebug_lua.h"
+
+namespace luadebug::sourcepool {
+    static uint64_t hash(std::string_view s) {
+        uint64_t h      = UINT64_C(0xcbf29ce484222325) ^ s.size();
+        const char* p   = s.data();
+        const char* end = p + s.size();
+        for (; end - p >= 8; p += 8) {
+            uint64_t v;
+            memcpy(&v, p, 8);
+            h ^= v * UINT64_C(0x9e3779b97f4a7c15);
+            h = ((h << 31) | (h >> 33)) * UINT64_C(0xff51afd7ed558ccd);
+        }
+        for (; p < end; ++p) {
+            h = (h ^ (uint8_t)*p) * UINT64_C(0x100000001b3);
+        }
+        h ^= h >> 33;
+        h *= UINT64_C(0xc4ceb9fe1a85ec53);
+        h ^= h >> 33;
+        return h;
+    }
+
+    // Texts are identified by a 32-bit reference derived from their hash, so
+    // the same text always gets the same reference. A reference is never
+    // reused: the texts stay in the pool, and the least recently used ones
+    // are moved to a temporary file once it is over capacity. A text keeps
+    // its place in the file once written, so moving it out again is free.
+    //
+    // There is one pool per process, shared by the workers, which add the
+    // texts, and the master, which reads them to answer the client.
+    struct pool {
+        struct entry {
+            uint64_t hash;
+            size_t size;
+            std::string text;
+            bool spilled   = false;
+            int64_t offset = -1;
+            std::list<uint32_t>::iterator lru;
+        };
+        std::mutex mutex;
+        std::unordered_map<uint32_t, entry> entries;
+        std::list<uint32_t> lru;
+        size_t capacity;
+        size_t memory  = 0;
+        FILE* file     = nullptr;
+        int64_t filesz = 0;
+
+        pool(size_t capacity)
+            : capacity(capacity) {}
+
+        bool seek(int64_t offset) {
+#if defined(_WIN32)
+            return _fseeki64(file, offset, SEEK_SET) == 0;
+#else
+            return fseeko(file, (off_t)offset, SEEK_SET) == 0;
+#endif
+        }
+
+        bool read(const entry& e, std::string& out) {
+            out.resize(e.size);
+            if (e.size == 0) {
+                return true;
+            }
+            if (!seek(e.offset)) {
+                return false;
+            }
+            return fread(out.data(), 1, e.size, file) == e.size;
+        }
+
+        bool write(entry& e) {
+            if (e.offset >= 0) {
+                return true;
+            }
+            if (!file) {
+                file = tmpfile();
+                if (!file) {
+                    return false;
+                }
+            }
+            if (!seek(filesz)) {
+                return false;
+            }
+            if (fwrite(e.text.data(), 1, e.size, file) != e.size) {
+                return false;
+            }
+            e.offset = filesz;
+            filesz += e.size;
+            return true;
+        }
+
+        void evict() {
+            while (memory > capacity && lru.size() > 1) {
+                entry& e = entries.at(lru.back());
+                if (!write(e)) {
+                    return;
+                }
+                lru.pop_back();
+                memory -= e.size;
+                e.spilled = true;
+                std::string().swap(e.text);
+            }
+        }
+
+        void touch(entry& e) {
+            lru.splice(lru.begin(), lru, e.lru);
+        }
+
+        // Reads a spilled text back into memory.
+        bool load(uint32_t ref, entry& e) {
+            if (!read(e, e.text)) {
+                std::string().swap(e.text);
+                return false;
+            }
+            e.spilled = false;
+            lru.push_front(ref);
+            e.lru = lru.begin();
+            memory += e.size;
+            evict();
+            return true;
+        }
+
+        uint32_t add(std::string_view s) {
+            uint64_t h   = hash(s);
+            uint32_t ref = (uint32_t)(h ^ (h >> 32)) & 0x7fffffff;
+            for (;; ref = (ref + 1) & 0x7fffffff) {
+                if (ref == 0) {
+                    continue;
+                }
+                auto it = entries.find(ref);
+                if (it == entries.end()) {
+                    break;
+                }
+                entry& e = it->second;
+                if (e.hash != h || e.size != s.size()) {
+                    continue;
+                }
+                // A text added again is in use, so it is brought back rather
+                // than read from the file on every add.
+                if (e.spilled && !load(ref, e)) {
+                    continue;
+                }
+                if (e.text == s) {
+                    touch(e);
+                    return ref;
+                }
+            }
+            entry& e = entries[ref];
+            e.hash   = h;
+            e.size   = s.size();
+            e.text.assign(s.data(), s.size());
+            lru.push_front(ref);
+            e.lru = lru.begin();
+            memory += e.size;
+            evict();
+            return ref;
+        }
+
+        bool get(uint32_t ref, std::string& out) {
+            auto it = entries.find(ref);
+            if (it == entries.end()) {
+                return false;
+            }
+            entry& e = it->second;
+            if (e.spilled) {
+                if (!load(ref, e)) {
+                    return false;
+                }
+            }
+            else {
+                touch(e);
+            }
+            out = e.text;
+            return true;
+        }
+    };
+
+    static constexpr luadbg_Integer DEFAULT_CAPACITY = 64 * 1024 * 1024;
+
+    static pool* shared          = nullptr;
+    static int shared_generation = 0;
+    static std::mutex shared_mutex;
+
+    static pool& checkpool(luadbg_State* L) {
+        return **(pool**)luadbgL_checkudata(L, 1, "luadebug.sourcepool");
+    }
+
+    static int pool_add(luadbg_State* L) {
+        pool& self    = checkpool(L);
+        size_t sz     = 0;
+        const char* s = luadbgL_checklstring(L, 2, &sz);
+        uint32_t ref;
+        {
+            std::lock_guard<std::mutex> lock(self.mutex);
+            ref = self.add({ s, sz });
+        }
+        luadbg_pushinteger(L, ref);
+        return 1;
+    }
+
+    static int pool_get(luadbg_State* L) {
+        pool& self   = checkpool(L);
+        uint32_t ref = (uint32_t)luadbgL_checkinteger(L, 2);
+        std::string text;
+        bool ok;
+        {
+            std::lock_guard<std::mutex> lock(self.mutex);
+            ok = self.get(ref, text);
+        }
+        if (!ok) {
+            return 0;
+        }
+        luadbg_pushlstring(L, text.data(), text.size());
+        return 1;
+    }
+
+    static int pool_memory(luadbg_State* L) {
+        pool& self = checkpool(L);
+        size_t memory;
+        int64_t filesz;
+        {
+            std::lock_guard<std::mutex> lock(self.mutex);
+            memory = self.memory;
+            filesz = self.filesz;
+        }
+        luadbg_pushinteger(L, (luadbg_Integer)memory);
+        luadbg_pushinteger(L, (luadbg_Integer)filesz);
+        return 2;
+    }
+
+    // The pool lives as long as the process. A forked child starts a new
+    // one: a thread of the parent may have held its lock.
+    static int get(luadbg_State* L) {
+        luadbg_Integer capacity = luadbgL_optinteger(L, 1, DEFAULT_CAPACITY);
+        pool* self;
+        {
+            std::lock_guard<std::mutex> lock(shared_mutex);
+            if (!shared || shared_generation != fork::generation()) {
+                shared            = new pool((size_t)capacity);
+                shared_generation = fork::generation();
+            }
+            self = shared;
+        }
+        *(pool**)luadbg_newuserdata(L, sizeof(pool*)) = self;
+        if (luadbgL_newmetatable(L, "luadebug.sourcepool")) {
+            static luadbgL_Reg mt[] = {
+                { "add", pool_add },
+                { "get", pool_get },
+                { "memory", pool_memory },
+                { NULL, NULL }
+            };
+            luadbgL_setfuncs(L, mt, 0);
+            luadbg_pushvalue(L, -1);
+            luadbg_setfield(L, -2, "__index");
+        }
+        luadbg_setmetatable(L, -2);
+        return 1;
+    }
+
+    static int luaopen(luadbg_State* L) {
+        luadbg_newtable(L);
+        luadbgL_Reg lib[] = {
+            { "get", get },
+            { NULL, NULL }
+        };
+        luadbgL_setfuncs(L, lib, 0);
+        return 1;
+    }
+}
+
+LUADEBUG_FUNC
+int luaopen_luadebug_sourcepool(luadbg_State* L) {
+    return luadebug::sourcepool::luaopen(L);
+}
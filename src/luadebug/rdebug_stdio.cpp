@@ -5,8 +5,6 @@
 #include "rdebug_lua.h"
 #include "rdebug_redirect.h"
 
-bool event(luadbg_State* L, lua_State* hL, const char* name, int start);
-
 namespace luadebug::stdio {
     static int getIoOutput(lua_State* hL) {
 #if LUA_VERSION_NUM >= 502
@@ -98,10 +96,14 @@ namespace luadebug::stdio {
         return lua_gettop(hL);
     }
 
+    static debughost::context* getContext(lua_State* hL) {
+        return (debughost::context*)lua_touserdata(hL, lua_upvalueindex(2));
+    }
+
     static int redirect_print(lua_State* hL) {
-        luadbg_State* L = debughost::get_client(hL);
-        if (L) {
-            bool ok = event(L, hL, "print", 1);
+        debughost::context* ctx = getContext(hL);
+        if (debughost::get_client(ctx)) {
+            bool ok = event(ctx, hL, "print", 1);
             if (ok) {
                 return 0;
             }
@@ -113,9 +115,9 @@ namespace luadebug::stdio {
         bool ok = LUA_TUSERDATA == getIoOutput(hL) && lua_rawequal(hL, -1, 1);
         lua_pop(hL, 1);
         if (ok) {
-            luadbg_State* L = debughost::get_client(hL);
-            if (L) {
-                bool ok = event(L, hL, "iowrite", 2);
+            debughost::context* ctx = getContext(hL);
+            if (debughost::get_client(ctx)) {
+                bool ok = event(ctx, hL, "iowrite", 2);
                 if (ok) {
                     lua_settop(hL, 1);
                     return 1;
@@ -126,9 +128,9 @@ namespace luadebug::stdio {
     }
 
     static int redirect_io_write(lua_State* hL) {
-        luadbg_State* L = debughost::get_client(hL);
-        if (L) {
-            bool ok = event(L, hL, "iowrite", 1);
+        debughost::context* ctx = getContext(hL);
+        if (debughost::get_client(ctx)) {
+            bool ok = event(ctx, hL, "iowrite", 1);
             if (ok) {
                 getIoOutput(hL);
                 return 1;
@@ -137,9 +139,10 @@ namespace luadebug::stdio {
         return callfunc(hL);
     }
 
-    static bool openhook(lua_State* hL, bool enable, lua_CFunction f) {
+    static bool openhook(lua_State* hL, debughost::context* ctx, bool enable, lua_CFunction f) {
         if (enable) {
-            lua_pushcclosure(hL, f, 1);
+            lua_pushlightuserdata(hL, ctx);
+            lua_pushcclosure(hL, f, 2);
             return true;
         }
         if (lua_tocfunction(hL, -1) == f) {
@@ -153,18 +156,20 @@ namespace luadebug::stdio {
     }
 
     static int open_print(luadbg_State* L) {
-        bool enable   = luadbg_toboolean(L, 1);
-        lua_State* hL = debughost::get(L);
+        bool enable             = luadbg_toboolean(L, 1);
+        debughost::context* ctx = debughost::get_context(L);
+        lua_State* hL           = ctx->current;
         lua_getglobal(hL, "print");
-        if (openhook(hL, enable, redirect_print)) {
+        if (openhook(hL, ctx, enable, redirect_print)) {
             lua_setglobal(hL, "print");
         }
         return 0;
     }
 
     static int open_iowrite(luadbg_State* L) {
-        bool enable   = luadbg_toboolean(L, 1);
-        lua_State* hL = debughost::get(L);
+        bool enable             = luadbg_toboolean(L, 1);
+        debughost::context* ctx = debughost::get_context(L);
+        lua_State* hL           = ctx->current;
         if (LUA_TUSERDATA == getIoOutput(hL)) {
             if (lua_getmetatable(hL, -1)) {
 #if LUA_VERSION_NUM >= 504
@@ -175,7 +180,7 @@ namespace luadebug::stdio {
                     lua_pushstring(hL, "write");
                     lua_pushvalue(hL, -1);
                     lua_rawget(hL, -3);
-                    if (openhook(hL, enable, redirect_f_write)) {
+                    if (openhook(hL, ctx, enable, redirect_f_write)) {
                         lua_rawset(hL, -3);
                     }
                     lua_pop(hL, 1);
@@ -192,7 +197,7 @@ namespace luadebug::stdio {
             lua_pushstring(hL, "write");
             lua_pushvalue(hL, -1);
             lua_rawget(hL, -3);
-            if (openhook(hL, enable, redirect_io_write)) {
+            if (openhook(hL, ctx, enable, redirect_io_write)) {
                 lua_rawset(hL, -3);
             }
         }
@@ -0,0 +1,503 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "compat/internal.h"
+#include "rdebug_debughost.h"
+#include "rdebug_lua.h"
+#include "util/protected_area.h"
+
+// Analysis of the strings of the debuggee: the largest ones, where they are
+// referenced from, and long strings that are stored more than once.
+
+namespace luadebug::strings {
+    using clock = std::chrono::steady_clock;
+
+    // 64-bit hash that can be fed in pieces.
+    struct hasher {
+        uint64_t h = UINT64_C(0xcbf29ce484222325);
+        void update(const char* p, size_t n) {
+            for (; n >= 8; p += 8, n -= 8) {
+                uint64_t v;
+                memcpy(&v, p, 8);
+                h ^= v * UINT64_C(0x9e3779b97f4a7c15);
+                h = ((h << 31) | (h >> 33)) * UINT64_C(0xff51afd7ed558ccd);
+            }
+            for (; n > 0; ++p, --n) {
+                h = (h ^ (uint8_t)*p) * UINT64_C(0x100000001b3);
+            }
+        }
+        uint64_t digest(size_t len) const {
+            uint64_t x = h ^ len;
+            x ^= x >> 33;
+            x *= UINT64_C(0xc4ceb9fe1a85ec53);
+            x ^= x >> 33;
+            return x;
+        }
+    };
+
+    struct budget {
+        clock::time_point deadline;
+        size_t ticks  = 0;
+        bool expired_ = false;
+        budget(int ms)
+            : deadline(clock::now() + std::chrono::milliseconds(ms)) {}
+        bool expired() {
+            if (!expired_ && (++ticks & 0xff) == 0) {
+                expired_ = clock::now() > deadline;
+            }
+            return expired_;
+        }
+    };
+
+    struct str {
+        const char* s;
+        size_t len;
+    };
+
+    struct group {
+        str first;
+        uint64_t hash;
+        uint64_t count;
+    };
+
+    struct analyzer {
+        budget& limit;
+        size_t topn;
+        size_t minsize;
+        uint64_t count = 0;
+        uint64_t bytes = 0;
+        std::vector<str> top;
+        // Keyed by hash. Different strings with the same hash get groups of
+        // their own under that key.
+        std::unordered_multimap<uint64_t, group> groups;
+
+        analyzer(budget& limit, size_t topn, size_t minsize)
+            : limit(limit)
+            , topn(topn)
+            , minsize(minsize) {}
+
+        static bool smaller(const str& a, const str& b) {
+            return a.len > b.len;
+        }
+        // A min-heap keeps the largest strings seen so far.
+        void push_top(const str& v) {
+            if (top.size() < topn) {
+                top.push_back(v);
+                std::push_heap(top.begin(), top.end(), smaller);
+            }
+            else if (topn > 0 && v.len > top.front().len) {
+                std::pop_heap(top.begin(), top.end(), smaller);
+                top.back() = v;
+                std::push_heap(top.begin(), top.end(), smaller);
+            }
+        }
+        void push_long(const str& v) {
+            hasher h;
+            h.update(v.s, v.len);
+            uint64_t hash = h.digest(v.len);
+            auto [first, last] = groups.equal_range(hash);
+            for (auto it = first; it != last; ++it) {
+                group& g = it->second;
+                if (g.first.len == v.len && memcmp(g.first.s, v.s, v.len) == 0) {
+                    g.count++;
+                    return;
+                }
+            }
+            groups.emplace(hash, group { v, hash, 1 });
+        }
+        static bool visit(void* ud, const char* s, size_t len, bool islong) {
+            analyzer& self = *(analyzer*)ud;
+            self.count++;
+            self.bytes += len;
+            self.push_top({ s, len });
+            if (islong && len >= self.minsize) {
+                self.push_long({ s, len });
+            }
+            return !self.limit.expired();
+        }
+    };
+
+    // Breadth-first walk from the globals and the registry, through tables,
+    // metatables, upvalues and user values, until every target string has
+    // enough referrers. The objects to visit are kept in a table on the
+    // debuggee's stack. When it collects, it also hands every string it
+    // reaches to an analyzer, and walks until it has seen everything.
+    struct finder {
+        static constexpr size_t max_paths = 3;
+        struct node {
+            int parent;
+            std::string label;
+        };
+
+        lua_State* hL;
+        budget& limit;
+        analyzer* collect;
+        int queue = 0;
+        std::vector<node> nodes;
+        std::unordered_set<const void*> visited;
+        std::unordered_map<const char*, std::vector<std::string>> targets;
+        size_t pending = 0;
+
+        finder(lua_State* hL, budget& limit, const std::vector<str>& strs, analyzer* collect = nullptr)
+            : hL(hL)
+            , limit(limit)
+            , collect(collect) {
+            for (auto& v : strs) {
+                targets[v.s];
+            }
+            pending = targets.size();
+        }
+
+        std::string path(int i, const std::string& last) {
+            std::vector<const std::string*> labels;
+            labels.push_back(&last);
+            for (; i >= 0; i = nodes[i].parent) {
+                labels.push_back(&nodes[i].label);
+            }
+            std::string res;
+            for (auto it = labels.rbegin(); it != labels.rend(); ++it) {
+                res += **it;
+            }
+            return res;
+        }
+
+        static bool isname(const char* s, size_t len) {
+            if (len == 0 || len > 32 || !(isalpha((unsigned char)s[0]) || s[0] == '_')) {
+                return false;
+            }
+            for (size_t i = 1; i < len; ++i) {
+                if (!(isalnum((unsigned char)s[i]) || s[i] == '_')) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        std::string keylabel(int idx) {
+            switch (lua_type(hL, idx)) {
+            case LUA_TSTRING: {
+                size_t len;
+                const char* s = lua_tolstring(hL, idx, &len);
+                if (isname(s, len)) {
+                    return "." + std::string(s, len);
+                }
+                return "[\"" + std::string(s, std::min<size_t>(len, 32)) + (len > 32 ? "...\"]" : "\"]");
+            }
+            case LUA_TNUMBER: {
+                char buf[64];
+                snprintf(buf, sizeof(buf), "[%.14g]", lua_tonumber(hL, idx));
+                return buf;
+            }
+            default:
+                return std::string("[") + lua_typename(hL, lua_type(hL, idx)) + "]";
+            }
+        }
+
+        void check(int idx, int parent, const std::string& label) {
+            if (lua_type(hL, idx) != LUA_TSTRING) {
+                return;
+            }
+            size_t len;
+            const char* s = lua_tolstring(hL, idx, &len);
+            if (collect && visited.insert(s).second) {
+                analyzer::visit(collect, s, len, false);
+            }
+            auto it = targets.find(s);
+            if (it == targets.end() || it->second.size() >= max_paths) {
+                return;
+            }
+            it->second.push_back(path(parent, label));
+            if (it->second.size() == max_paths) {
+                pending--;
+            }
+        }
+
+        // Pops the value on the top of the stack.
+        void enqueue(int parent, std::string label) {
+            int t = lua_type(hL, -1);
+            if (t != LUA_TTABLE && t != LUA_TFUNCTION && t != LUA_TUSERDATA) {
+                lua_pop(hL, 1);
+                return;
+            }
+            if (!visited.insert(lua_topointer(hL, -1)).second) {
+                lua_pop(hL, 1);
+                return;
+            }
+            nodes.push_back({ parent, std::move(label) });
+            lua_rawseti(hL, queue, (lua_Integer)nodes.size());
+        }
+
+        void expand(int i) {
+            if (lua_getmetatable(hL, -1)) {
+                enqueue(i, "(metatable)");
+            }
+            switch (lua_type(hL, -1)) {
+            case LUA_TTABLE:
+                lua_pushnil(hL);
+                while (lua_next(hL, -2)) {
+                    std::string label = keylabel(-2);
+                    check(-1, i, label);
+                    check(-2, i, label + "(key)");
+                    enqueue(i, label);
+                    if (lua_type(hL, -1) != LUA_TSTRING && lua_type(hL, -1) != LUA_TNUMBER) {
+                        lua_pushvalue(hL, -1);
+                        enqueue(i, label + "(key)");
+                    }
+                }
+                break;
+            case LUA_TFUNCTION:
+                for (int n = 1;; ++n) {
+                    const char* name = lua_getupvalue(hL, -1, n);
+                    if (!name) {
+                        break;
+                    }
+                    std::string label = *name ? "(upvalue " + std::string(name) + ")" : "(upvalue " + std::to_string(n) + ")";
+                    check(-1, i, label);
+                    enqueue(i, label);
+                }
+                break;
+            case LUA_TUSERDATA:
+#if LUA_VERSION_NUM >= 504
+                lua_getiuservalue(hL, -1, 1);
+                enqueue(i, "(uservalue)");
+#elif LUA_VERSION_NUM >= 502 && !defined(LUAJIT_VERSION)
+                lua_getuservalue(hL, -1);
+                enqueue(i, "(uservalue)");
+#endif
+                break;
+            default:
+                break;
+            }
+        }
+
+        void root(const char* name) {
+            nodes.push_back({ -1, name });
+            lua_rawseti(hL, queue, (lua_Integer)nodes.size());
+        }
+
+        void run() {
+            if ((pending == 0 && !collect) || lua_checkstack(hL, 8) == 0) {
+                return;
+            }
+            lua_newtable(hL);
+            queue = lua_gettop(hL);
+#if LUA_VERSION_NUM >= 502
+            lua_pushglobaltable(hL);
+#else
+            lua_pushvalue(hL, LUA_GLOBALSINDEX);
+#endif
+            visited.insert(lua_topointer(hL, -1));
+            root("_G");
+            lua_pushvalue(hL, LUA_REGISTRYINDEX);
+            visited.insert(lua_topointer(hL, -1));
+            root("registry");
+            for (size_t i = 0; i < nodes.size() && (pending > 0 || collect) && !limit.expired(); ++i) {
+                lua_rawgeti(hL, queue, (lua_Integer)i + 1);
+                expand((int)i);
+                lua_pop(hL, 1);
+            }
+        }
+
+        // The walk allocates on hL, so it runs protected there. If it fails,
+        // what it found so far is kept.
+        static int protected_run(lua_State* hL) {
+            ((finder*)lua_touserdata(hL, 1))->run();
+            return 0;
+        }
+        void pcall() {
+            if (lua_checkstack(hL, 2) == 0) {
+                return;
+            }
+            lua_pushcfunction(hL, protected_run);
+            lua_pushlightuserdata(hL, this);
+            if (lua_pcall(hL, 1, 0, 0) != 0) {
+                lua_pop(hL, 1);
+            }
+        }
+    };
+
+    // The strings are kept by pointer, so nothing may be collected until
+    // their previews are copied. The collector is restarted on every way out,
+    // an error included.
+    struct gcguard {
+        lua_State* hL;
+        bool running;
+        gcguard(lua_State* hL)
+            : hL(hL)
+            , running(lua_gcisrunning(hL)) {
+            lua_gc(hL, LUA_GCSTOP, 0);
+        }
+        ~gcguard() {
+            if (running) {
+                lua_gc(hL, LUA_GCRESTART, 0);
+            }
+        }
+    };
+
+    static std::string preview(const str& v) {
+        static const char hex[] = "0123456789abcdef";
+        std::string res;
+        size_t n = std::min<size_t>(v.len, 64);
+        for (size_t i = 0; i < n; ++i) {
+            unsigned char c = (unsigned char)v.s[i];
+            if (c >= 0x20 && c < 0x7f) {
+                res += (char)c;
+            }
+            else {
+                res += '\\';
+                res += 'x';
+                res += hex[c >> 4];
+                res += hex[c & 0xf];
+            }
+        }
+        if (v.len > n) {
+            res += "...";
+        }
+        return res;
+    }
+
+    struct topentry {
+        size_t size;
+        std::string preview;
+        std::vector<std::string> referrers;
+    };
+
+    struct dupentry {
+        uint64_t hash;
+        uint64_t count;
+        size_t size;
+        std::string preview;
+    };
+
+    static int getoption(luadbg_State* L, const char* name, int def) {
+        int v = def;
+        if (luadbg_type(L, 1) == LUA_TTABLE) {
+            if (luadbg_getfield(L, 1, name) == LUA_TNUMBER) {
+                v = (int)luadbg_tointeger(L, -1);
+            }
+            luadbg_pop(L, 1);
+        }
+        return v;
+    }
+
+    static int analyze(luadbg_State* L, lua_State* hL, protected_area& area) {
+        int topn    = std::max(0, getoption(L, "top", 20));
+        int minsize = std::max(0, getoption(L, "minSize", 256));
+        budget limit(std::max(1, getoption(L, "budget", 200)));
+
+        analyzer a(limit, (size_t)topn, (size_t)minsize);
+        std::vector<topentry> top;
+        std::vector<dupentry> dups;
+        uint64_t wasted = 0;
+        bool reachable  = false;
+        {
+            gcguard gc(hL);
+            if (!lua_foreach_string(hL, analyzer::visit, &a) && a.count == 0) {
+                // The string table can't be walked (LuaJIT), so the strings
+                // are the ones reachable from the globals and the registry.
+                // They are all interned, so there are no duplicates.
+                finder collector(hL, limit, {}, &a);
+                collector.pcall();
+                reachable = true;
+            }
+            std::sort(a.top.begin(), a.top.end(), analyzer::smaller);
+
+            std::vector<const group*> groups;
+            for (auto& [_, g] : a.groups) {
+                if (g.count > 1) {
+                    groups.push_back(&g);
+                    wasted += (g.count - 1) * g.first.len;
+                }
+            }
+            std::sort(groups.begin(), groups.end(), [](const group* a, const group* b) {
+                return (a->count - 1) * a->first.len > (b->count - 1) * b->first.len;
+            });
+            if (groups.size() > (size_t)topn) {
+                groups.resize((size_t)topn);
+            }
+            for (const group* g : groups) {
+                dups.push_back({ g->hash, g->count, g->first.len, preview(g->first) });
+            }
+
+            finder f(hL, limit, a.top);
+            f.pcall();
+            for (const str& v : a.top) {
+                top.push_back({ v.len, preview(v), std::move(f.targets[v.s]) });
+            }
+        }
+
+        luadbg_createtable(L, 0, 7);
+        luadbg_pushinteger(L, (luadbg_Integer)a.count);
+        luadbg_setfield(L, -2, "strings");
+        luadbg_pushinteger(L, (luadbg_Integer)a.bytes);
+        luadbg_setfield(L, -2, "bytes");
+        luadbg_pushinteger(L, (luadbg_Integer)wasted);
+        luadbg_setfield(L, -2, "wasted");
+        luadbg_pushboolean(L, limit.expired_);
+        luadbg_setfield(L, -2, "truncated");
+        luadbg_pushboolean(L, reachable);
+        luadbg_setfield(L, -2, "reachable");
+
+        luadbg_createtable(L, (int)top.size(), 0);
+        for (size_t i = 0; i < top.size(); ++i) {
+            const topentry& v = top[i];
+            luadbg_createtable(L, 0, 3);
+            luadbg_pushinteger(L, (luadbg_Integer)v.size);
+            luadbg_setfield(L, -2, "size");
+            luadbg_pushlstring(L, v.preview.data(), v.preview.size());
+            luadbg_setfield(L, -2, "preview");
+            luadbg_createtable(L, (int)v.referrers.size(), 0);
+            for (size_t j = 0; j < v.referrers.size(); ++j) {
+                luadbg_pushlstring(L, v.referrers[j].data(), v.referrers[j].size());
+                luadbg_rawseti(L, -2, (luadbg_Integer)j + 1);
+            }
+            luadbg_setfield(L, -2, "referrers");
+            luadbg_rawseti(L, -2, (luadbg_Integer)i + 1);
+        }
+        luadbg_setfield(L, -2, "top");
+
+        luadbg_createtable(L, (int)dups.size(), 0);
+        for (size_t i = 0; i < dups.size(); ++i) {
+            const dupentry& g = dups[i];
+            luadbg_createtable(L, 0, 5);
+            char hash[32];
+            snprintf(hash, sizeof(hash), "%016llx", (unsigned long long)g.hash);
+            luadbg_pushstring(L, hash);
+            luadbg_setfield(L, -2, "hash");
+            luadbg_pushinteger(L, (luadbg_Integer)g.count);
+            luadbg_setfield(L, -2, "count");
+            luadbg_pushinteger(L, (luadbg_Integer)g.size);
+            luadbg_setfield(L, -2, "size");
+            luadbg_pushinteger(L, (luadbg_Integer)((g.count - 1) * g.size));
+            luadbg_setfield(L, -2, "wasted");
+            luadbg_pushlstring(L, g.preview.data(), g.preview.size());
+            luadbg_setfield(L, -2, "preview");
+            luadbg_rawseti(L, -2, (luadbg_Integer)i + 1);
+        }
+        luadbg_setfield(L, -2, "duplicates");
+        return 1;
+    }
+
+    static int luaopen(luadbg_State* L) {
+        luadbg_newtable(L);
+        luadbg_pushlightuserdata(L, debughost::get_context(L));
+        static luadbgL_Reg lib[] = {
+            { "analyze", protected_call<analyze> },
+            { NULL, NULL },
+        };
+        luadbgL_setfuncs(L, lib, 1);
+        return 1;
+    }
+}
+
+LUADEBUG_FUNC
+int luaopen_luadebug_strings(luadbg_State* L) {
+    return luadebug::strings::luaopen(L);
+}
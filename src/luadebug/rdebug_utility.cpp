@@ -1,3 +1,6 @@
+#include <chrono>
+
+#include "rdebug_fork.h"
 #include "rdebug_lua.h"
 #if defined(_WIN32)
 #    include <Windows.h>
@@ -38,11 +41,41 @@ namespace luadebug::utility {
         raise(SIGINT);
         return 0;
     }
+    static int getpid(luadbg_State* L) {
+        luadbg_pushinteger(L, fork::pid());
+        return 1;
+    }
+
+    static int monotonic(luadbg_State* L) {
+        auto now = std::chrono::steady_clock::now().time_since_epoch();
+        luadbg_pushinteger(L, (luadbg_Integer)std::chrono::duration_cast<std::chrono::microseconds>(now).count());
+        return 1;
+    }
+
+    static int forkattach(luadbg_State* L) {
+        fork::set_attach(luadbg_toboolean(L, 1));
+        return 0;
+    }
+
+    static int forkchildren(luadbg_State* L) {
+        auto children = fork::children();
+        luadbg_createtable(L, (int)children.size(), 0);
+        for (size_t i = 0; i < children.size(); ++i) {
+            luadbg_pushinteger(L, children[i]);
+            luadbg_rawseti(L, -2, (luadbg_Integer)(i + 1));
+        }
+        return 1;
+    }
+
     static int luaopen(luadbg_State* L) {
         luadbg_newtable(L);
         luadbgL_Reg lib[] = {
             { "closewindow", closewindow },
             { "closeprocess", closeprocess },
+            { "getpid", getpid },
+            { "monotonic", monotonic },
+            { "forkattach", forkattach },
+            { "forkchildren", forkchildren },
             { NULL, NULL }
         };
         luadbgL_setfuncs(L, lib, 0);
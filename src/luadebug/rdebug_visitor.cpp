@@ -3,8 +3,14 @@
 #include <string.h>
 
 #include <algorithm>
+#include <atomic>
 #include <bitset>
 #include <limits>
+#include <new>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
 
 #include "compat/internal.h"
 #include "compat/table.h"
@@ -40,7 +46,12 @@ namespace luadebug::visitor {
         return ok;
     }
 
-    static int copy_to_dbg(lua_State* hL, luadbg_State* L, int idx = -1) {
+    // Strings longer than this aren't copied into the debugger. The caller
+    // makes a refvalue instead, as for tables, and reads slices of the
+    // string with visitor.strsub when it needs them.
+    static constexpr size_t LAZY_STRING = 4096;
+
+    static int copy_to_dbg(lua_State* hL, luadbg_State* L, int idx = -1, size_t maxstring = LAZY_STRING) {
         int t = lua_type(hL, idx);
         switch (t) {
         case LUA_TNIL:
@@ -64,6 +75,9 @@ namespace luadebug::visitor {
         case LUA_TSTRING: {
             size_t sz;
             const char* str = lua_tolstring(hL, idx, &sz);
+            if (sz > maxstring) {
+                return LUA_TNONE;
+            }
             luadbg_pushlstring(L, str, sz);
             break;
         }
@@ -379,6 +393,251 @@ namespace luadebug::visitor {
         return 2;
     }
 
+    // The keys of a table sorted in the order serialize.lua uses, optionally
+    // keeping only the keys that match a filter. The order is built once per
+    // table and kept until cleantablesort, so paging through it only costs
+    // the page itself.
+    struct sortslot {
+        unsigned int index;
+        bool array;
+    };
+    struct sortedtable {
+        unsigned int asize;
+        unsigned int hsize;
+        std::string filter;
+        bool prefix;
+        std::vector<sortslot> slots;
+    };
+    using sortcache = std::unordered_map<const void*, sortedtable>;
+    static int SORTCACHE = 0;
+
+    static int sortcache_gc(luadbg_State* L) {
+        sortcache* self = (sortcache*)luadbg_touserdata(L, 1);
+        self->~sortcache();
+        return 0;
+    }
+
+    static sortcache& get_sortcache(luadbg_State* L) {
+        if (LUADBG_TUSERDATA != luadbg_rawgetp(L, LUADBG_REGISTRYINDEX, &SORTCACHE)) {
+            luadbg_pop(L, 1);
+            sortcache* self = (sortcache*)luadbg_newuserdata(L, sizeof(sortcache));
+            new (self) sortcache;
+            luadbg_createtable(L, 0, 1);
+            luadbg_pushcfunction(L, sortcache_gc);
+            luadbg_setfield(L, -2, "__gc");
+            luadbg_setmetatable(L, -2);
+            luadbg_pushvalue(L, -1);
+            luadbg_rawsetp(L, LUADBG_REGISTRYINDEX, &SORTCACHE);
+        }
+        sortcache* self = (sortcache*)luadbg_touserdata(L, -1);
+        luadbg_pop(L, 1);
+        return *self;
+    }
+
+    struct sortkey {
+        sortslot slot;
+        int order;
+        lua_Number n;
+        const char* s;
+        size_t len;
+    };
+
+    static int sortkey_order(int t) {
+        switch (t) {
+        case LUA_TNUMBER: return 1;
+        case LUA_TBOOLEAN: return 2;
+        case LUA_TSTRING: return 3;
+        case LUA_TTABLE: return 4;
+        case LUA_TFUNCTION: return 5;
+        case LUA_TUSERDATA:
+        case LUA_TLIGHTUSERDATA: return 6;
+        case LUA_TTHREAD: return 7;
+        default: return 8;
+        }
+    }
+
+    static bool sortkey_less(const sortkey& a, const sortkey& b) {
+        if (a.order != b.order) {
+            return a.order < b.order;
+        }
+        switch (a.order) {
+        case 1:
+        case 2:
+            return a.n < b.n;
+        case 3: {
+            int r = memcmp(a.s, b.s, (std::min)(a.len, b.len));
+            return r < 0 || (r == 0 && a.len < b.len);
+        }
+        default:
+            return false;
+        }
+    }
+
+    // Only string and number keys have a text to match.
+    static bool sortkey_match(lua_State* hL, const sortkey& k, const std::string& filter, bool prefix) {
+        if (filter.empty()) {
+            return true;
+        }
+        std::string_view text;
+        char buf[64];
+        if (k.order == 3) {
+            text = { k.s, k.len };
+        }
+        else if (k.order == 1) {
+            int n;
+#if LUA_VERSION_NUM >= 503 || defined(LUAJIT_VERSION)
+            if (lua_isinteger(hL, -1)) {
+                n = snprintf(buf, sizeof(buf), "%lld", (long long)lua_tointeger(hL, -1));
+            }
+            else
+#endif
+            {
+                n = snprintf(buf, sizeof(buf), "%.14g", (double)k.n);
+            }
+            text = { buf, (size_t)n };
+        }
+        else {
+            return false;
+        }
+        if (prefix) {
+            return text.substr(0, filter.size()) == filter;
+        }
+        return text.find(filter) != std::string_view::npos;
+    }
+
+    // The key of the i-th slot of the array part.
+    static lua_Integer array_key(unsigned int i) {
+#ifdef LUAJIT_VERSION
+        return (lua_Integer)i;
+#else
+        return (lua_Integer)i + 1;
+#endif
+    }
+
+    static sortedtable& tablesort_build(luadbg_State* L, lua_State* hL, const void* tv, std::string filter, bool prefix) {
+        sortcache& cache   = get_sortcache(L);
+        unsigned int asize = table::array_size(tv);
+        unsigned int hsize = table::hash_size(tv);
+        auto it            = cache.find(tv);
+        if (it != cache.end() && it->second.asize == asize && it->second.hsize == hsize && it->second.prefix == prefix && it->second.filter == filter) {
+            return it->second;
+        }
+        std::vector<sortkey> keys;
+        for (unsigned int i = 0; i < asize; ++i) {
+            if (!table::get_array(hL, tv, i)) {
+                continue;
+            }
+            bool isnil = lua_isnil(hL, -1);
+            lua_pop(hL, 1);
+            if (isnil) {
+                continue;
+            }
+            lua_pushinteger(hL, array_key(i));
+            sortkey k { { i, true }, 1, (lua_Number)array_key(i), nullptr, 0 };
+            if (sortkey_match(hL, k, filter, prefix)) {
+                keys.push_back(k);
+            }
+            lua_pop(hL, 1);
+        }
+        for (unsigned int i = 0; i < hsize; ++i) {
+            if (!table::get_hash_k(hL, tv, i)) {
+                continue;
+            }
+            sortkey k { { i, false }, sortkey_order(lua_type(hL, -1)), 0, nullptr, 0 };
+            if (k.order == 1) {
+                k.n = lua_tonumber(hL, -1);
+            }
+            else if (k.order == 2) {
+                k.n = lua_toboolean(hL, -1);
+            }
+            else if (k.order == 3) {
+                // The table keeps the string alive while we sort.
+                k.s = lua_tolstring(hL, -1, &k.len);
+            }
+            if (sortkey_match(hL, k, filter, prefix)) {
+                keys.push_back(k);
+            }
+            lua_pop(hL, 1);
+        }
+        std::stable_sort(keys.begin(), keys.end(), sortkey_less);
+        sortedtable& res = cache[tv];
+        res.asize        = asize;
+        res.hsize        = hsize;
+        res.filter       = std::move(filter);
+        res.prefix       = prefix;
+        res.slots.clear();
+        res.slots.reserve(keys.size());
+        for (auto& k : keys) {
+            res.slots.push_back(k.slot);
+        }
+        return res;
+    }
+
+    static int visitor_tablesort(luadbg_State* L, lua_State* hL, protected_area& area) {
+        unsigned int start = area.optinteger<unsigned int>(L, 2, 0);
+        unsigned int count = area.optinteger<unsigned int>(L, 3, (std::numeric_limits<unsigned int>::max)());
+        std::string filter;
+        if (luadbg_type(L, 4) == LUADBG_TSTRING) {
+            auto str = area.checkstring(L, 4);
+            filter.assign(str.data(), str.size());
+        }
+        bool prefix = luadbg_toboolean(L, 5);
+        area.check_client_stack(4);
+        if (!copy_from_dbg(L, hL, area, 1, LUADBG_TTABLE)) {
+            return 0;
+        }
+        const void* tv = lua_topointer(hL, -1);
+        if (!tv) {
+            lua_pop(hL, 1);
+            return 0;
+        }
+        sortedtable& sorted = tablesort_build(L, hL, tv, std::move(filter), prefix);
+        luadbg_newtable(L);
+        luadbg_Integer n = 0;
+        size_t total     = sorted.slots.size();
+        for (size_t k = start; k < total && k - start < count; ++k) {
+            unsigned int i = sorted.slots[k].index;
+            if (sorted.slots[k].array) {
+                if (!table::get_array(hL, tv, i)) {
+                    continue;
+                }
+                luadbg_pushinteger(L, array_key(i));
+                luadbg_rawseti(L, -2, ++n);
+                refvalue::create(L, 1, refvalue::TABLE_ARRAY { i });
+                if (copy_to_dbg(hL, L) == LUA_TNONE) {
+                    luadbg_pushvalue(L, -1);
+                }
+                luadbg_rawseti(L, -3, ++n);
+                luadbg_rawseti(L, -2, ++n);
+                lua_pop(hL, 1);
+                continue;
+            }
+            if (!table::get_hash_kv(hL, tv, i)) {
+                continue;
+            }
+            if (copy_to_dbg(hL, L) == LUA_TNONE) {
+                refvalue::create(L, 1, refvalue::TABLE_HASH_KEY { i });
+            }
+            luadbg_rawseti(L, -2, ++n);
+            lua_pop(hL, 1);
+            refvalue::create(L, 1, refvalue::TABLE_HASH_VAL { i });
+            if (copy_to_dbg(hL, L) == LUA_TNONE) {
+                luadbg_pushvalue(L, -1);
+            }
+            luadbg_rawseti(L, -3, ++n);
+            luadbg_rawseti(L, -2, ++n);
+            lua_pop(hL, 1);
+        }
+        lua_pop(hL, 1);
+        luadbg_pushinteger(L, (luadbg_Integer)total);
+        return 2;
+    }
+
+    static int visitor_cleantablesort(luadbg_State* L, lua_State* hL, protected_area& area) {
+        get_sortcache(L).clear();
+        return 0;
+    }
+
     static int visitor_udread(luadbg_State* L, lua_State* hL, protected_area& area) {
         auto offset = area.checkinteger<luadbg_Integer>(L, 2);
         auto count  = area.checkinteger<luadbg_Integer>(L, 3);
@@ -453,13 +712,54 @@ namespace luadebug::visitor {
             luadbg_pushnil(L);
             return 1;
         }
-        if (copy_to_dbg(hL, L) == LUA_TNONE) {
+        if (copy_to_dbg(hL, L, -1, (std::numeric_limits<size_t>::max)()) == LUA_TNONE) {
             luadbg_pushfstring(L, "%s: %p", lua_typename(hL, lua_type(hL, -1)), lua_topointer(hL, -1));
         }
         lua_pop(hL, 1);
         return 1;
     }
 
+    static void pushstrsub(luadbg_State* L, const char* s, size_t len, luadbg_Integer i, luadbg_Integer j) {
+        if (i < 0) {
+            i = (std::max)((luadbg_Integer)len + i + 1, (luadbg_Integer)1);
+        }
+        else if (i == 0) {
+            i = 1;
+        }
+        if (j < 0) {
+            j = (luadbg_Integer)len + j + 1;
+        }
+        else if ((size_t)j > len) {
+            j = (luadbg_Integer)len;
+        }
+        if (i > j) {
+            luadbg_pushliteral(L, "");
+        }
+        else {
+            luadbg_pushlstring(L, s + i - 1, (size_t)(j - i + 1));
+        }
+        luadbg_pushinteger(L, (luadbg_Integer)len);
+    }
+
+    static int visitor_strsub(luadbg_State* L, lua_State* hL, protected_area& area) {
+        auto i = area.optinteger<luadbg_Integer>(L, 2, 1);
+        auto j = area.optinteger<luadbg_Integer>(L, 3, -1);
+        if (luadbg_type(L, 1) == LUADBG_TSTRING) {
+            size_t len;
+            const char* s = luadbg_tolstring(L, 1, &len);
+            pushstrsub(L, s, len, i, j);
+            return 2;
+        }
+        if (!copy_from_dbg(L, hL, area, 1, LUADBG_TSTRING)) {
+            return 0;
+        }
+        size_t len;
+        const char* s = lua_tolstring(hL, -1, &len);
+        pushstrsub(L, s, len, i, j);
+        lua_pop(hL, 1);
+        return 2;
+    }
+
     static int visitor_assign(luadbg_State* L, lua_State* hL, protected_area& area) {
         area.check_type(L, 1, LUADBG_TUSERDATA);
         area.check_client_stack(3);
@@ -787,7 +1087,7 @@ namespace luadebug::visitor {
             return 2;
         }
         luadbg_pushboolean(L, 1);
-        if (copy_to_dbg(hL, L) == LUA_TNONE) {
+        if (copy_to_dbg(hL, L, -1, (std::numeric_limits<size_t>::max)()) == LUA_TNONE) {
             luadbg_pushfstring(L, "%s: %p", lua_typename(hL, lua_type(hL, -1)), lua_topointer(hL, -1));
         }
         lua_pop(hL, 1);
@@ -845,6 +1145,108 @@ namespace luadebug::visitor {
         }
     }
 
+    static Proto* frame_proto(lua_State* hL, int frame, int* pc) {
+        lua_Debug ar;
+        if (lua_getstack(hL, frame, &ar) == 0) {
+            return nullptr;
+        }
+        CallInfo* ci = lua_debug2ci(hL, &ar);
+#ifdef LUAJIT_VERSION
+        if (!lua_isluafunc(hL, &ar)) {
+            return nullptr;
+        }
+#endif
+        *pc = lua_ci2pc(hL, ci);
+        return lua_ci2proto(ci);
+    }
+
+    // %p has no 0x prefix on MSVC, and the client parses these as numbers.
+    static void push_address(luadbg_State* L, const void* address) {
+        char buf[32];
+        int n = snprintf(buf, sizeof(buf), "0x%llx", (unsigned long long)(uintptr_t)address);
+        luadbg_pushlstring(L, buf, (size_t)n);
+    }
+
+    static int visitor_getpc(luadbg_State* L, lua_State* hL, protected_area& area) {
+        int pc   = -1;
+        Proto* p = frame_proto(hL, area.checkinteger<int>(L, 1), &pc);
+        if (!p || pc < 0 || pc >= lua_proto_sizecode(p)) {
+            return 0;
+        }
+        lua_instruction inst;
+        lua_proto_instruction(p, pc, &inst);
+        push_address(L, inst.address);
+        luadbg_pushinteger(L, pc);
+        return 2;
+    }
+
+    static int visitor_calltargets(luadbg_State* L, lua_State* hL, protected_area& area) {
+        int pc   = -1;
+        Proto* p = frame_proto(hL, area.checkinteger<int>(L, 1), &pc);
+        if (!p || pc < 0) {
+            return 0;
+        }
+        lua_calltarget targets[32];
+        int n = lua_proto_calltargets(p, pc, targets, 32);
+        luadbg_createtable(L, n, 0);
+        for (int i = 0; i < n; ++i) {
+            luadbg_createtable(L, 0, 2);
+            luadbg_pushinteger(L, targets[i].pc);
+            luadbg_setfield(L, -2, "pc");
+            luadbg_pushstring(L, targets[i].name);
+            luadbg_setfield(L, -2, "name");
+            luadbg_rawseti(L, -2, i + 1);
+        }
+        return 1;
+    }
+
+    static int visitor_disassemble(luadbg_State* L, lua_State* hL, protected_area& area) {
+        Proto* p = nullptr;
+        int pc   = -1;
+        switch (luadbg_type(L, 1)) {
+        case LUADBG_TNUMBER:
+            p = frame_proto(hL, area.checkinteger<int>(L, 1), &pc);
+            break;
+        case LUADBG_TUSERDATA:
+            if (!copy_from_dbg(L, hL, area, 1, LUADBG_TFUNCTION)) {
+                return area.raise_error("Need a function ref");
+            }
+            p = lua_getproto(hL, -1);
+            lua_pop(hL, 1);
+            break;
+        default:
+            return area.raise_error("Need stack level (integer) or function ref");
+        }
+        if (!p) {
+            return 0;
+        }
+        int n = lua_proto_sizecode(p);
+        luadbg_createtable(L, n, 0);
+        for (int i = 0; i < n; ++i) {
+            lua_instruction inst;
+            lua_proto_instruction(p, i, &inst);
+            luadbg_createtable(L, 0, 5);
+            push_address(L, inst.address);
+            luadbg_setfield(L, -2, "address");
+            luadbg_pushinteger(L, inst.line);
+            luadbg_setfield(L, -2, "line");
+            luadbg_pushstring(L, inst.opname);
+            luadbg_setfield(L, -2, "opname");
+            luadbg_pushstring(L, inst.operands);
+            luadbg_setfield(L, -2, "operands");
+            if (inst.comment[0]) {
+                luadbg_pushstring(L, inst.comment);
+                luadbg_setfield(L, -2, "comment");
+            }
+            luadbg_rawseti(L, -2, i + 1);
+        }
+        if (pc < 0) {
+            return 1;
+        }
+        luadbg_pushinteger(L, pc);
+        return 2;
+    }
+
     static int visitor_costatus(luadbg_State* L, lua_State* hL, protected_area& area) {
         if (!copy_from_dbg(L, hL, area, 1, LUADBG_TTHREAD)) {
             luadbg_pushstring(L, "invalid");
@@ -894,6 +1296,77 @@ namespace luadebug::visitor {
         return 1;
     }
 
+    // Every VM of the process, as tracked by the launcher. It is only there
+    // when the debugger was injected, see luadebug_setinventory.
+    using state_visitor = void (*)(void* ud, lua_State* L, const char* status, const char* version, size_t heap, int hookmask);
+    using inventory     = void (*)(void* self, state_visitor f, void* ud);
+    static std::atomic<inventory> inventory_func { nullptr };
+    static std::atomic<void*> inventory_self { nullptr };
+
+    static const char* current_version() {
+#ifdef LUAJIT_VERSION
+        return "luajit";
+#elif LUA_VERSION_NUM >= 504
+        return "lua54";
+#elif LUA_VERSION_NUM >= 503
+        return "lua53";
+#elif LUA_VERSION_NUM >= 502
+        return "lua52";
+#else
+        return "lua51";
+#endif
+    }
+
+    static void vms_push(luadbg_State* L, const void* state, const char* status, const char* version, size_t heap, int hookmask) {
+        luadbg_createtable(L, 0, 8);
+        luadbg_pushfstring(L, "%p", state);
+        luadbg_setfield(L, -2, "state");
+        luadbg_pushstring(L, status);
+        luadbg_setfield(L, -2, "status");
+        luadbg_pushstring(L, version);
+        luadbg_setfield(L, -2, "version");
+        if (heap) {
+            luadbg_pushinteger(L, (luadbg_Integer)heap);
+            luadbg_setfield(L, -2, "heap");
+        }
+        luadbg_pushinteger(L, hookmask);
+        luadbg_setfield(L, -2, "hookmask");
+        luadbg_rawseti(L, -2, (luadbg_Integer)luadbg_rawlen(L, -2) + 1);
+    }
+
+    struct vms_collect {
+        luadbg_State* L;
+        lua_State* mainL;
+    };
+
+    static void vms_visit(void* ud, lua_State* state, const char* status, const char* version, size_t heap, int hookmask) {
+        auto& c = *(vms_collect*)ud;
+        if (state == c.mainL) {
+            // Pushed first, with live values.
+            return;
+        }
+        vms_push(c.L, state, status, version, heap, hookmask);
+    }
+
+    static int visitor_vms(luadbg_State* L, lua_State* hL, protected_area& area) {
+        lua_State* mainL = lua_getmainthread(hL);
+        size_t heap      = ((size_t)lua_gc(hL, LUA_GCCOUNT, 0) << 10) + (size_t)lua_gc(hL, LUA_GCCOUNTB, 0);
+        luadbg_newtable(L);
+        vms_push(L, mainL, "attached", current_version(), heap, lua_gethookmask(mainL));
+        luadbg_rawgeti(L, -1, 1);
+        luadbg_pushinteger(L, lua_thread_count(hL));
+        luadbg_setfield(L, -2, "coroutines");
+        luadbg_pushboolean(L, 1);
+        luadbg_setfield(L, -2, "current");
+        luadbg_pop(L, 1);
+        inventory f = inventory_func;
+        if (f) {
+            vms_collect c { L, mainL };
+            f(inventory_self, vms_visit, &c);
+        }
+        return 1;
+    }
+
     static int luaopen(luadbg_State* L) {
         luadbgL_Reg l[] = {
             { "getlocal", protected_call<visitor_getlocal> },
@@ -911,12 +1384,18 @@ namespace luadebug::visitor {
             { "tablehash", protected_call<visitor_tablehash> },
             { "tablehashv", protected_call<visitor_tablehash<false>> },
             { "tablesize", protected_call<visitor_tablesize> },
+            { "tablesort", protected_call<visitor_tablesort> },
+            { "cleantablesort", protected_call<visitor_cleantablesort> },
             { "udread", protected_call<visitor_udread> },
             { "udwrite", protected_call<visitor_udwrite> },
             { "value", protected_call<visitor_value> },
+            { "strsub", protected_call<visitor_strsub> },
             { "assign", protected_call<visitor_assign> },
             { "type", protected_call<visitor_type> },
             { "getinfo", protected_call<visitor_getinfo> },
+            { "getpc", protected_call<visitor_getpc> },
+            { "calltargets", protected_call<visitor_calltargets> },
+            { "disassemble", protected_call<visitor_disassemble> },
             { "load", protected_call<visitor_load> },
             { "eval", protected_call<visitor_eval> },
             { "watch", protected_call<visitor_watch> },
@@ -924,11 +1403,13 @@ namespace luadebug::visitor {
             { "costatus", protected_call<visitor_costatus> },
             { "gccount", protected_call<visitor_gccount> },
             { "cfunctioninfo", protected_call<visitor_cfunctioninfo> },
+            { "vms", protected_call<visitor_vms> },
             { NULL, NULL },
         };
-        debughost::get(L);
+        debughost::context* ctx = debughost::get_context(L);
         luadbgL_newlibtable(L, l);
-        luadbgL_setfuncs(L, l, 0);
+        luadbg_pushlightuserdata(L, ctx);
+        luadbgL_setfuncs(L, l, 1);
         refvalue::create(L, refvalue::GLOBAL {});
         luadbg_setfield(L, -2, "_G");
         refvalue::create(L, refvalue::REGISTRY { refvalue::REGISTRY_TYPE::REGISTRY });
@@ -941,3 +1422,11 @@ LUADEBUG_FUNC
 int luaopen_luadebug_visitor(luadbg_State* L) {
     return luadebug::visitor::luaopen(L);
 }
+
+// Called by the launcher once the debugger is loaded, with the function
+// that walks the Lua states it has seen.
+LUADEBUG_FUNC
+void luadebug_setinventory(luadebug::visitor::inventory f, void* self) {
+    luadebug::visitor::inventory_self = self;
+    luadebug::visitor::inventory_func = f;
+}
@@ -0,0 +1,20 @@
+#include <sampler/sampler.h>
+
+#if defined(_WIN32)
+#    include <sampler/sampler_win32.inl>
+#elif defined(__linux__) || defined(__APPLE__)
+#    include <sampler/sampler_posix.inl>
+#else
+
+namespace luadebug::sampler {
+    target* attach(lua_State* L) {
+        return nullptr;
+    }
+    void detach(target* t) {
+    }
+    bool capture(target* t, sample& s) {
+        return false;
+    }
+}
+
+#endif
@@ -0,0 +1,26 @@
+#pragma once
+
+#include "compat/internal.h"
+
+namespace luadebug::sampler {
+    constexpr int max_native = 128;
+    constexpr int max_lua    = 64;
+
+    struct sample {
+        int nnative = 0;
+        int nlua    = 0;
+        // Return addresses, the innermost first. native[0] is the interrupted
+        // instruction.
+        void* native[max_native];
+        lua_sample_frame lua[max_lua];
+    };
+
+    struct target;
+
+    // Must be called on the thread to be sampled.
+    target* attach(lua_State* L);
+    void detach(target* t);
+    // Interrupts the target thread and captures its native and Lua stacks at
+    // the same instant. Called from the sampling thread.
+    bool capture(target* t, sample& s);
+}
@@ -0,0 +1,246 @@
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sampler/sampler.h>
+#include <signal.h>
+#include <time.h>
+
+#if defined(__APPLE__)
+#    include <sys/ucontext.h>
+#else
+#    include <ucontext.h>
+#endif
+
+#include <atomic>
+#include <cstdint>
+
+namespace luadebug::sampler {
+    enum class state : int {
+        idle,
+        requested,
+        busy,
+        filled,
+    };
+
+    struct target {
+        lua_State* L;
+        pthread_t thread;
+        uintptr_t stack_lo = 0;
+        uintptr_t stack_hi = 0;
+        sample* out        = nullptr;
+        std::atomic<state> st { state::idle };
+    };
+
+    static std::atomic<target*> active { nullptr };
+    static bool installed = false;
+    static struct sigaction previous;
+    // SIGPROF sent by capture and not handled yet, and the thread they were
+    // sent to. Any other SIGPROF belongs to whoever had the signal before.
+    static std::atomic<int> inflight { 0 };
+    static std::atomic<pthread_t> inflight_thread;
+
+    static bool getstack(uintptr_t& lo, uintptr_t& hi) {
+#if defined(__APPLE__)
+        pthread_t self = pthread_self();
+        hi             = (uintptr_t)pthread_get_stackaddr_np(self);
+        lo             = hi - pthread_get_stacksize_np(self);
+        return true;
+#else
+        pthread_attr_t attr;
+        if (pthread_getattr_np(pthread_self(), &attr) != 0) {
+            return false;
+        }
+        void* addr  = nullptr;
+        size_t size = 0;
+        int r       = pthread_attr_getstack(&attr, &addr, &size);
+        pthread_attr_destroy(&attr);
+        if (r != 0) {
+            return false;
+        }
+        lo = (uintptr_t)addr;
+        hi = lo + size;
+        return true;
+#endif
+    }
+
+    static bool getregisters(void* ucontext, uintptr_t& pc, uintptr_t& fp) {
+        auto uc = (ucontext_t*)ucontext;
+#if defined(__linux__) && defined(__x86_64__)
+        pc = (uintptr_t)uc->uc_mcontext.gregs[REG_RIP];
+        fp = (uintptr_t)uc->uc_mcontext.gregs[REG_RBP];
+        return true;
+#elif defined(__linux__) && defined(__aarch64__)
+        pc = (uintptr_t)uc->uc_mcontext.pc;
+        fp = (uintptr_t)uc->uc_mcontext.regs[29];
+        return true;
+#elif defined(__APPLE__) && defined(__x86_64__)
+        pc = (uintptr_t)uc->uc_mcontext->__ss.__rip;
+        fp = (uintptr_t)uc->uc_mcontext->__ss.__rbp;
+        return true;
+#elif defined(__APPLE__) && defined(__aarch64__)
+        pc = (uintptr_t)arm_thread_state64_get_pc(uc->uc_mcontext->__ss);
+        fp = (uintptr_t)arm_thread_state64_get_fp(uc->uc_mcontext->__ss);
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    // Walks the frame pointer chain. Every frame is checked against the stack
+    // bounds, so a frame built without a frame pointer ends the walk early
+    // instead of faulting.
+    static int walk(target* t, void* ucontext, void** frames, int max) {
+        uintptr_t pc, fp;
+        if (!getregisters(ucontext, pc, fp)) {
+            return 0;
+        }
+        int n       = 0;
+        frames[n++] = (void*)pc;
+        while (n < max) {
+            if (fp < t->stack_lo || fp + 2 * sizeof(uintptr_t) > t->stack_hi || fp % sizeof(uintptr_t) != 0) {
+                break;
+            }
+            uintptr_t next = ((uintptr_t*)fp)[0];
+            uintptr_t ret  = ((uintptr_t*)fp)[1];
+            if (ret == 0) {
+                break;
+            }
+            frames[n++] = (void*)ret;
+            if (next <= fp) {
+                break;
+            }
+            fp = next;
+        }
+        return n;
+    }
+
+    static void forward(int sig, siginfo_t* info, void* ucontext) {
+        if (previous.sa_flags & SA_SIGINFO) {
+            if (previous.sa_sigaction) {
+                previous.sa_sigaction(sig, info, ucontext);
+            }
+        }
+        else if (previous.sa_handler != SIG_DFL && previous.sa_handler != SIG_IGN) {
+            previous.sa_handler(sig);
+        }
+        // The default action would kill the process, so it is dropped.
+    }
+
+    static bool claim() {
+        if (!pthread_equal(pthread_self(), inflight_thread.load())) {
+            return false;
+        }
+        int n = inflight.load();
+        while (n > 0) {
+            if (inflight.compare_exchange_weak(n, n - 1)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    static void handler(int sig, siginfo_t* info, void* ucontext) {
+        if (!claim()) {
+            forward(sig, info, ucontext);
+            return;
+        }
+        target* t = active.load();
+        if (!t || !pthread_equal(pthread_self(), t->thread)) {
+            return;
+        }
+        state expected = state::requested;
+        if (!t->st.compare_exchange_strong(expected, state::busy)) {
+            return;
+        }
+        int saved_errno = errno;
+        sample& s       = *t->out;
+        s.nnative       = walk(t, ucontext, s.native, max_native);
+        s.nlua = lua_sample_stack(t->L, s.lua, max_lua);
+        t->st.store(state::filled);
+        errno = saved_errno;
+    }
+
+    static bool install() {
+        if (installed) {
+            return true;
+        }
+        struct sigaction sa = {};
+        sa.sa_sigaction     = handler;
+        sa.sa_flags         = SA_SIGINFO | SA_RESTART;
+        sigemptyset(&sa.sa_mask);
+        if (sigaction(SIGPROF, &sa, &previous) != 0) {
+            return false;
+        }
+        installed = true;
+        return true;
+    }
+
+    // A SIGPROF of capture still in flight must not reach the previous
+    // action, which may be the default one that kills the process. The
+    // handler is then left installed, it keeps forwarding the others.
+    static void uninstall() {
+        if (!installed || inflight.load() != 0) {
+            return;
+        }
+        if (sigaction(SIGPROF, &previous, nullptr) == 0) {
+            installed = false;
+        }
+    }
+
+    target* attach(lua_State* L) {
+        if (active.load()) {
+            return nullptr;
+        }
+        auto t    = new target;
+        t->L      = L;
+        t->thread = pthread_self();
+        if (!getstack(t->stack_lo, t->stack_hi) || !install()) {
+            delete t;
+            return nullptr;
+        }
+        active.store(t);
+        return t;
+    }
+
+    void detach(target* t) {
+        if (!t) {
+            return;
+        }
+        active.store(nullptr);
+        // Wait for a handler that may still be writing the sample.
+        while (t->st.load() == state::busy) {
+            sched_yield();
+        }
+        uninstall();
+        delete t;
+    }
+
+    bool capture(target* t, sample& s) {
+        t->out = &s;
+        t->st.store(state::requested);
+        inflight_thread.store(t->thread);
+        inflight.fetch_add(1);
+        if (pthread_kill(t->thread, SIGPROF) != 0) {
+            inflight.fetch_sub(1);
+            t->st.store(state::idle);
+            return false;
+        }
+        struct timespec ts = { 0, 100000 };
+        for (int i = 0; i < 500; ++i) {
+            if (t->st.load() == state::filled) {
+                t->st.store(state::idle);
+                return true;
+            }
+            nanosleep(&ts, nullptr);
+        }
+        state expected = state::requested;
+        if (t->st.compare_exchange_strong(expected, state::idle)) {
+            return false;
+        }
+        while (t->st.load() != state::filled) {
+            sched_yield();
+        }
+        t->st.store(state::idle);
+        return true;
+    }
+}
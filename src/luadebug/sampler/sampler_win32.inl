@@ -0,0 +1,193 @@
+//clang-format off
+#include <Windows.h>
+//clang-format on
+#include <sampler/sampler.h>
+
+#include <cstdint>
+#include <cstring>
+
+namespace luadebug::sampler {
+    struct target {
+        lua_State* L;
+        HANDLE thread;
+        uintptr_t stack_lo;
+        uintptr_t stack_hi;
+        // The stack is copied here while the thread is suspended, and is
+        // unwound after it resumes: RtlLookupFunctionEntry takes the loader
+        // and function table locks, which the suspended thread may hold.
+        unsigned char* copy;
+    };
+
+#if defined(_M_X64) || defined(_M_ARM64)
+    static void relocate(DWORD64& v, uintptr_t lo, uintptr_t hi, intptr_t delta) {
+        if (v >= lo && v < hi) {
+            v = (DWORD64)((intptr_t)v + delta);
+        }
+    }
+
+    // Moves every pointer into [lo, hi) of the copied stack and of the
+    // context to the copy, so that the unwinder never reads the live stack.
+    static void relocate(CONTEXT& ctx, uintptr_t* words, size_t n, uintptr_t lo, uintptr_t hi, intptr_t delta) {
+        for (size_t i = 0; i < n; ++i) {
+            if (words[i] >= lo && words[i] < hi) {
+                words[i] = (uintptr_t)((intptr_t)words[i] + delta);
+            }
+        }
+#    if defined(_M_X64)
+        DWORD64* regs[] = { &ctx.Rax, &ctx.Rcx, &ctx.Rdx, &ctx.Rbx, &ctx.Rsp, &ctx.Rbp, &ctx.Rsi, &ctx.Rdi, &ctx.R8, &ctx.R9, &ctx.R10, &ctx.R11, &ctx.R12, &ctx.R13, &ctx.R14, &ctx.R15 };
+        for (DWORD64* r : regs) {
+            relocate(*r, lo, hi, delta);
+        }
+#    else
+        for (DWORD64& r : ctx.X) {
+            relocate(r, lo, hi, delta);
+        }
+        relocate(ctx.Sp, lo, hi, delta);
+#    endif
+    }
+
+    static int walk(CONTEXT& ctx, uintptr_t lo, uintptr_t hi, void** frames, int max) {
+        int n = 0;
+        while (n < max) {
+#    if defined(_M_X64)
+            DWORD64 pc = ctx.Rip;
+            DWORD64 sp = ctx.Rsp;
+#    else
+            DWORD64 pc = ctx.Pc;
+            DWORD64 sp = ctx.Sp;
+#    endif
+            if (pc == 0 || sp < lo || sp >= hi) {
+                break;
+            }
+            frames[n++]         = (void*)pc;
+            DWORD64 imagebase   = 0;
+            PRUNTIME_FUNCTION f = RtlLookupFunctionEntry(pc, &imagebase, NULL);
+            if (!f) {
+                // A leaf function, the return address is on the top of the stack.
+#    if defined(_M_X64)
+                if (sp + sizeof(DWORD64) > hi) {
+                    break;
+                }
+                ctx.Rip = *(DWORD64*)sp;
+                ctx.Rsp += 8;
+#    else
+                if (ctx.Pc == ctx.Lr) {
+                    break;
+                }
+                ctx.Pc = ctx.Lr;
+#    endif
+                continue;
+            }
+            PVOID handlerdata        = NULL;
+            DWORD64 establisherframe = 0;
+            RtlVirtualUnwind(UNW_FLAG_NHANDLER, imagebase, pc, f, &ctx, &handlerdata, &establisherframe, NULL);
+        }
+        return n;
+    }
+#elif defined(_M_IX86)
+    static int walk(const CONTEXT& context, uintptr_t lo, uintptr_t hi, void** frames, int max) {
+        int n        = 0;
+        frames[n++]  = (void*)(uintptr_t)context.Eip;
+        uintptr_t fp = context.Ebp;
+        while (n < max) {
+            if (fp % sizeof(uintptr_t) != 0 || fp < lo || fp + 2 * sizeof(uintptr_t) > hi) {
+                break;
+            }
+            uintptr_t next = ((uintptr_t*)fp)[0];
+            uintptr_t ret  = ((uintptr_t*)fp)[1];
+            if (ret == 0) {
+                break;
+            }
+            frames[n++] = (void*)ret;
+            if (next <= fp) {
+                break;
+            }
+            fp = next;
+        }
+        return n;
+    }
+#endif
+
+    target* attach(lua_State* L) {
+        // GetCurrentThreadStackLimits needs Windows 8. The TEB holds the
+        // base of the stack, and its reservation starts at the allocation
+        // base of any address in it.
+        NT_TIB* tib = (NT_TIB*)NtCurrentTeb();
+        MEMORY_BASIC_INFORMATION mbi;
+        if (!VirtualQuery(&mbi, &mbi, sizeof(mbi))) {
+            return nullptr;
+        }
+        ULONG_PTR lo = (ULONG_PTR)mbi.AllocationBase;
+        ULONG_PTR hi = (ULONG_PTR)tib->StackBase;
+        HANDLE thread = NULL;
+        if (!DuplicateHandle(GetCurrentProcess(), GetCurrentThread(), GetCurrentProcess(), &thread, THREAD_SUSPEND_RESUME | THREAD_GET_CONTEXT | THREAD_QUERY_INFORMATION, FALSE, 0)) {
+            return nullptr;
+        }
+        unsigned char* copy = nullptr;
+#if defined(_M_X64) || defined(_M_ARM64)
+        copy = (unsigned char*)VirtualAlloc(NULL, hi - lo, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+        if (!copy) {
+            CloseHandle(thread);
+            return nullptr;
+        }
+#endif
+        return new target { L, thread, (uintptr_t)lo, (uintptr_t)hi, copy };
+    }
+
+    void detach(target* t) {
+        if (!t) {
+            return;
+        }
+        CloseHandle(t->thread);
+        if (t->copy) {
+            VirtualFree(t->copy, 0, MEM_RELEASE);
+        }
+        delete t;
+    }
+
+    bool capture(target* t, sample& s) {
+        // Nothing may allocate or take a lock until the thread resumes: it
+        // could be holding the heap or the loader lock.
+        if (SuspendThread(t->thread) == (DWORD)-1) {
+            return false;
+        }
+        CONTEXT context      = {};
+        context.ContextFlags = CONTEXT_FULL;
+        bool ok              = GetThreadContext(t->thread, &context);
+        if (!ok) {
+            ResumeThread(t->thread);
+            return false;
+        }
+#if defined(_M_X64) || defined(_M_ARM64)
+#    if defined(_M_X64)
+        uintptr_t sp = (uintptr_t)context.Rsp & ~(uintptr_t)(sizeof(uintptr_t) - 1);
+#    else
+        uintptr_t sp = (uintptr_t)context.Sp & ~(uintptr_t)(sizeof(uintptr_t) - 1);
+#    endif
+        bool copied = sp >= t->stack_lo && sp < t->stack_hi;
+        if (copied) {
+            memcpy(t->copy + (sp - t->stack_lo), (void*)sp, t->stack_hi - sp);
+        }
+        s.nlua = lua_sample_stack(t->L, s.lua, max_lua);
+        ResumeThread(t->thread);
+        if (copied) {
+            intptr_t delta = (intptr_t)t->copy - (intptr_t)t->stack_lo;
+            relocate(context, (uintptr_t*)(t->copy + (sp - t->stack_lo)), (t->stack_hi - sp) / sizeof(uintptr_t), sp, t->stack_hi, delta);
+            s.nnative = walk(context, sp + delta, t->stack_hi + delta, s.native, max_native);
+        }
+        else {
+#    if defined(_M_X64)
+            s.native[0] = (void*)context.Rip;
+#    else
+            s.native[0] = (void*)context.Pc;
+#    endif
+            s.nnative = 1;
+        }
+#else
+        s.nnative = walk(context, t->stack_lo, t->stack_hi, s.native, max_native);
+        s.nlua    = lua_sample_stack(t->L, s.lua, max_lua);
+        ResumeThread(t->thread);
+#endif
+        return true;
+    }
+}
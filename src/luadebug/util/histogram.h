@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint>
+
+namespace luadebug {
+    // Log-bucketed histogram with a fixed size. Every power of two is split
+    // into 4 buckets, so a value is known within 25%. Values of 2^33 and
+    // more share the last bucket.
+    struct histogram {
+        static constexpr int sub_bits = 2;
+        static constexpr int sub      = 1 << sub_bits;
+        static constexpr int size     = 32 * sub;
+
+        uint64_t count = 0;
+        uint64_t total = 0;
+        uint64_t max   = 0;
+        uint32_t buckets[size] {};
+
+        static int bucket(uint64_t v) {
+            if (v < sub) {
+                return (int)v;
+            }
+            int e = 63;
+            while (!(v >> e)) {
+                e--;
+            }
+            int i = (e - sub_bits + 1) * sub + (int)((v >> (e - sub_bits)) & (sub - 1));
+            return i < size ? i : size - 1;
+        }
+
+        static uint64_t lower(int i) {
+            if (i < sub) {
+                return (uint64_t)i;
+            }
+            int e = i / sub + sub_bits - 1;
+            return (uint64_t)(sub + i % sub) << (e - sub_bits);
+        }
+
+        void add(uint64_t v) {
+            count++;
+            total += v;
+            if (v > max) {
+                max = v;
+            }
+            uint32_t& n = buckets[bucket(v)];
+            if (n != UINT32_MAX) {
+                n++;
+            }
+        }
+    };
+}
@@ -128,9 +128,9 @@ namespace luadebug {
             }
         }
 
-        protected_area(luadbg_State* L)
+        protected_area(luadbg_State* L, lua_State* hL)
             : L(L)
-            , hL(debughost::get(L))
+            , hL(hL)
             , top(lua_gettop(hL)) {
             check_recursive();
         };
@@ -152,7 +152,8 @@ namespace luadebug {
         using visitor = int (*)(luadbg_State* L, lua_State* hL, protected_area& area);
 
         static inline int call(luadbg_State* L, visitor func) {
-            protected_area area(L);
+            auto ctx = (debughost::context*)luadbg_touserdata(L, luadbg_upvalueindex(1));
+            protected_area area(L, ctx->current);
             lua_State* hL = area.get_client();
             try {
                 int r = func(L, hL, area);
@@ -0,0 +1,257 @@
+#include <binding/binding.h>
+#include <dirent.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <lua.hpp>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace query_process {
+    struct process {
+        int pid = 0;
+        std::string name;
+        std::string version;
+        bool lua      = false;
+        bool debugger = false;
+    };
+
+    static std::string_view basename(std::string_view path) {
+        size_t pos = path.find_last_of('/');
+        if (pos == std::string_view::npos) {
+            return path;
+        }
+        return path.substr(pos + 1);
+    }
+
+    static std::string_view dirname(std::string_view path) {
+        size_t pos = path.find_last_of('/');
+        if (pos == std::string_view::npos) {
+            return {};
+        }
+        return path.substr(0, pos);
+    }
+
+    static bool starts_with(std::string_view s, std::string_view prefix) {
+        return s.substr(0, prefix.size()) == prefix;
+    }
+
+    // liblua5.4.so, liblua.so.5.3, liblua54.so, libluajit-5.1.so.2, lua5.1, luajit
+    static std::string detect_version(std::string_view filename) {
+        if (filename.find("luajit") != std::string_view::npos) {
+            return "luajit";
+        }
+        size_t pos = filename.find("lua");
+        if (pos == std::string_view::npos) {
+            return {};
+        }
+        for (size_t i = pos + 3; i + 1 < filename.size(); ++i) {
+            if (filename[i] != '5') {
+                continue;
+            }
+            char minor = filename[i + 1] == '.' && i + 2 < filename.size() ? filename[i + 2] : filename[i + 1];
+            if (minor >= '1' && minor <= '4') {
+                return std::string("lua5") + minor;
+            }
+        }
+        return "lua";
+    }
+
+    // Skips `lua` or `luajit` followed by a version made of [-.0-9].
+    static bool skip_lua_version(std::string_view& s) {
+        if (!starts_with(s, "lua")) {
+            return false;
+        }
+        s.remove_prefix(3);
+        if (starts_with(s, "jit")) {
+            s.remove_prefix(3);
+        }
+        while (!s.empty() && (s[0] == '-' || s[0] == '.' || (s[0] >= '0' && s[0] <= '9'))) {
+            s.remove_prefix(1);
+        }
+        return true;
+    }
+
+    // liblua(jit)?[-.0-9]*\.so(\.[.0-9]*)? for a library, lua(jit)?[-.0-9]*
+    // for an executable. Other libraries, like libluasocket.so, are not the
+    // runtime.
+    static bool is_lua_runtime(std::string_view filename) {
+        if (starts_with(filename, "lib")) {
+            filename.remove_prefix(3);
+            if (!skip_lua_version(filename)) {
+                return false;
+            }
+            // The dot of .so went with the version.
+            if (!starts_with(filename, "so")) {
+                return false;
+            }
+            filename.remove_prefix(2);
+            return filename.empty() || (filename[0] == '.' && filename.find_first_not_of(".0123456789") == std::string_view::npos);
+        }
+        return skip_lua_version(filename) && filename.empty();
+    }
+
+    static bool read_comm(process& p) {
+        char path[64];
+        snprintf(path, sizeof(path), "/proc/%d/comm", p.pid);
+        FILE* f = fopen(path, "r");
+        if (!f) {
+            return false;
+        }
+        char buf[256];
+        bool ok = fgets(buf, sizeof(buf), f) != nullptr;
+        fclose(f);
+        if (!ok) {
+            return false;
+        }
+        p.name = buf;
+        while (!p.name.empty() && (p.name.back() == '\n' || p.name.back() == '\r')) {
+            p.name.pop_back();
+        }
+        return true;
+    }
+
+    static void read_maps(process& p) {
+        char path[64];
+        snprintf(path, sizeof(path), "/proc/%d/maps", p.pid);
+        FILE* f = fopen(path, "r");
+        if (!f) {
+            return;
+        }
+        char buf[4096];
+        std::string last;
+        while (fgets(buf, sizeof(buf), f)) {
+            const char* file = strchr(buf, '/');
+            if (!file) {
+                continue;
+            }
+            std::string_view filepath(file);
+            while (!filepath.empty() && filepath.back() == '\n') {
+                filepath.remove_suffix(1);
+            }
+            if (filepath == last) {
+                continue;
+            }
+            last = filepath;
+            std::string_view filename = basename(filepath);
+            if (filename == "luadebug.so") {
+                // runtime/<platform>/<luaVersion>/luadebug.so
+                p.debugger = true;
+                p.version  = basename(dirname(filepath));
+            }
+            else if (!p.lua && is_lua_runtime(filename)) {
+                p.lua = true;
+                if (p.version.empty()) {
+                    p.version = detect_version(filename);
+                }
+            }
+        }
+        fclose(f);
+    }
+
+    static std::vector<int> list_pids() {
+        std::vector<int> pids;
+        DIR* dir = opendir("/proc");
+        if (!dir) {
+            return pids;
+        }
+        while (struct dirent* entry = readdir(dir)) {
+            char* end;
+            long pid = strtol(entry->d_name, &end, 10);
+            if (*end == '\0' && pid > 0) {
+                pids.push_back((int)pid);
+            }
+        }
+        closedir(dir);
+        return pids;
+    }
+
+    // Only the processes with a Lua runtime or the debugger mapped are
+    // reported. Lua may be linked statically, so with byname the processes of
+    // that name are reported when none of them maps a runtime.
+    static std::vector<process> scan(const char* name, bool byname) {
+        std::vector<int> pids = list_pids();
+        size_t nthreads       = std::clamp<size_t>(std::thread::hardware_concurrency(), 1, 8);
+        nthreads              = std::min(nthreads, std::max<size_t>(pids.size() / 256, 1));
+        std::vector<std::vector<process>> results(nthreads);
+        std::vector<std::vector<process>> named(nthreads);
+        auto worker = [&](size_t id) {
+            for (size_t i = id; i < pids.size(); i += nthreads) {
+                process p;
+                p.pid = pids[i];
+                if (!read_comm(p)) {
+                    continue;
+                }
+                if (name && p.name != name) {
+                    continue;
+                }
+                read_maps(p);
+                if (p.lua || p.debugger) {
+                    results[id].emplace_back(std::move(p));
+                }
+                else if (name && byname) {
+                    named[id].emplace_back(std::move(p));
+                }
+            }
+        };
+        std::vector<std::thread> threads;
+        for (size_t id = 1; id < nthreads; ++id) {
+            threads.emplace_back(worker, id);
+        }
+        worker(0);
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        std::vector<process> res;
+        for (auto& r : results) {
+            std::move(r.begin(), r.end(), std::back_inserter(res));
+        }
+        if (res.empty()) {
+            for (auto& r : named) {
+                std::move(r.begin(), r.end(), std::back_inserter(res));
+            }
+        }
+        std::sort(res.begin(), res.end(), [](const process& a, const process& b) {
+            return a.pid < b.pid;
+        });
+        return res;
+    }
+
+    static int lscan(lua_State* L) {
+        const char* name         = luaL_optstring(L, 1, nullptr);
+        bool byname              = lua_toboolean(L, 2);
+        std::vector<process> res = scan(name, byname);
+        lua_createtable(L, (int)res.size(), 0);
+        for (size_t i = 0; i < res.size(); ++i) {
+            const process& p = res[i];
+            lua_createtable(L, 0, 4);
+            lua_pushinteger(L, p.pid);
+            lua_setfield(L, -2, "pid");
+            lua_pushlstring(L, p.name.data(), p.name.size());
+            lua_setfield(L, -2, "name");
+            if (!p.version.empty()) {
+                lua_pushlstring(L, p.version.data(), p.version.size());
+                lua_setfield(L, -2, "luaVersion");
+            }
+            lua_pushboolean(L, p.debugger);
+            lua_setfield(L, -2, "debugger");
+            lua_rawseti(L, -2, (lua_Integer)(i + 1));
+        }
+        return 1;
+    }
+}
+
+extern "C" int luaopen_query_process(lua_State* L) {
+    luaL_Reg lib[] = {
+        { "scan", query_process::lscan },
+        { NULL, NULL },
+    };
+    luaL_newlib(L, lib);
+    return 1;
+}
+
+static ::bee::lua::callfunc _init(::bee::lua::register_module, "query_process", luaopen_query_process);
@@ -0,0 +1,146 @@
+-- luamake -test dap_bench
+-- luamake lua test/dap_bench.lua [rounds] [runtime...]
+--
+-- Launches test/dap_bench/workload.lua under the debugger for each runtime in
+-- publish/runtime, drives it over DAP and prints one json object per line:
+--   {"runtime":"lua54","op":"stackTrace","count":20,"min":..,"p50":..,"p90":..,"p99":..,"max":..}
+-- All times are in milliseconds.
+
+package.path = "./?.lua;extension/script/?.lua;3rd/json.lua/?.lua"
+package.loaded["common.json"] = require "json"
+
+local fs = require "bee.filesystem"
+local dap = require "test.dap_client"
+
+local ROUNDS <const> = tonumber(arg[1]) or 20
+local PORT <const> = 4280
+local WORKLOAD <const> = fs.absolute(fs.path "test/dap_bench/workload.lua"):string()
+
+local now = dap.now
+
+local function percentile(sorted, p)
+    return sorted[math.max(1, math.ceil(#sorted * p))]
+end
+
+local function report(version, op, samples)
+    table.sort(samples)
+    print(('{"runtime":"%s","op":"%s","count":%d,"min":%.3f,"p50":%.3f,"p90":%.3f,"p99":%.3f,"max":%.3f}'):format(
+        version,
+        op,
+        #samples,
+        samples[1],
+        percentile(samples, 0.50),
+        percentile(samples, 0.90),
+        percentile(samples, 0.99),
+        samples[#samples]
+    ))
+end
+
+local function timeit(samples, op, f)
+    local clock = now()
+    local res = f()
+    local t = samples[op]
+    if not t then
+        t = {}
+        samples[op] = t
+    end
+    t[#t+1] = (now() - clock) * 1000
+    return res
+end
+
+local OPS <const> = {
+    "setBreakpoints->stopped",
+    "stackTrace",
+    "scopes",
+    "variables",
+    "evaluate",
+    "stepOver",
+    "stepIn",
+    "stepOut",
+    "continue",
+}
+
+local function bench(version, port)
+    local content = dap.readall(WORKLOAD)
+    local source = { path = WORKLOAD }
+    local line = dap.findline(content, "dap_bench: breakpoint")
+    local s = dap.session(version, port, WORKLOAD)
+    local ok, err = pcall(function()
+        s.launch()
+        s.request("configurationDone", {})
+
+        local samples = {}
+        local function step(op, command, threadId)
+            timeit(samples, op, function()
+                s.request(command, { threadId = threadId })
+                s.event "stopped"
+            end)
+        end
+        for _ = 1, ROUNDS do
+            local stopped = timeit(samples, "setBreakpoints->stopped", function()
+                s.request("setBreakpoints", {
+                    source = source,
+                    breakpoints = { { line = line } },
+                    sourceContent = content,
+                })
+                return s.event "stopped"
+            end)
+            local threadId = stopped.threadId
+            local frames = timeit(samples, "stackTrace", function()
+                return s.request("stackTrace", { threadId = threadId, startFrame = 0, levels = 1000 }).stackFrames
+            end)
+            local frameId = frames[1].id
+            local scopes = timeit(samples, "scopes", function()
+                return s.request("scopes", { frameId = frameId }).scopes
+            end)
+            local locals = s.request("variables", { variablesReference = scopes[1].variablesReference }).variables
+            local ref
+            for _, var in ipairs(locals) do
+                if var.name == "t" then
+                    ref = var.variablesReference
+                end
+            end
+            timeit(samples, "variables", function()
+                s.request("variables", { variablesReference = assert(ref) })
+            end)
+            timeit(samples, "evaluate", function()
+                s.request("evaluate", { expression = "#t", frameId = frameId, context = "watch" })
+            end)
+            s.request("setBreakpoints", {
+                source = source,
+                breakpoints = {},
+                sourceContent = content,
+            })
+            step("stepOver", "next", threadId)
+            step("stepIn", "stepIn", threadId)
+            step("stepOut", "stepOut", threadId)
+            timeit(samples, "continue", function()
+                s.request("continue", { threadId = threadId })
+            end)
+        end
+        for _, op in ipairs(OPS) do
+            report(version, op, samples[op])
+        end
+    end)
+    s.close()
+    if not ok then
+        io.stderr:write(("%s: %s\n"):format(version, err))
+        return false
+    end
+    return true
+end
+
+local versions = {}
+for i = 2, #arg do
+    versions[#versions+1] = arg[i]
+end
+
+local res = true
+for i, version in ipairs(dap.runtimes(versions)) do
+    if not bench(version, PORT + i) then
+        res = false
+    end
+end
+if not res then
+    os.exit(1)
+end
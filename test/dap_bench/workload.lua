@@ -0,0 +1,30 @@
+-- Workload driven by test/dap_bench.lua. It must run on every supported
+-- runtime, so keep it to the Lua 5.1 subset.
+
+local DEPTH = 200
+
+local entities = {}
+for i = 1, 10000 do
+    entities[i] = { id = i, name = "entity_" .. i }
+end
+
+local function touch(t)
+    return #t
+end
+
+local function leaf(t)
+    local n = 0 -- dap_bench: breakpoint
+    n = n + touch(t)
+    return n
+end
+
+local function deep(level, t)
+    if level == 0 then
+        return leaf(t)
+    end
+    return deep(level - 1, t) + 0
+end
+
+while true do
+    deep(DEPTH, entities)
+end
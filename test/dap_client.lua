@@ -0,0 +1,177 @@
+-- Minimal headless DAP client used by the benchmarks in test/.
+-- Expects package.path to contain "extension/script/?.lua".
+
+local platform = require "bee.platform"
+local fs = require "bee.filesystem"
+local sp = require "bee.subprocess"
+local network = require "common.network"
+local select = require "common.select"
+
+local TIMEOUT <const> = 60
+
+local m = {}
+
+-- The client busy-polls while it waits, so its cpu time follows wall time.
+m.now = os.clock
+do
+    local ok, time = pcall(require, "bee.time")
+    if ok then
+        m.now = function() return time.monotonic() / 1000 end
+    end
+end
+
+function m.readall(filename)
+    local f <close> = assert(io.open(filename, "rb"))
+    return f:read "a"
+end
+
+function m.findline(content, mark)
+    local n = 0
+    for line in content:gmatch "([^\n]*)\n" do
+        n = n + 1
+        if line:find(mark, 1, true) then
+            return n
+        end
+    end
+    error(("Cannot found `%s`."):format(mark))
+end
+
+local function runtime_platform()
+    local arch = platform.Arch == "x86_64" and "x64" or platform.Arch
+    if platform.os == "windows" then
+        return "win32-"..(arch == "x86" and "ia32" or arch)
+    elseif platform.os == "macos" then
+        return "darwin-"..arch
+    end
+    return "linux-"..arch
+end
+
+function m.runtimes(list)
+    if #list > 0 then
+        return list
+    end
+    local dir = fs.path "publish/runtime" / runtime_platform()
+    for _, version in ipairs { "lua51", "lua52", "lua53", "lua54", "luajit" } do
+        if fs.exists(dir / version) then
+            list[#list+1] = version
+        end
+    end
+    return list
+end
+
+function m.luaexe(version)
+    return fs.path "publish/runtime" / runtime_platform() / version / (platform.os == "windows" and "lua.exe" or "lua")
+end
+
+function m.run(version, ...)
+    local process = assert(sp.spawn {
+        m.luaexe(version),
+        ...
+    })
+    return process:wait()
+end
+
+function m.session(version, port, ...)
+    local server = network("listen:127.0.0.1:"..port)
+    local process = assert(sp.spawn {
+        m.luaexe(version),
+        "-e", ("dofile[[%s]];DBG[[c:127.0.0.1:%d]]"):format(fs.absolute(fs.path "publish/script/launch.lua"):string(), port),
+        ...
+    })
+    local seq = 0
+    local queue = {}
+    local s = {}
+
+    local function recv(match)
+        for i, pkg in ipairs(queue) do
+            if match(pkg) then
+                table.remove(queue, i)
+                return pkg
+            end
+        end
+        local deadline = m.now() + TIMEOUT
+        while true do
+            local pkg = server.recvmsg()
+            if pkg then
+                if match(pkg) then
+                    return pkg
+                end
+                queue[#queue+1] = pkg
+            else
+                if m.now() > deadline then
+                    error "Timeout."
+                end
+                select.update(0)
+            end
+        end
+    end
+
+    function s.send(command, arguments)
+        seq = seq + 1
+        server.sendmsg {
+            type = "request",
+            seq = seq,
+            command = command,
+            arguments = arguments,
+        }
+        return seq
+    end
+
+    function s.response(request_seq)
+        local pkg = recv(function(pkg)
+            return pkg.type == "response" and pkg.request_seq == request_seq
+        end)
+        if not pkg.success then
+            error(("`%s` failed: %s"):format(pkg.command, pkg.message))
+        end
+        return pkg.body
+    end
+
+    function s.request(command, arguments)
+        return s.response(s.send(command, arguments))
+    end
+
+    function s.event(name)
+        return recv(function(pkg)
+            return pkg.type == "event" and pkg.event == name
+        end).body
+    end
+
+    function s.launch()
+        s.request("initialize", {
+            clientID = "dap_client",
+            adapterID = "lua",
+            pathFormat = "path",
+            linesStartAt1 = true,
+            columnsStartAt1 = true,
+        })
+        s.event "initialized"
+        s.request("launch", {
+            type = "lua",
+            request = "launch",
+            name = "dap_client",
+            luaVersion = version,
+            sourceCoding = "utf8",
+            console = "internalConsole",
+            configuration = { variables = {} },
+        })
+    end
+
+    function s.wait()
+        local exitcode = process:wait()
+        server.closeall()
+        return exitcode
+    end
+
+    function s.close()
+        pcall(s.send, "disconnect", { terminateDebuggee = true })
+        pcall(select.update, 0)
+        process:kill()
+        process:wait()
+        server.closeall()
+    end
+
+    return s
+end
+
+return m
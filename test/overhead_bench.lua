@@ -0,0 +1,136 @@
+-- luamake -test overhead_bench
+-- luamake lua test/overhead_bench.lua [repeat] [runtime...]
+--
+-- Runs the workloads of test/overhead_bench/workload.lua on each runtime in
+-- publish/runtime, without the debugger and under several debugger modes, and
+-- prints one json object per line:
+--   {"runtime":"lua54","workload":"fib","mode":"hot","seconds":..,"slowdown":..}
+-- The slowdown is relative to the same workload without the debugger.
+
+package.path = "./?.lua;extension/script/?.lua;3rd/json.lua/?.lua"
+package.loaded["common.json"] = require "json"
+
+local fs = require "bee.filesystem"
+local dap = require "test.dap_client"
+
+local REPEAT <const> = tonumber(arg[1]) or 3
+local WORKLOAD <const> = fs.absolute(fs.path "test/overhead_bench/workload.lua"):string()
+local UNRELATED <const> = fs.absolute(fs.path "test/overhead_bench/unrelated.lua"):string()
+local OUTPUT <const> = fs.absolute(fs.path "build/overhead_bench.txt"):string()
+
+local WORKLOADS <const> = { "fib", "table", "string", "coroutine", "alloc" }
+
+local port = 4380
+
+local function setBreakpoint(s, filename, mark, condition)
+    local content = dap.readall(filename)
+    s.request("setBreakpoints", {
+        source = { path = filename },
+        breakpoints = { { line = dap.findline(content, mark), condition = condition } },
+        sourceContent = content,
+    })
+end
+
+local MODES <const> = {
+    { name = "idle" },
+    { name = "unrelated", setup = function(s)
+        setBreakpoint(s, UNRELATED, "overhead_bench: unrelated", "false")
+    end },
+    { name = "hot", setup = function(s, workload)
+        setBreakpoint(s, WORKLOAD, "overhead_bench: hot "..workload, "false")
+    end },
+    { name = "funcbp", setup = function(s)
+        s.request("setFunctionBreakpoints", {
+            breakpoints = { { name = "never_called" } },
+        })
+    end },
+    { name = "step", setup = function(s)
+        setBreakpoint(s, WORKLOAD, "overhead_bench: step")
+    end, run = function(s)
+        local threadId = s.event "stopped".threadId
+        s.request("setBreakpoints", {
+            source = { path = WORKLOAD },
+            breakpoints = {},
+        })
+        s.request("next", { threadId = threadId })
+        s.event "stopped"
+        s.request("continue", { threadId = threadId })
+    end },
+}
+
+local function result()
+    local seconds = tonumber(dap.readall(OUTPUT))
+    os.remove(OUTPUT)
+    return seconds
+end
+
+local function run_none(version, workload)
+    assert(dap.run(version, WORKLOAD, workload, OUTPUT) == 0)
+    return result()
+end
+
+local function run_mode(version, workload, mode)
+    port = port + 1
+    local s = dap.session(version, port, WORKLOAD, workload, OUTPUT)
+    local ok, err = pcall(function()
+        s.launch()
+        if mode.setup then
+            mode.setup(s, workload)
+        end
+        s.request("configurationDone", {})
+        if mode.run then
+            mode.run(s)
+        end
+    end)
+    if not ok then
+        s.close()
+        error(err)
+    end
+    assert(s.wait() == 0)
+    return result()
+end
+
+local function best(f, ...)
+    local min = math.huge
+    for _ = 1, REPEAT do
+        min = math.min(min, f(...))
+    end
+    return min
+end
+
+local function report(version, workload, mode, seconds, baseline)
+    print(('{"runtime":"%s","workload":"%s","mode":"%s","seconds":%.6f,"slowdown":%.3f}'):format(
+        version,
+        workload,
+        mode,
+        seconds,
+        seconds / baseline
+    ))
+end
+
+local versions = {}
+for i = 2, #arg do
+    versions[#versions+1] = arg[i]
+end
+
+fs.create_directories(fs.path(OUTPUT):parent_path())
+
+local res = true
+for _, version in ipairs(dap.runtimes(versions)) do
+    local ok, err = pcall(function()
+        for _, workload in ipairs(WORKLOADS) do
+            local baseline = best(run_none, version, workload)
+            report(version, workload, "none", baseline, baseline)
+            for _, mode in ipairs(MODES) do
+                report(version, workload, mode.name, best(run_mode, version, workload, mode), baseline)
+            end
+        end
+    end)
+    if not ok then
+        io.stderr:write(("%s: %s\n"):format(version, err))
+        res = false
+    end
+end
+if not res then
+    os.exit(1)
+end
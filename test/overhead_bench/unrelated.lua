@@ -0,0 +1,14 @@
+-- Loaded by workload.lua but never called in the hot path, so a breakpoint
+-- here measures the cost of having breakpoints in other files.
+
+local m = {}
+
+function m.unrelated(n)
+    local sum = 0 -- overhead_bench: unrelated
+    for i = 1, n do
+        sum = sum + i
+    end
+    return sum
+end
+
+return m
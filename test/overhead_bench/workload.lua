@@ -0,0 +1,79 @@
+-- lua workload.lua <name> <output>
+--
+-- Runs one workload of test/overhead_bench.lua and writes the elapsed cpu
+-- time to <output>. It must run on every supported runtime, so keep it to
+-- the Lua 5.1 subset.
+
+local name, output = ...
+local dir = debug.getinfo(1, "S").source:sub(2):match "(.*[/\\])" or "./"
+local unrelated = dofile(dir .. "unrelated.lua")
+
+local function fib(n)
+    if n < 2 then -- overhead_bench: hot fib
+        return n
+    end
+    return fib(n - 1) + fib(n - 2)
+end
+
+local workloads = {}
+
+function workloads.fib()
+    fib(30)
+end
+
+function workloads.table()
+    local t = {}
+    for i = 1, 200000 do
+        t[i] = i
+        t["k" .. (i % 1000)] = i -- overhead_bench: hot table
+    end
+    local sum = 0
+    for _ = 1, 10 do
+        for i = 1, #t do
+            sum = sum + t[i]
+        end
+    end
+    return sum
+end
+
+function workloads.string()
+    local n = 0
+    for i = 1, 100000 do
+        local s = string.format("%d:%s", i, "value") -- overhead_bench: hot string
+        s = s:upper():gsub("VALUE", "v")
+        n = n + #s
+    end
+    return n
+end
+
+function workloads.coroutine()
+    local co = coroutine.wrap(function()
+        while true do
+            coroutine.yield() -- overhead_bench: hot coroutine
+        end
+    end)
+    for _ = 1, 300000 do
+        co()
+    end
+end
+
+function workloads.alloc()
+    local keep
+    for i = 1, 1000000 do
+        keep = { i, x = i } -- overhead_bench: hot alloc
+    end
+    return keep
+end
+
+local function run()
+    unrelated.unrelated(1)
+    local clock = os.clock()
+    workloads[name]()
+    return os.clock() - clock
+end
+
+local elapsed = run() -- overhead_bench: step
+
+local f = assert(io.open(output, "wb"))
+f:write(string.format("%.6f", elapsed))
+f:close()
@@ -0,0 +1,127 @@
+-- luamake lua test/transport_bench.lua [delay_ms] [bandwidth_kbps]
+--
+-- Sends typical large DAP payloads over a loopback connection, with and
+-- without lz4 compression, and reports the latency over a simulated link.
+
+package.path = "extension/script/?.lua;3rd/json.lua/?.lua"
+package.loaded["common.json"] = require "json"
+
+local network = require "common.network"
+local select = require "common.select"
+local base64 = require "common.base64"
+
+local DELAY <const> = tonumber(arg[1]) or 50
+local BANDWIDTH <const> = (tonumber(arg[2]) or 10 * 1024) * 1024 / 8
+local ROUNDS <const> = 10
+
+local json = require "common.json"
+local port = 4279
+
+local function readall(filename)
+    local f <close> = assert(io.open(filename, "rb"))
+    return f:read "a"
+end
+
+local function variables_payload()
+    local variables = {}
+    for i = 1, 2000 do
+        variables[i] = {
+            name = ("[%d]"):format(i),
+            value = ("{x=%d, y=%d, name=\"entity_%d\"}"):format(i, i * 2, i),
+            type = "table",
+            variablesReference = i + 100,
+            evaluateName = ("entities[%d]"):format(i),
+        }
+    end
+    return {
+        type = "response",
+        seq = 0,
+        command = "variables",
+        request_seq = 1,
+        success = true,
+        body = { variables = variables },
+    }
+end
+
+local function source_payload()
+    return {
+        type = "response",
+        seq = 0,
+        command = "source",
+        request_seq = 1,
+        success = true,
+        body = { content = readall "extension/script/backend/worker.lua" },
+    }
+end
+
+local function memory_payload()
+    local t = {}
+    for i = 1, 64 * 1024 do
+        t[i] = string.char(i % 16)
+    end
+    return {
+        type = "response",
+        seq = 0,
+        command = "readMemory",
+        request_seq = 1,
+        success = true,
+        body = {
+            address = "0",
+            data = base64.encode(table.concat(t)),
+        },
+    }
+end
+
+local function transfer(server, client, pkg)
+    local bytes = 0
+    local send = server.send
+    function server.send(data)
+        bytes = bytes + #data
+        send(data)
+    end
+    local clock = os.clock()
+    server.sendmsg(pkg)
+    local res
+    repeat
+        select.update(0)
+        res = client.recvmsg()
+    until res
+    server.send = send
+    return bytes, os.clock() - clock
+end
+
+local function bench(name, pkg, compress)
+    port = port + 1
+    local server = network("listen:127.0.0.1:"..port)
+    local client = network("connect:127.0.0.1:"..port)
+    server.compress(compress)
+    local bytes, cpu = 0, 0
+    for _ = 1, ROUNDS do
+        local b, c = transfer(server, client, pkg)
+        bytes = bytes + b
+        cpu = cpu + c
+    end
+    server.closeall()
+    bytes = bytes / ROUNDS
+    cpu = cpu / ROUNDS
+    local latency = DELAY / 1000 + bytes / BANDWIDTH + cpu
+    local size = #json.encode(pkg)
+    print(("%-10s %-5s %10d bytes %8.2f ms cpu %8.2f ms latency %10.1f KB/s"):format(
+        name,
+        compress and "lz4" or "raw",
+        math.floor(bytes),
+        cpu * 1000,
+        latency * 1000,
+        size / latency / 1024
+    ))
+end
+
+print(("delay %d ms, bandwidth %d kbps"):format(DELAY, BANDWIDTH * 8 // 1024))
+for _, payload in ipairs {
+    { "variables", variables_payload() },
+    { "source", source_payload() },
+    { "memory", memory_payload() },
+} do
+    bench(payload[1], payload[2], false)
+    bench(payload[1], payload[2], true)
+end